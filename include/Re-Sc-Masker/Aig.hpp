@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// And-inverter graph with XOR nodes (XAG) for the bit-level stage.
+/// A literal is `node * 2 + complemented`, node 0 is the constant false, so literals 0/1 are false/true.
+/// Gates are hashed structurally as they are built: a gate with the same fanins is only built once,
+/// and a NOT is a complemented edge which costs no node at all.
+/// XOR nodes are kept since a masked XOR is linear, while an XOR made of ANDs would need three masked ANDs.
+class Aig {
+public:
+    using Lit = std::uint32_t;
+    static constexpr Lit FALSE = 0, TRUE = 1;
+
+    enum class NodeKind : std::uint8_t { Const, Input, And, Xor };
+    struct Node {
+        NodeKind kind;
+        /// Fanins of gates, both are plain (not complemented) for XOR nodes
+        Lit a = FALSE, b = FALSE;
+        /// Names of inputs
+        std::string name;
+    };
+
+    Aig() { nodes.push_back(Node{NodeKind::Const, FALSE, FALSE, ""}); }
+
+    static Lit neg(Lit l) { return l ^ 1; }
+    static bool isNeg(Lit l) { return l & 1; }
+    static std::uint32_t nodeOf(Lit l) { return l >> 1; }
+    static Lit litOf(std::uint32_t node) { return node << 1; }
+
+    /// The input named `name`, created on the first call
+    Lit mkInput(const std::string &name);
+    Lit mkAnd(Lit a, Lit b);
+    Lit mkXor(Lit a, Lit b);
+    Lit mkOr(Lit a, Lit b) { return neg(mkAnd(neg(a), neg(b))); }
+    Lit mkEq(Lit a, Lit b) { return neg(mkXor(a, b)); }
+
+    const Node &node(std::uint32_t id) const { return nodes[id]; }
+    /// #nodes, including the constant node and inputs. Node ids are in topological order.
+    size_t size() const { return nodes.size(); }
+    size_t and_count = 0, xor_count = 0;
+
+private:
+    Lit mkGate(NodeKind kind, Lit a, Lit b);
+
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, std::uint32_t> inputs;
+    /// (a, b) -> node, one table per gate kind
+    std::unordered_map<std::uint64_t, std::uint32_t> and_table, xor_table;
+};
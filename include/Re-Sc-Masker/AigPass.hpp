@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Re-Sc-Masker/Aig.hpp"
+#include "Re-Sc-Masker/AigRewriter.hpp"
+#include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+struct AigOptions {
+    /// Rounds of cut-based rewriting, stopping early once nothing is rewritten
+    unsigned rewrite_rounds = SCM_AIG_REWRITE_ROUNDS;
+    MaskedCost cost{SCM_MASKED_COST_AND, SCM_MASKED_COST_XOR, SCM_MASKED_COST_NOT};
+};
+
+/// Rebuild a bit-blasted region through an AIG, so that duplicate gates are merged and
+/// NOT gates are absorbed by XOR gates wherever possible.
+/// The AIG is then rewritten to minimize its masked cost, see `AigRewriter`.
+/// Only gates reaching the outputs are emitted again, each one exactly once,
+/// right before the first output or pseudo instruction needing them.
+class AigPass : private NonCopyable<AigPass> {
+public:
+    explicit AigPass(Region &&blasted_region, const AigOptions &opts = {});
+
+    /// Return the region emitted from the AIG
+    Region get();
+
+private:
+    Aig::Lit litOf(const ValueInfo &var);
+    void rewrite();
+    void emit();
+    /// Emit the gates of the cone of a literal not emitted yet
+    void emitCone(Aig::Lit lit);
+    /// Name of a var holding the value of a literal, emitting a NOT if needed.
+    /// Constants are returned as "0"/"1".
+    std::string nameOf(Aig::Lit lit);
+
+private:
+    AigOptions opts;
+    Region origin;
+    Region region;
+    Aig aig;
+    /// Whether all instructions can be represented in the AIG; the region is kept as-is otherwise
+    bool supported = true;
+    /// bit -> its current literal
+    std::unordered_map<std::string, Aig::Lit> bits;
+    /// Instructions kept around the gates in their order: splits of vars into bits, output assembly and
+    /// pseudo instructions on words (e.g. lookups), with the literal of the bit being assembled if any
+    std::vector<std::pair<Instruction, Aig::Lit>> steps;
+    /// node -> names of the plain and complemented literal
+    std::unordered_map<std::uint32_t, std::string> names, neg_names;
+    size_t and_count = 0, xor_count = 0;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Re-Sc-Masker/Aig.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Cut-based rewriting minimizing the masked cost of an AIG.
+/// For each gate, 4-feasible cuts are enumerated and the function of each cut is looked up in a library
+/// of implementations with minimum multiplicative complexity (#AND gates).
+/// The cone of the gate is replaced if the library implementation is cheaper than the gates it frees.
+/// The library holds every 4-input function computable with at most 2 ANDs, the rest are kept as they are.
+class AigRewriter {
+public:
+    static constexpr int CUT_SIZE = 4;
+
+    /// Rewrite `src` into a new graph, the literals in `outputs` are kept alive
+    AigRewriter(const Aig &src, const std::vector<Aig::Lit> &outputs, const MaskedCost &cost);
+
+    /// The literal in the new graph of a literal in the source graph
+    Aig::Lit map(Aig::Lit lit) const { return mapped[Aig::nodeOf(lit)] ^ Aig::isNeg(lit); }
+
+    /// The rewritten graph
+    Aig aig;
+    size_t rewritten_count = 0;
+
+private:
+    struct Cut {
+        std::array<std::uint32_t, CUT_SIZE> leaves;
+        int size;
+    };
+
+    /// An XAG with at most 2 ANDs over the inputs x0..x3 of a cut:
+    /// g1 = a1 & b1; g2 = a2 & b2; f = out
+    /// Each operand is an affine function, i.e. a mask of signals (see `AFFINE_*`) xor-ed together.
+    struct Impl {
+        std::uint8_t mc = 0xff;
+        std::uint8_t a1 = 0, b1 = 0, a2 = 0, b2 = 0, out = 0;
+        std::uint8_t xors = 0, nots = 0;
+    };
+    /// Signals in an affine mask: bits 0..3 are the cut inputs
+    static constexpr std::uint8_t AFFINE_G1 = 1 << 4, AFFINE_G2 = 1 << 5, AFFINE_ONE = 1 << 6;
+
+    static const std::vector<Impl> &library();
+    unsigned implCost(const Impl &impl) const;
+    Aig::Lit buildImpl(const Impl &impl, const Cut &cut);
+
+    void enumerateCuts(std::uint32_t id);
+    std::uint16_t truthTable(std::uint32_t root, const Cut &cut) const;
+    unsigned gateCost(std::uint32_t id) const;
+    unsigned mffcCost(std::uint32_t root, const Cut &cut);
+
+    const Aig &src;
+    MaskedCost cost;
+    /// source node -> literal in the new graph
+    std::vector<Aig::Lit> mapped;
+    /// source node -> its cuts, the trivial cut first
+    std::vector<std::vector<Cut>> cuts;
+    /// #fanouts of each source node
+    std::vector<unsigned> refs;
+};
@@ -3,17 +3,46 @@
 #include <z3++.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "Re-Sc-Masker/BitCircuit.hpp"
+#include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/LookupTable.hpp"
 #include "Re-Sc-Masker/Preludes.hpp"
 
 class Z3VInfo;
 
+/// Knobs bounding the time and memory spent in Z3, 0 for unlimited
+struct BitBlastOptions {
+    unsigned goal_timeout_ms = SCM_Z3_GOAL_TIMEOUT_MS;
+    unsigned goal_max_steps = SCM_Z3_GOAL_MAX_STEPS;
+    unsigned goal_max_memory_mb = SCM_Z3_GOAL_MAX_MEMORY_MB;
+    unsigned ctx_recycle_period = SCM_Z3_CTX_RECYCLE_PERIOD;
+    /// Skip Z3 and blast every instruction directly
+    bool direct_only = SCM_DIRECT_BLAST;
+    /// Arithmetic built without Z3
+    ArithOptions arith{SCM_ADDER_ARCH, SCM_ADDER_DEPTH_WEIGHT, SCM_MULTIPLIER_ARCH, SCM_KARATSUBA_THRESHOLD,
+                       MaskedCost{SCM_MASKED_COST_AND, SCM_MASKED_COST_XOR, SCM_MASKED_COST_NOT}};
+    /// Sum trees spanning several instructions are compressed at once, see `Z3BitBlastPass::calc_sum_trees`
+    bool carry_save_sums = SCM_CARRY_SAVE_SUMS;
+    /// Masking of lookups in constant tables
+    LutMasking lut_masking = SCM_LUT_MASKING;
+    /// Masked cost of recomputing one table entry, weighed against `ArithOptions::masked_cost` of the circuit
+    unsigned lut_recompute_cost_per_entry = SCM_LUT_RECOMPUTE_COST_PER_ENTRY;
+    /// Keep `+`, `-` and products by constants arithmetically masked, see `Z3BitBlastPass::blastArith`
+    bool arith_masking = SCM_ARITH_MASKING;
+    /// Keep bitwise operations Boolean-masked on whole words, see `Z3BitBlastPass::blastWord`
+    bool word_masking = SCM_WORD_MASKING;
+};
+
 struct BitBlastPass {
     virtual Region get() = 0;
 };
@@ -23,7 +52,7 @@ class Z3BitBlastPass : public BitBlastPass, private NonCopyable<Z3BitBlastPass>
 public:
     using TopoId = std::uint32_t;
     /// Encode relationship between separated bits in Z3
-    explicit Z3BitBlastPass(const ValueInfo &ret, Region &&origin_region);
+    explicit Z3BitBlastPass(const ValueInfo &ret, Region &&origin_region, const BitBlastOptions &opts = {});
 
     /// Return the bit-blasted region
     Region get() override;
@@ -33,15 +62,90 @@ private:
     static const TraversingState NEED_EXPRESSION = (1 << 0);
 
     void calc_topo(const Region &origin_region);
+    void calc_last_use(const Region &origin_region);
+    void calc_sum_trees(const Region &origin_region);
+    /// Whether an op is blasted by `directBlast` anyway
+    bool isBlastedDirectly(const std::string &op) const;
+    /// Whether an instruction is masked arithmetically instead of being bit-blasted
+    bool isArithMasked(const Instruction &inst) const;
+    /// Whether a bitwise instruction is masked on whole words instead of being bit-blasted
+    bool isWordMasked(const Instruction &inst) const;
+    /// Lazily register Z3 objects for a var
+    void touchVar(const ValueInfo &var);
+    /// Release Z3 objects of vars that will never be used again
+    void releaseDeadVars(size_t inst_idx);
     /// Encode relationship between separated bits in Z3
-    void blast(Instruction &&inst);
+    void blast(Instruction &&inst, size_t inst_idx);
+    /// Return false if Z3 cannot handle the instruction within the limits
+    bool blastWithZ3(const Instruction &inst);
+    /// Return false if the instruction is not a pure bit permutation
+    bool wire(const Instruction &inst);
+    void redefine(const ValueInfo &var, bool keep_value);
+    BitCircuit::Bits bitsOf(const ValueInfo &var, int width);
+    BitCircuit::Bit resolveBit(const std::string &bit, VProp prop);
+    BitCircuit::Bits detachSelfBits(const ValueInfo &var, BitCircuit::Bits &&bits);
     /// Traverse the model to get the representation of output variables
     Z3VInfo traverseZ3Model(const z3::expr &e, TraversingState state, int indent);
-    void solve_and_extract(const z3::goal &goal);
+    /// Return false if any limit is hit, nothing is emitted then
+    bool solve_and_extract(const z3::goal &goal);
+    /// Define a var found by the traversal, undone by `rollbackTraversal`
+    void defineTraversed(const ValueInfo &var);
+    /// Undo the vars and the Z3 bits registered by a traversal given up
+    void rollbackTraversal();
+    /// Fallback: blast the instruction gate by gate without Z3.
+    /// Sums are left in carry-save form if `carry_save` is set.
+    void directBlast(const Instruction &inst, bool carry_save);
+    /// `<<` or `>>` by a var, blasted as a barrel shifter
+    BitCircuit::Bits shiftByVar(BitCircuit &circuit, const Instruction &inst);
+    /// Arithmetic options of circuits built without Z3
+    ArithOptions directArith() const;
     void splitVar2Bits(const ValueInfo &var);
+    /// Blast a lookup in a constant table, masked as chosen by `lut_masking`
+    void blastLookup(const Instruction &inst);
+    /// table[index] by randomized table recomputation, see `LookupTable`
+    BitCircuit::Bits recomputeLookup(const std::string &table_name, const BitCircuit::Bits &index, size_t width);
+    /// A new word assembled from bits
+    ValueInfo packBits(const BitCircuit::Bits &bits);
+    /// New bits split from a word, or the bits of a constant
+    BitCircuit::Bits unpackWord(const ValueInfo &word, int width);
+
+    /// A value x held masked on whole words: x == masked + mask (mod 2^width) for arithmetic masking,
+    /// x == masked ^ mask for Boolean masking
+    struct WordShares {
+        ValueInfo masked, mask;
+        /// Random words the mask is computed from, sorted
+        std::vector<std::string> randoms;
+    };
+    /// Mask `+`, `-` or a product by a constant share-wise on arithmetic shares
+    void blastArith(const Instruction &inst);
+    /// Arithmetic shares of an operand, converted from its bits if needed
+    WordShares arithSharesOf(const ValueInfo &var, int width);
+    /// Mask `^`, `&`, `|`, `~` and shifts by constants on Boolean shares of whole words
+    void blastWord(const Instruction &inst);
+    /// Boolean shares of an operand, converted from its bits if needed
+    WordShares booleanSharesOf(const ValueInfo &var, int width);
+    /// Boolean shares of `x & y`, by an ISW gadget on words unless an operand is public
+    WordShares andWords(const WordShares &x, const WordShares &y, int width);
+    /// Compute the bits of a var held masked on words, if not computed yet; those of an output are unmasked
+    void materializeWord(const std::string &name, bool is_output = false);
+    /// A word `lhs op rhs` on masked values, see `Instruction::wordOperator`; shares known to be 0 are folded
+    ValueInfo emitWordOp(std::string_view op, const ValueInfo &lhs, const ValueInfo &rhs, int width);
+    /// A word of fresh random bits
+    ValueInfo randomWord(int width, BitCircuit::Bits *bits = nullptr);
+    /// Drop all Z3 objects and start over with a fresh context
+    void recycleContext();
 
 private:
-    z3::context z3ctx;
+    BitBlastOptions opts;
+    std::unique_ptr<z3::context> z3ctx;
+
+    /// #goals sent to Z3 / #instructions blasted directly
+    size_t goal_count = 0;
+    size_t fallback_count = 0;
+    /// #goals sent to the current context
+    size_t goals_in_ctx = 0;
+    /// Give up the current goal after this
+    std::optional<std::chrono::steady_clock::time_point> goal_deadline;
 
     /// var name -> topo sort id
     std::unordered_map<std::string, TopoId> var2topo{};
@@ -62,9 +166,41 @@ private:
     std::unordered_map<int, std::string> id2varbit;
     /// e.g. `|out#3|` -> `k!4`
     std::unordered_map<std::string, int> varbit2id;
+    /// Sym table entries defined by the traversal of the current goal with their previous value, if any,
+    /// and the Z3 bits it registered
+    std::vector<std::pair<std::string, std::optional<ValueInfo>>> traversed_syms;
+    std::vector<int> traversed_ids;
 
     std::unordered_set<ValueInfo> var_splited;
 
+    /// var -> id of the last instruction using it
+    std::unordered_map<ValueInfo, size_t> last_use;
+    /// instruction id -> vars last used by the instruction
+    std::unordered_map<size_t, std::vector<ValueInfo>> dying_at;
+
+    /// Instructions whose result is only used by the next sum (or difference) of a sum tree
+    std::unordered_set<size_t> carry_save_defs;
+    /// var name -> columns of bits summing up to its value, pending until the var is used
+    std::unordered_map<std::string, std::vector<BitCircuit::Bits>> pending_sums;
+
+    /// `var#i` -> the bit it is wired to, or "0"/"1"
+    std::unordered_map<std::string, BitCircuit::Bit> bit_alias;
+    /// var name -> bits wired to its bits
+    std::unordered_map<std::string, std::vector<std::string>> alias_users;
+
+    /// Vars to be assembled from bits at the end
+    std::vector<ValueInfo> output_vars;
+
+    /// var name -> arithmetic shares of its current value
+    std::unordered_map<std::string, WordShares> arith_vars;
+    /// var name -> Boolean shares on words of its current value
+    std::unordered_map<std::string, WordShares> boolean_vars;
+    /// Vars held masked on words whose bits are not computed yet
+    std::unordered_map<std::string, ValueInfo> word_pending;
+    /// Vars written so far; inputs not in it still hold their value as words
+    std::unordered_set<std::string> written_vars;
+    size_t b2a_count = 0, a2b_count = 0, word_inst_count = 0, w2b_count = 0;
+
     Region blasted_region;
     ValueInfo ret;
 };
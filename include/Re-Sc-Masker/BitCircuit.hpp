@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Carry computation of adders and subtractors
+enum class AdderArch {
+    /// Let Z3 blast `+` and `-`, falling back to `RippleCarry`
+    Z3,
+    /// n-1 ANDs, AND depth n-1
+    RippleCarry,
+    /// Sparse parallel prefix: ~2n ANDs, AND depth ~2log(n)
+    BrentKung,
+    /// Dense parallel prefix: ~n log(n) ANDs, AND depth log(n)
+    KoggeStone,
+    /// The cheapest of the above under the masked cost model, see `BitCircuit::addAuto`
+    Auto,
+};
+
+/// Multiplication of `*`
+enum class MultiplierArch {
+    /// Let Z3 blast `*`, falling back to `CarrySave`
+    Z3,
+    /// Partial products compressed by full adders, then summed by a single adder
+    CarrySave,
+    /// Recursive Karatsuba splitting down to `ArithOptions::karatsuba_threshold` bits, then `CarrySave`
+    Karatsuba,
+};
+
+/// How arithmetic operations are built from gates
+struct ArithOptions {
+    AdderArch adder_arch = AdderArch::RippleCarry;
+    /// Cost of one level of AND depth when choosing an adder, relative to the masked cost of gates
+    unsigned adder_depth_weight = 0;
+    MultiplierArch multiplier_arch = MultiplierArch::CarrySave;
+    /// Operands at least this wide are split by Karatsuba
+    unsigned karatsuba_threshold = 16;
+    /// Masked cost of gates when choosing between circuits
+    MaskedCost masked_cost{9, 2, 1};
+};
+
+/// Emits 1-bit instructions into a region without going through Z3.
+/// A bit is referred by its var name, or by "0"/"1" for constant bits,
+/// which are folded on the fly and never emitted as operands.
+class BitCircuit {
+public:
+    using Bit = std::string;
+    using Bits = std::vector<Bit>;
+
+    explicit BitCircuit(Region &region, const ArithOptions &opts = {}) : region(region), opts(opts) {}
+
+    static bool isConst(const Bit &b) { return b == "0" || b == "1"; }
+
+    Bit mkNot(const Bit &a);
+    Bit mkXor(const Bit &a, const Bit &b);
+    Bit mkAnd(const Bit &a, const Bit &b);
+    Bit mkOr(const Bit &a, const Bit &b);
+    /// A new bit holding the current value of `a`
+    Bit mkCopy(const Bit &a);
+
+    /// `target = b`
+    void assign(const Bit &target, const Bit &b, VProp prop = VProp::UNK);
+
+    /// a + b + cin, truncated to the width of `a`, with the carries computed by `adder_arch`
+    Bits add(const Bits &a, const Bits &b, const Bit &cin = "0");
+    /// a - b, truncated to the width of `a`
+    Bits sub(const Bits &a, const Bits &b);
+    /// a * b, truncated to the width of `a`, built according to `multiplier_arch`
+    Bits mul(const Bits &a, const Bits &b);
+
+    /// Sum of all bits, column `i` holding bits of weight 2^i, truncated to the number of columns.
+    /// Columns are compressed by full adders first, so that a single adder is needed.
+    Bits sumColumns(std::vector<Bits> &&columns);
+    /// Add the bits of a * b shifted by `offset` to the columns, bits beyond the last column are dropped
+    void pushProduct(std::vector<Bits> &columns, size_t offset, const Bits &a, const Bits &b);
+
+    /// table[index], each entry truncated to `width` bits, `table` having 2^|index| entries.
+    /// The AES S-box is built from the depth-16 Boyar-Peralta circuit (34 ANDs),
+    /// other tables from their algebraic normal form.
+    Bits lookup(const std::vector<uint64_t> &table, const Bits &index, size_t width);
+
+    /// Masked cost of the gates in a region, see `ArithOptions::masked_cost`
+    unsigned maskedCost(const Region &region) const;
+
+    /// #AND gates on the longest path from the inputs of the circuit to `b`
+    unsigned andDepth(const Bit &b) const;
+
+    /// #AND gates emitted so far
+    size_t and_count = 0;
+
+private:
+    Bit newTemp();
+    Bit emit(std::string_view op, const Bit &a, const Bit &b);
+
+    Bits addRipple(const Bits &a, const Bits &b, const Bit &cin);
+    Bits addPrefix(const Bits &a, const Bits &b, const Bit &cin, AdderArch arch);
+    Bits addAuto(const Bits &a, const Bits &b, const Bit &cin);
+
+    /// Bits of table[index] from the AES S-box circuit, or nothing if the table is not the AES S-box
+    std::optional<Bits> lookupAesSbox(const std::vector<uint64_t> &table, const Bits &index, size_t width);
+    Bits lookupAnf(const std::vector<uint64_t> &table, const Bits &index, size_t width);
+
+    /// The full 2n-bit product of two n-bit operands
+    Bits mulFull(const Bits &a, const Bits &b);
+    bool splitByKaratsuba(const Bits &a, const Bits &b) const;
+
+    Region &region;
+    ArithOptions opts;
+    std::unordered_map<Bit, unsigned> and_depths;
+};
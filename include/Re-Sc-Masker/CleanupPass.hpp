@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Clean up a bit-level region before masking:
+/// copies (`a = b`) are propagated into their uses, instructions not reaching any output are removed,
+/// and symbols no longer referred by any instruction are dropped.
+class CleanupPass : private NonCopyable<CleanupPass> {
+public:
+    explicit CleanupPass(Region &&origin_region);
+
+    /// Return the cleaned region
+    Region get();
+
+private:
+    void propagateCopies();
+    void eliminateDeadCode();
+    void pruneSymbols();
+
+private:
+    Region region;
+    size_t propagated_count = 0;
+    size_t removed_inst_count = 0;
+    size_t removed_symbol_count = 0;
+};
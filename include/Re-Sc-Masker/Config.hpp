@@ -1,8 +1,101 @@
 #pragma once
-#include "Re-Sc-Masker/RegionDivider.hpp"
-#include "Re-Sc-Masker/RegionMasker.hpp"
 
 // TODO: Choose specific class(behavior) for different parts
 // e.g. Choose `TrivialRegionMasker` for `MaskedRegionType`
 
 // #define SCM_Z3_BLASTING_ENABLED
+
+/// Per-goal limits of Z3 tactics when bit-blasting, 0 for unlimited.
+/// A goal hitting any of them is blasted directly without Z3.
+#define SCM_Z3_GOAL_TIMEOUT_MS 10000
+#define SCM_Z3_GOAL_MAX_STEPS 0
+#define SCM_Z3_GOAL_MAX_MEMORY_MB 1024
+/// Recreate the Z3 context after every N goals to cap its memory, 0 to never recycle
+#define SCM_Z3_CTX_RECYCLE_PERIOD 64
+/// Skip Z3 and blast every instruction gate by gate with the circuits below
+#define SCM_DIRECT_BLAST false
+/// Narrow local vars to their significant bits before bit-blasting, see `RangeAnalysisPass`
+#define SCM_NARROW_WIDTHS true
+
+/// Architecture of `+` and `-` after bit-blasting, see `AdderArch`
+#define SCM_ADDER_ARCH AdderArch::Auto
+/// Masked cost of one level of AND depth when choosing an adder automatically.
+/// The masked code runs sequentially, so only the gate count matters by default.
+#define SCM_ADDER_DEPTH_WEIGHT 0
+/// Architecture of `*` after bit-blasting, see `MultiplierArch`
+#define SCM_MULTIPLIER_ARCH MultiplierArch::Karatsuba
+/// Multiplications at least this wide are split by Karatsuba
+#define SCM_KARATSUBA_THRESHOLD 16
+/// Compress trees of `+`, `-` and `*` across instructions with a single carry-propagate adder
+#define SCM_CARRY_SAVE_SUMS true
+/// Rewrite multiplications by constants into shifts and additions/subtractions (canonical signed digits) before
+/// bit-blasting, see `ConstMulPass`
+#define SCM_CONST_MUL_CSD true
+
+/// Rounds of cut-based rewriting on the AIG before masking, 0 to disable
+#define SCM_AIG_REWRITE_ROUNDS 2
+/// Keep masked values as a pair of shares across linear operations (XOR, NOT, copies),
+/// which are then computed share by share without fresh randomness; only ANDs and ORs draw random bits
+#define SCM_SHARE_LINEAR_OPS true
+/// Masking order d: masked values are split into d+1 shares, so that any d intermediate values are independent
+/// of the secrets. Orders above 1 imply `SCM_SHARE_LINEAR_OPS`.
+#define SCM_MASKING_ORDER 1
+/// Gadget of masked ANDs, see `AndGadget`
+#define SCM_AND_GADGET AndGadget::Auto
+/// Weights of #instructions, #random bits and latency (gate levels) when choosing the gadget of each AND.
+/// The masked code runs sequentially, so latency does not matter by default.
+#define SCM_GADGET_COST_INSTRUCTION 1
+#define SCM_GADGET_COST_RANDOM 1
+#define SCM_GADGET_COST_LATENCY 0
+/// Masked cost of each gate (#instructions + #random bits emitted by `TrivialRegionMasker`)
+#define SCM_MASKED_COST_AND 9
+#define SCM_MASKED_COST_XOR 2
+#define SCM_MASKED_COST_NOT 1
+
+/// Group bit gates into fanout-free cones of up to `SCM_REGION_MAX_INPUTS` input bits (see `ConeRegionDivider`) and
+/// mask each cone by a program synthesized by Z3 for it as a whole (see `RegionSynthesizer`), wherever one is found
+/// cheaper than masking it gate by gate in time. First order only, with `SCM_SHARE_LINEAR_OPS` and without
+/// `SCM_PARTITION_REGION_SIZE`.
+#define SCM_SYNTHESIZE_REGIONS false
+#define SCM_REGION_MAX_INPUTS 3
+/// Time limit (ms) of synthesizing the masked program of one region
+#define SCM_SYNTHESIS_TIMEOUT_MS 10000
+/// Most fresh random bits of a synthesized program
+#define SCM_SYNTHESIS_MAX_RANDOMS 1
+/// Regions synthesized in parallel, 0 for one per hardware thread
+#define SCM_SYNTHESIS_THREADS 0
+
+/// Divide the circuit into regions of about this many instructions with few edges between them, see
+/// `PartitionRegionDivider`; 0 for one instruction per region. Regions are masked in parallel, on
+/// `SCM_MASKING_THREADS` threads (0 for one per hardware thread), with the same result whatever their number.
+#define SCM_PARTITION_REGION_SIZE 0
+#define SCM_MASKING_THREADS 0
+
+/// Mask `+`, `-` and products by constants arithmetically (modulo 2^n, share-wise and free of randomness) instead of
+/// bit-blasting them, converting between Boolean and arithmetic masking only where bitwise operations meet them.
+/// The conversions are first-order secure only.
+#define SCM_ARITH_MASKING false
+/// Mask `^`, `&`, `|`, `~` and shifts by constants on whole words (first-order ISW on words for ANDs) when their
+/// operands are inputs or already masked on words, instead of masking each of their bits on its own
+#define SCM_WORD_MASKING false
+
+/// Masking of lookups in constant tables, see `LutMasking`
+#define SCM_LUT_MASKING LutMasking::Auto
+/// Masked cost of recomputing one table entry (index xor, read, output xor, write)
+#define SCM_LUT_RECOMPUTE_COST_PER_ENTRY 4
+
+/// Emit instructions not depending on secrets unmasked, see `TaintPass`
+#define SCM_TAINT_ANALYSIS true
+
+/// Merge fresh random bits of the masked code wherever every intermediate value stays as secure, see `RandomReusePass`
+#define SCM_REUSE_RANDOMS true
+/// Time limit (ms) of proving by Z3 that one unmasked value does not depend on random bits
+#define SCM_RANDOM_REUSE_TIMEOUT_MS 1000
+
+/// Move instructions not depending on inputs into a precompute function filling a state read by the masked function,
+/// see `RegionConcatenater::printAsCode`
+#define SCM_SPLIT_OFFLINE false
+
+// The masker reads the settings above
+#include "Re-Sc-Masker/RegionDivider.hpp"
+#include "Re-Sc-Masker/RegionMasker.hpp"
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Rewrite multiplications by constants into shifts, which are free wiring after bit-blasting,
+/// and a minimal number of additions and subtractions given by the canonical signed digit (CSD) form of the constant.
+/// A product whose constant is a shifted one of an earlier product of the same var is computed by shifting that product.
+class ConstMulPass : private NonCopyable<ConstMulPass> {
+public:
+    explicit ConstMulPass(Region &&origin_region);
+
+    /// Return the region without multiplications by constants
+    Region get();
+
+private:
+    /// Nonzero digits of the CSD form of `c` mod 2^width, as (is negative, position)
+    static std::vector<std::pair<bool, int>> csdDigits(uint64_t c, int width);
+    void rewrite(const Instruction &inst, const ValueInfo &var, uint64_t c);
+    ValueInfo newTemp(Width width);
+
+private:
+    Region origin;
+    Region region;
+    /// Earlier products still holding their value: (var, odd part of the constant) -> (product, shift of the constant)
+    std::vector<std::pair<std::pair<std::string, uint64_t>, std::pair<ValueInfo, int>>> products;
+    size_t rewritten_count = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Propagate constant bits through a bit-blasted region and fold the gates they reach,
+/// e.g. `x & 0 -> 0`, `x ^ 0 -> x`, `x & 1 -> x`, `x ^ 1 -> !x`.
+/// Constant bits are substituted into their uses, so they never reach the masker.
+class ConstPropPass : private NonCopyable<ConstPropPass> {
+public:
+    explicit ConstPropPass(Region &&blasted_region);
+
+    /// Return the folded region
+    Region get();
+
+private:
+    void fold(Instruction &&inst);
+    /// "0"/"1" if the var is known to be constant, otherwise ""
+    std::string constOf(const ValueInfo &var) const;
+
+private:
+    Region region;
+    /// var -> its current constant value
+    std::unordered_map<std::string, bool> consts;
+    size_t folded_count = 0;
+};
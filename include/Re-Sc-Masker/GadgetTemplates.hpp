@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Masked AND gadgets of order d, on d+1 shares
+enum class AndGadget {
+    /// Ishai-Sahai-Wagner: each pair of cross products is blinded by one random bit, accumulated share by share.
+    /// SNI, but the operands must be shared independently, as the cross products combine shares of both.
+    ISW,
+    /// Domain-oriented masking (DOM-indep): each cross product is blinded on its own, so that the terms of a share
+    /// are summed by a balanced tree. Only NI, the operands must be shared independently as well.
+    DOM,
+    /// DOM after an SNI refresh of the second operand (HPC1): PINI and secure on dependent operands,
+    /// at twice the random bits
+    HPC1,
+    /// The cheapest secure gadget under the cost model, for each AND
+    Auto,
+};
+
+/// What a gadget emits for one AND
+struct GadgetCost {
+    unsigned instructions;
+    unsigned randoms;
+    /// Gates on the longest path from the operand shares to the result shares
+    unsigned latency;
+};
+
+/// Weights of the gadget costs when choosing a gadget
+struct GadgetCostWeights {
+    unsigned instruction;
+    unsigned random;
+    unsigned latency;
+};
+
+/// Masked gadgets of `TrivialRegionMasker`.
+/// First-order gadgets are described once as instructions over numbered slots, a gadget being instantiated by
+/// filling the slots (operands, fresh random bits and temps named after the result), then emitting its instructions
+/// in bulk. AND gadgets of any order are generated share by share, and chosen by their cost.
+namespace gadget {
+
+inline GadgetCost costOf(AndGadget gadget, unsigned order) {
+    auto shares = order + 1, pairs = order * (order + 1) / 2;
+    auto tree_depth = 0u;
+    while ((1u << tree_depth) < shares) {
+        tree_depth++;
+    }
+    switch (gadget) {
+        case AndGadget::ISW:
+            return {shares * shares + 4 * pairs, pairs, order + 3};
+        case AndGadget::DOM:
+            return {shares * shares + 4 * pairs, pairs, tree_depth + 2};
+        case AndGadget::HPC1:
+            return {shares * shares + 6 * pairs, 2 * pairs, order + tree_depth + 2};
+        default:
+            return {0, 0, 0};
+    }
+}
+
+/// ISW and DOM multiply shares of both operands together, which leaks unless they are shared independently
+inline bool isSecure(AndGadget gadget, bool independent) { return independent || gadget == AndGadget::HPC1; }
+
+/// The gadget of an AND: `preferred` if it is secure there, otherwise the cheapest secure one,
+/// the first of the library on ties
+inline AndGadget choose(AndGadget preferred, unsigned order, bool independent, const GadgetCostWeights &weights) {
+    if (preferred != AndGadget::Auto && isSecure(preferred, independent)) {
+        return preferred;
+    }
+    auto best = AndGadget::Auto;
+    auto best_cost = 0u;
+    for (auto candidate : {AndGadget::ISW, AndGadget::DOM, AndGadget::HPC1}) {
+        if (!isSecure(candidate, independent)) {
+            continue;
+        }
+        auto cost = costOf(candidate, order);
+        auto weighted =
+            weights.instruction * cost.instructions + weights.random * cost.randoms + weights.latency * cost.latency;
+        if (best == AndGadget::Auto || weighted < best_cost) {
+            best = candidate;
+            best_cost = weighted;
+        }
+    }
+    return best;
+}
+
+/// Slots of operands, fresh random bits and temps; temp `i` is slot `T0 + i`
+enum Slot : std::uint8_t { NONE, A, B, RES, R1, R2, R3, T0 };
+
+struct Temp {
+    /// Appended to the name of the result
+    std::string_view suffix;
+    VProp prop;
+};
+
+struct Op {
+    std::string_view op;
+    std::uint8_t res, lhs, rhs;
+};
+
+struct Template {
+    /// Fresh random bits, in slots R1, R2...
+    std::uint8_t rand_count;
+    std::span<const Temp> temps;
+    std::span<const Op> ops;
+};
+
+// XOR: T=A^B ->
+// mA=A^r1;
+// mB=B^r2;
+// mT=mA^mB;
+// mR=r1^r2;
+// T=mT^mR;
+inline constexpr Temp XOR_TEMPS[] = {
+    {"xormA", VProp::MASKED}, {"xormB", VProp::MASKED}, {"xormR", VProp::MASKED}, {"xormT", VProp::MASKED}};
+inline constexpr Op XOR_OPS[] = {
+    {"^", T0, A, R1},     {"^", T0 + 1, B, R2}, {"^", T0 + 3, T0, T0 + 1},
+    {"^", T0 + 2, R1, R2}, {"^", RES, T0 + 2, T0 + 3},
+};
+inline constexpr Template XOR{2, XOR_TEMPS, XOR_OPS};
+
+// EQ: T=(A==B) -> T=!(A^B) ->
+// mA=A^r1;
+// mB=B^r2;
+// mT=mA^mB;
+// mR=r1^r2;
+// T_=mT^r3;
+// mC = T_^mR;
+// Tr3 = ~mC;
+// T = Tr3^r3;
+inline constexpr Temp EQ_TEMPS[] = {
+    {"xormA", VProp::MASKED}, {"xormB", VProp::MASKED},  {"xormR", VProp::MASKED},   {"xormT", VProp::MASKED},
+    {"xormT_", VProp::MASKED}, {"xormC", VProp::MASKED}, {"xormTr3", VProp::MASKED},
+};
+inline constexpr Op EQ_OPS[] = {
+    {"^", T0, A, R1},          {"^", T0 + 1, B, R2},          {"^", T0 + 3, T0, T0 + 1},     {"^", T0 + 2, R1, R2},
+    {"^", T0 + 4, T0 + 3, R3}, {"^", T0 + 5, T0 + 4, T0 + 2}, {"!", T0 + 6, T0 + 5, NONE}, {"^", RES, T0 + 6, R3},
+};
+inline constexpr Template EQ{3, EQ_TEMPS, EQ_OPS};
+
+// NOT: T=!A ->
+// mA=A^r1;
+// mT=!mA;
+// T=mT^r1
+inline constexpr Temp NOT_TEMPS[] = {{"notmA", VProp::MASKED}, {"notmT", VProp::MASKED}};
+inline constexpr Op NOT_OPS[] = {{"^", T0, A, R1}, {"!", T0 + 1, T0, NONE}, {"^", RES, T0 + 1, R1}};
+inline constexpr Template NOT{1, NOT_TEMPS, NOT_OPS};
+
+// AND: T = A & B ->
+// mA = A ^ r1;
+// mB = B ^ r2;
+// negmB = !mB;
+// mAr2 = mA & r2;
+// negr1 = !r1;
+// tmp1 = negmB & r1;
+// tmp2 = mB & mA;
+// tmp3 = !mAr2;
+// tmp4 = negr1 | r2;
+// tmp5 = tmp1 | tmp2;
+// tmp6 = tmp3 ^ tmp4;
+// T = tmp5 ^ tmp6;
+inline constexpr Temp AND_TEMPS[] = {
+    {"andmA", VProp::MASKED}, {"andmB", VProp::MASKED}, {"andneg1", VProp::UNK}, {"andr2", VProp::UNK},
+    {"andneg2", VProp::UNK},  {"andtmp1", VProp::UNK},  {"andtmp2", VProp::UNK}, {"andtmp3", VProp::UNK},
+    {"andtmp4", VProp::UNK},  {"andtmp5", VProp::UNK},  {"andtmp6", VProp::UNK},
+};
+inline constexpr Op AND_OPS[] = {
+    {"^", T0, A, R1},
+    {"^", T0 + 1, B, R2},
+    {"!", T0 + 2, T0 + 1, NONE},
+    {"&&", T0 + 3, T0, R2},
+    {"!", T0 + 4, R1, NONE},
+    {"&&", T0 + 5, T0 + 2, R1},
+    {"&&", T0 + 6, T0 + 1, T0},
+    {"!", T0 + 7, T0 + 3, NONE},
+    {"||", T0 + 8, T0 + 4, R2},
+    {"||", T0 + 9, T0 + 5, T0 + 6},
+    {"^", T0 + 10, T0 + 7, T0 + 8},
+    {"^", RES, T0 + 9, T0 + 10},
+};
+inline constexpr Template AND{2, AND_TEMPS, AND_OPS};
+
+// OR: T = A | B -> T = !((!A) & (!B)), the AND gadget with the complements folded into its shares:
+// mA = A ^ r1;
+// mB = B ^ r2;
+// negmA = !mA;         (mA of !A)
+// negmB = !mB;         (mB of !B, whose negmB is mB)
+// mAr2 = negmA & r2;
+// negr1 = !r1;
+// tmp1 = mB & r1;
+// tmp2 = negmB & negmA;
+// tmp4 = negr1 | r2;
+// tmp5 = tmp1 | tmp2;
+// tmp6 = mAr2 ^ tmp4;  (tmp3 ^ tmp4, complemented)
+// T = tmp5 ^ tmp6;
+inline constexpr Temp OR_TEMPS[] = {
+    {"ormA", VProp::MASKED}, {"ormB", VProp::MASKED}, {"orneg0", VProp::UNK}, {"orneg1", VProp::UNK},
+    {"orr2", VProp::UNK},    {"orneg2", VProp::UNK},  {"ortmp1", VProp::UNK}, {"ortmp2", VProp::UNK},
+    {"ortmp4", VProp::UNK},  {"ortmp5", VProp::UNK},  {"ortmp6", VProp::UNK},
+};
+inline constexpr Op OR_OPS[] = {
+    {"^", T0, A, R1},
+    {"^", T0 + 1, B, R2},
+    {"!", T0 + 2, T0, NONE},
+    {"!", T0 + 3, T0 + 1, NONE},
+    {"&&", T0 + 4, T0 + 2, R2},
+    {"!", T0 + 5, R1, NONE},
+    {"&&", T0 + 6, T0 + 1, R1},
+    {"&&", T0 + 7, T0 + 3, T0 + 2},
+    {"||", T0 + 8, T0 + 5, R2},
+    {"||", T0 + 9, T0 + 6, T0 + 7},
+    {"^", T0 + 10, T0 + 4, T0 + 8},
+    {"^", RES, T0 + 9, T0 + 10},
+};
+inline constexpr Template OR{2, OR_TEMPS, OR_OPS};
+
+// NOR: T = !(A | B) -> T = (!A) & (!B), the OR gadget without complementing the result:
+// ...
+// tmp3 = !mAr2;
+// tmp6 = tmp3 ^ tmp4;
+// T = tmp5 ^ tmp6;
+inline constexpr Temp NOR_TEMPS[] = {
+    {"normA", VProp::MASKED}, {"normB", VProp::MASKED}, {"norneg0", VProp::UNK}, {"norneg1", VProp::UNK},
+    {"norr2", VProp::UNK},    {"norneg2", VProp::UNK},  {"nortmp1", VProp::UNK}, {"nortmp2", VProp::UNK},
+    {"nortmp3", VProp::UNK},  {"nortmp4", VProp::UNK},  {"nortmp5", VProp::UNK}, {"nortmp6", VProp::UNK},
+};
+inline constexpr Op NOR_OPS[] = {
+    {"^", T0, A, R1},
+    {"^", T0 + 1, B, R2},
+    {"!", T0 + 2, T0, NONE},
+    {"!", T0 + 3, T0 + 1, NONE},
+    {"&&", T0 + 4, T0 + 2, R2},
+    {"!", T0 + 5, R1, NONE},
+    {"&&", T0 + 6, T0 + 1, R1},
+    {"&&", T0 + 7, T0 + 3, T0 + 2},
+    {"!", T0 + 8, T0 + 4, NONE},
+    {"||", T0 + 9, T0 + 5, R2},
+    {"||", T0 + 10, T0 + 6, T0 + 7},
+    {"^", T0 + 11, T0 + 8, T0 + 9},
+    {"^", RES, T0 + 10, T0 + 11},
+};
+inline constexpr Template NOR{2, NOR_TEMPS, NOR_OPS};
+
+}  // namespace gadget
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// How a lookup in a constant table is masked
+enum class LutMasking {
+    /// Bitsliced circuit of the table, from a known decomposition with few ANDs (the AES S-box)
+    /// or from its algebraic normal form
+    Circuit,
+    /// Randomized table recomputation: the table is recomputed under fresh input and output masks,
+    /// then read at the masked index
+    Recompute,
+    /// The cheaper of the above under the masked cost model, for each lookup
+    Auto,
+};
+
+/// A constant array declared at file scope.
+/// A lookup is `res = table[index]` (op `[]`), the table being a CST operand named after it.
+/// After bit-blasting, a recomputed table is `masked = table[. ^ min] ^ mout` (op `/lut-recompute/`, the masks being
+/// packed into the rhs word as `mout << index_width | min`) and a lookup into it is `res = masked[index]` (op `/lut/`).
+struct LookupTable {
+    /// Width of entries
+    Width width;
+    std::vector<uint64_t> entries;
+    /// How each lookup was masked, printed along with the masked code
+    std::vector<std::string> reports;
+
+    /// #bits of an index addressing every entry
+    unsigned indexWidth() const { return entries.size() > 1 ? std::bit_width(entries.size() - 1) : 0; }
+
+    /// Tables of the input program, by name
+    static std::unordered_map<std::string, LookupTable> &all() {
+        static std::unordered_map<std::string, LookupTable> tables;
+        return tables;
+    }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Specialize a word-level region on public params fixed at deployment:
+/// reads of a bound param become constants, which later passes fold away along with everything depending on them.
+/// Only `VProp::PUB` params can be bound, binding a secret would leak it into the masked code.
+class ParamBindingPass : private NonCopyable<ParamBindingPass> {
+public:
+    using Bindings = std::unordered_map<std::string, uint64_t>;
+
+    ParamBindingPass(Region &&origin_region, const Bindings &bindings);
+
+    /// Parse a file of `name = value` lines, `#` starting a comment, see `parseAssignments`.
+    /// Values may be decimal, hexadecimal (0x) or octal (0), and negative for signed params.
+    static std::optional<Bindings> parseFile(const std::string &path);
+
+    /// Return the specialized region
+    Region get();
+
+    /// Params actually bound, they can be dropped from the signature
+    std::unordered_set<std::string> bound;
+
+private:
+    Region region;
+};
@@ -5,6 +5,9 @@
 #include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -207,6 +210,15 @@ public:
         if (op == "/clear/") {
             return res.name + " = 0; // <=0";
         }
+        if (op == "/lut-recompute/") {
+            return res.name + " = " + lhs.name + "[. ^ " + rhs.name + "]; // recomputed";
+        }
+        if (op == "/lut/" || op == "[]") {
+            return res.name + " = " + lhs.name + "[" + rhs.name + "];";
+        }
+        if (auto word_op = wordOperator(op); !word_op.empty()) {
+            return res.name + " = " + lhs.name + std::string(word_op) + rhs.name + "; // word";
+        }
         if (op == "=") {
             return res.name + " = " + lhs.name + ";";
         }
@@ -231,6 +243,19 @@ public:
         if (op == "/clear/") {
             return regularizer(res.name) + " = 0; // <=0";
         }
+        if (op == "/lut-recompute/") {  // see `LookupTable`
+            auto index_width = std::to_string(std::abs(rhs.width) - std::abs(res.width));
+            return "for (uint64_t a = 0; a < (1ull << " + index_width + "); a++) " + regularizer(res.name) + "[a] = " +
+                   regularizer(lhs.name) + "[a ^ (" + regularizer(rhs.name) + " & ((1ull << " + index_width +
+                   ") - 1))] ^ (" + regularizer(rhs.name) + " >> " + index_width + ");";
+        }
+        if (op == "/lut/") {
+            return regularizer(res.name) + " = " + regularizer(lhs.name) + "[" + regularizer(rhs.name) + "];";
+        }
+        if (auto word_op = wordOperator(op); !word_op.empty()) {
+            return regularizer(res.name) + " = " + regularizer(lhs.name) + std::string(word_op) +
+                   regularizer(rhs.name) + ";";
+        }
         if (op == "=") {
             return regularizer(res.name) + " = " + regularizer(lhs.name) + ";";
         }
@@ -246,6 +271,34 @@ public:
 
     inline bool isUnaryOp() const { return rhs.isNone(); }
 
+    /// The C operator of a pseudo instruction on whole words holding masked values, e.g. "+" for `/add/`;
+    /// empty for other ops. Only the low bits of the result are meaningful, see `Z3BitBlastPass::blastArith` and
+    /// `Z3BitBlastPass::blastWord`.
+    static std::string_view wordOperator(std::string_view op) {
+        if (op == "/add/") {
+            return "+";
+        }
+        if (op == "/sub/") {
+            return "-";
+        }
+        if (op == "/mul/") {
+            return "*";
+        }
+        if (op == "/xor/") {
+            return "^";
+        }
+        if (op == "/and/") {
+            return "&";
+        }
+        if (op == "/shl/") {
+            return "<<";
+        }
+        if (op == "/shr/") {
+            return ">>";
+        }
+        return "";
+    }
+
 public:
     std::string op;
     ValueInfo res, lhs, rhs;
@@ -305,14 +358,17 @@ public:
     SymbolTable sym_tbl;
 };
 
-inline size_t getWidthFromType(std::string_view type) {
-    size_t width = 1;
-    if (type.find("uint2") != std::string::npos) {
+inline Width getWidthFromType(std::string_view type) {
+    Width width = 1;
+    // NOTE: longer names first, e.g. "uint16" also contains "uint1"
+    if (type.find("uint16") != std::string::npos) {
+        width = 16;
+    } else if (type.find("uint1") != std::string::npos) {
+        width = 1;
+    } else if (type.find("uint2") != std::string::npos) {
         width = 2;
     } else if (type.find("uint8") != std::string::npos) {
         width = 8;
-    } else if (type.find("uint16") != std::string::npos) {
-        width = 16;
     } else if (type.find("uint32") != std::string::npos) {
         width = 32;
     } else if (type.find("uint64") != std::string::npos) {
@@ -321,14 +377,81 @@ inline size_t getWidthFromType(std::string_view type) {
         width = -8;
     } else if (type.find("int16") != std::string::npos) {
         width = -16;
+    } else if (type.find("int1") != std::string::npos) {
+        width = -1;
     } else if (type.find("int32") != std::string::npos) {
         width = -32;
     } else if (type.find("int64") != std::string::npos) {
         width = -64;
+    } else {
+        // Builtin types, as printed by Clang for expressions
+        if (type.ends_with(" *")) {
+            type.remove_suffix(2);
+        }
+        static const std::pair<std::string_view, Width> builtins[] = {
+            {"_Bool", 1},          {"bool", 1},
+            {"unsigned char", 8},  {"signed char", -8},
+            {"char", -8},          {"unsigned short", 16},
+            {"short", -16},        {"unsigned int", 32},
+            {"int", -32},          {"unsigned long long", 64},
+            {"long long", -64},    {"unsigned long", 64},
+            {"long", -64},
+        };
+        for (const auto &[name, w] : builtins) {
+            if (type == name) {
+                width = w;
+                break;
+            }
+        }
     }
     return width;
 }
 
+/// #bits of a width
+inline int getBitWidth(Width width) { return width < 0 ? -width : width; }
+
+inline bool isSigned(Width width) { return width < 0; }
+
+/// Read a file of `name = value` lines, `#` starting a comment, passing each pair to `assign`.
+/// Return false if the file cannot be read, or a line is not of this form or `assign` rejects its value,
+/// which is reported as not matching `expected`.
+inline bool parseAssignments(const std::string &path, std::string_view expected,
+                             const std::function<bool(const std::string &name, const std::string &value)> &assign) {
+    std::ifstream file(path);
+    if (!file) {
+        llvm::errs() << "Cannot open " << path << "\n";
+        return false;
+    }
+    auto trim = [](const std::string &s) {
+        auto begin = s.find_first_not_of(" \t\r");
+        auto end = s.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+    };
+    std::string line;
+    for (size_t line_no = 1; std::getline(file, line); line_no++) {
+        line = line.substr(0, line.find('#'));
+        if (trim(line).empty()) {
+            continue;
+        }
+        auto eq = line.find('=');
+        auto name = eq == std::string::npos ? std::string() : trim(line.substr(0, eq));
+        auto value = eq == std::string::npos ? std::string() : trim(line.substr(eq + 1));
+        if (name.empty() || name.find_first_of(" \t") != std::string::npos || value.empty() || !assign(name, value)) {
+            llvm::errs() << path << ":" << line_no << ": expected `" << expected << "`\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Cost of each kind of gate once masked, in whatever unit the user cares about
+/// (e.g. #instructions + #random bits emitted by the masker).
+struct MaskedCost {
+    unsigned and_cost;
+    unsigned xor_cost;
+    unsigned not_cost;
+};
+
 // Mixin classes
 
 /// Mixin CRTP class to disallow copying
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+struct RandomReuseOptions {
+    /// Time limit (ms) of proving that one value does not depend on random bits, 0 for unlimited
+    unsigned solver_timeout_ms = SCM_RANDOM_REUSE_TIMEOUT_MS;
+};
+
+/// Merge the fresh random bits of a masked region, so that fewer of them are drawn.
+/// Each value is typed by the random bits it depends on and those masking it perfectly (the value is `x ^ r`,
+/// `r` not appearing in `x`): it is uniformly distributed if some random bit masks it perfectly,
+/// secret-independent if it depends on no secret or combines secret-independent values of disjoint random bits,
+/// and unknown otherwise.
+/// A random bit is merged into an earlier one only if no uniform or secret-independent value becomes unknown.
+/// Unknown values must not change either: output bits (the masked code being correct whatever the random bits are)
+/// and values proven by Z3 not to depend on random bits keep their value anyway,
+/// and the random bits of other unknown values are never merged together.
+class RandomReusePass : private NonCopyable<RandomReusePass> {
+public:
+    /// `params` are never renamed, even if they are random
+    RandomReusePass(const ValueInfo &return_var, Region &&masked_region, const std::vector<std::string> &params,
+                    const RandomReuseOptions &opts = {});
+
+    /// Return the region with merged random bits renamed
+    Region get();
+
+private:
+    /// Random bits, one bit per random index
+    using RandomSet = std::vector<std::uint64_t>;
+
+    enum class Dist { Uniform, SecretIndep, Unknown };
+
+    /// How the value of a node is computed from its operands
+    enum class NodeKind { Leaf, Copy, Not, Xor, Eq, And, Or, Extract, Assemble, Opaque };
+
+    /// A bit or word read by the region, or the value written by an instruction
+    struct Node {
+        NodeKind kind;
+        /// Operand nodes, -1 for none
+        int lhs = -1, rhs = -1;
+        /// Name and class of a leaf
+        std::string name;
+        VProp prop = VProp::UNK;
+        /// Index of a random leaf, -1 otherwise
+        int random = -1;
+    };
+
+    /// What is known about the distribution of the value of a node
+    struct Fact {
+        /// Random bits the value depends on
+        RandomSet deps;
+        /// Random bits masking the value perfectly
+        RandomSet masks;
+        bool secret = false;
+        Dist dist = Dist::SecretIndep;
+    };
+
+    void buildNodes(const ValueInfo &return_var, const std::vector<std::string> &params);
+    int leafOf(const std::string &name, VProp prop, bool is_fresh);
+    Fact leafFact(const Node &leaf, size_t random) const;
+    Fact infer(const Node &node, const Fact &lhs, const Fact &rhs) const;
+    /// Pin together the random bits of unknown values, unless they are proven not to depend on random bits
+    void pinUnknowns(const RandomReuseOptions &opts);
+    /// Merge each fresh random bit into the first earlier one keeping every typed value typed
+    void mergeRandoms();
+    bool tryMerge(size_t random, size_t into, const std::vector<int> &cone);
+
+private:
+    Region region;
+    std::vector<Node> nodes;
+    std::vector<Fact> facts;
+    /// Fact of a missing operand
+    Fact none;
+    /// Bits written once into an output, i.e. holding plain values
+    std::unordered_set<int> output_bits;
+    /// Node of each leaf by name
+    std::unordered_map<std::string, int> leaves;
+    /// Leaf node of each random bit, and whether it may be renamed (drawn by the masker, not a param)
+    std::vector<int> random_nodes;
+    std::vector<bool> fresh;
+    /// Random bits never merged with each random bit
+    std::vector<RandomSet> conflicts;
+    /// The random bit each random bit is merged into, itself if not merged
+    std::vector<size_t> merged_into;
+    /// Scratch facts of a tentative merge, valid where stamped by the current try
+    std::vector<Fact> scratch;
+    std::vector<size_t> stamps;
+    size_t try_count = 0;
+
+    size_t plain_count = 0;
+    size_t pinned_count = 0;
+    size_t merged_count = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Value-range and known-bits analysis over a word-level region, seeded by declared types, constant masks and shifts.
+/// Intervals bound sums and products, known bits follow masks and shifts exactly (e.g. `(x << 8) >> 8`),
+/// and each refines the other. Each unsigned local var is narrowed to the bits its values can actually occupy,
+/// so that its always-zero high bits are neither bit-blasted nor masked.
+/// Inputs, outputs and the returned var keep their declared widths.
+class RangeAnalysisPass : private NonCopyable<RangeAnalysisPass> {
+public:
+    RangeAnalysisPass(const ValueInfo &ret, Region &&origin_region);
+
+    /// Return the region with narrowed vars
+    Region get();
+
+private:
+    /// Closed interval of the unsigned value of a var
+    struct Range {
+        uint64_t lo, hi;
+    };
+    /// Bits of the unsigned value of a var known to be 0 or 1
+    struct KnownBits {
+        uint64_t zeros, ones;
+    };
+
+    static Range full(Width width);
+    Range rangeOf(const ValueInfo &var) const;
+    Range transfer(const Instruction &inst) const;
+    KnownBits knownBitsOf(const ValueInfo &var) const;
+    KnownBits transferBits(const Instruction &inst) const;
+    bool narrowable(const ValueInfo &var) const;
+    void narrow(ValueInfo &var) const;
+
+private:
+    Region region;
+    ValueInfo ret;
+    /// var -> range of its current value
+    std::unordered_map<std::string, Range> ranges;
+    /// var -> known bits of its current value
+    std::unordered_map<std::string, KnownBits> known_bits;
+    /// var -> #significant bits over all its defs
+    std::unordered_map<std::string, int> sig_widths;
+};
@@ -2,12 +2,20 @@
 
 #include <llvm-16/llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <set>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/LookupTable.hpp"
 #include "Re-Sc-Masker/Preludes.hpp"
 
 template <typename RegionCollectorT>
@@ -30,15 +38,63 @@ public:
         /// varname -> (#instruction in the output region)
         std::unordered_map<std::string, size_t> var2def;
 
+        /// Name of a var holding the unmasked value of an output var, for reads other than XOR uses.
+        /// Before the first XOR use, the def is frozen so that it is never swapped;
+        /// after it, the swapped RND vars are xor-ed back into a copy.
+        auto unmasked = [&](const std::string &var) -> std::string {
+            auto diff = xor_diff.find(var);
+            if (diff == xor_diff.end()) {
+                xor_diff[var] = {};
+                return var;
+            }
+            if (diff->second.empty()) {  // frozen
+                return var;
+            }
+            auto name = var + "unmasked";
+            if (!region.sym_tbl.count(name)) {
+                ValueInfo copy{name, 1, VProp::UNK, nullptr};
+                region.sym_tbl[name] = copy;
+                region.insts.emplace_back("=", copy, ValueInfo{var, 1, VProp::UNK, nullptr}, ValueInfo{});
+                for (const auto &d : diff->second) {
+                    region.insts.emplace_back("^", copy, copy, ValueInfo{d, 1, VProp::RND, nullptr});
+                }
+            }
+            return name;
+        };
+
         for (auto &&masked_region : r.regions) {
             for (auto &&inst : masked_region.insts) {
                 inst.dump();
                 if (inst.op == "=") {  // a move-assignment is found
                     auto real_lhs_i = find_n_update(r.alias_edge, inst.lhs.name);
-                    if (real_lhs_i != r.alias_edge.end()) {
-                        r.alias_edge[inst.res.name] = real_lhs_i->second;
-                    }
+                    auto real_lhs = real_lhs_i == r.alias_edge.end() ? inst.lhs.name : real_lhs_i->second;
                     llvm::errs() << "//=\n" << inst.toString() << "\n";
+                    if (!r.output2xors.count(real_lhs)) {
+                        if (real_lhs_i != r.alias_edge.end()) {
+                            r.alias_edge[inst.res.name] = real_lhs;
+                        }
+                        region.insts.emplace_back(std::move(inst));
+                        continue;
+                    }
+                    // A plain copy of an output var needs its unmasked value
+                    auto src = unmasked(real_lhs);
+                    if (src == real_lhs) {
+                        r.alias_edge.try_emplace(real_lhs, real_lhs);
+                        r.alias_edge[inst.res.name] = real_lhs;
+                    } else {
+                        inst.lhs.name = src;
+                        r.alias_edge[inst.res.name] = inst.res.name;  // not an alias of the swapped def
+                    }
+                    region.insts.emplace_back(std::move(inst));
+                    continue;
+                }
+
+                if (inst.op == "/z3=>var/") {  // assembling a bit into an output var also needs its unmasked value
+                    auto real_lhs_i = find_n_update(r.alias_edge, inst.lhs.name);
+                    auto real_lhs = real_lhs_i == r.alias_edge.end() ? inst.lhs.name : real_lhs_i->second;
+                    if (r.output2xors.count(real_lhs)) {
+                        inst.lhs.name = unmasked(real_lhs);
+                    }
                     region.insts.emplace_back(std::move(inst));
                     continue;
                 }
@@ -112,6 +168,10 @@ public:
                     // Remember: only changes on def statement (of `X`) will have side-effects, so in this case the size
                     // of xor_diff[X]==2
                     const auto &diff = xor_diff[real_lhs];
+                    if (diff.empty()) {  // frozen by a plain copy: the def stays unmasked
+                        region.insts.emplace_back(std::move(inst));
+                        continue;
+                    }
                     assert(diff.size() == 2);
                     region.insts.emplace_back("//", "{replaced(" + real_lhs + "):");
                     region.insts.emplace_back(inst);
@@ -135,6 +195,10 @@ public:
                     }
 
                     const auto &diff = xor_diff[real_rhs];
+                    if (diff.empty()) {  // frozen by a plain copy: the def stays unmasked
+                        region.insts.emplace_back(std::move(inst));
+                        continue;
+                    }
                     assert(diff.size() == 2);
 
                     region.insts.emplace_back("//", "{replaced(" + real_rhs + "):");
@@ -163,8 +227,12 @@ public:
                               std::make_move_iterator(r.global_sym_tbl.end()));
     }
 
-    void printAsCode(std::string_view func_name, ValueInfo return_var,
-                     std::vector<std::string> original_fparams) const {
+    /// Print the region as a function.
+    /// With `split_offline`, instructions depending on random bits and constants only are moved into
+    /// `<func_name>_precompute`, which may run before the inputs are known and fills a `<func_name>_state` struct;
+    /// the function then takes the state instead of random bits.
+    void printAsCode(std::string_view func_name, ValueInfo return_var, std::vector<std::string> original_fparams,
+                     bool split_offline = SCM_SPLIT_OFFLINE) const {
         const auto vname_regularizer = [](std::string_view var_name) {
             auto pos = var_name.find('#');
             return pos == std::string::npos ? std::string(var_name) : std::string(var_name).replace(pos, 1, "_");
@@ -173,56 +241,255 @@ public:
         std::vector<ValueInfo> temp_vars;
         llvm::errs() << "\n=====RESULT====="
                      << "\n";
-        // func decl
-        llvm::outs() << "bool " << func_name << "(";
-        bool is_first_param = true;
 
-        // Find all params declared in the function signature...
-        for (const auto &vname : original_fparams) {
-            if (is_first_param) {
-                is_first_param = false;
-            } else {
-                llvm::outs() << ",";
+        // Lookup tables: how each lookup is masked, and the tables recomputed at run time
+        std::set<std::string> recomputed_tables;
+        /// masked table -> #entries; words read or written by lookups and arithmetic on masked words
+        std::map<std::string, uint64_t> masked_tables;
+        std::set<std::string> words;
+        for (const auto &inst : region.insts) {
+            if (inst.op == "/lut-recompute/") {
+                recomputed_tables.insert(inst.lhs.name);
+                masked_tables[inst.res.name] = uint64_t{1} << (std::abs(inst.rhs.width) - std::abs(inst.res.width));
+                words.insert(inst.rhs.name);
+            } else if (inst.op == "/lut/") {
+                words.insert(inst.res.name);
+                words.insert(inst.rhs.name);
+            } else if (!Instruction::wordOperator(inst.op).empty()) {
+                words.insert({inst.res.name, inst.lhs.name, inst.rhs.name});
             }
-            llvm::outs() << "bool " << vname_regularizer(vname) << "=0";
         }
+        for (const auto &[name, table] : LookupTable::all()) {
+            for (const auto &report : table.reports) {
+                llvm::outs() << "// " << report << "\n";
+            }
+            if (!recomputed_tables.count(name)) {
+                continue;
+            }
+            llvm::outs() << "static const uint64_t " << name << "[" << (uint64_t{1} << table.indexWidth()) << "] = {";
+            for (size_t i = 0; i < table.entries.size(); i++) {
+                llvm::outs() << (i ? ", " : "") << table.entries[i];
+            }
+            llvm::outs() << "};\n";
+        }
+        const auto declaration = [&](const ValueInfo &var) {
+            auto masked_table = masked_tables.find(var.name);
+            if (masked_table != masked_tables.end()) {
+                return "uint64_t " + vname_regularizer(var.name) + "[" + std::to_string(masked_table->second) + "]";
+            }
+            return (words.count(var.name) ? "uint64_t " : "bool ") + vname_regularizer(var.name);
+        };
 
-        // ...and those random variables introduced by us
+        // Random variables introduced by us are params as well, other vars are locals; both are sorted by name, so
+        // that the output does not depend on the order of the symbol table
+        std::vector<std::string> random_params, vnames;
         for (const auto &[vname, vinfo] : region.sym_tbl) {
+            vnames.push_back(vname);
+        }
+        std::sort(vnames.begin(), vnames.end());
+        for (const auto &vname : vnames) {
+            const auto &vinfo = region.sym_tbl.at(vname);
             // Ignore those variables printed in func head
             if (std::count(original_fparams.begin(), original_fparams.end(), vinfo.name)) {
                 continue;
             }
-            // Find all params declared in the function signature
             if (vinfo.prop == VProp::RND) {
-                if (is_first_param) {
-                    is_first_param = false;
-                } else {
-                    llvm::outs() << ",";
-                }
-                llvm::outs() << "bool " << vname_regularizer(vname) << "=0";
+                random_params.push_back(vname);
             } else {
                 temp_vars.emplace_back(vinfo);
             }
         }
+        bool is_first_param = true;
+        const auto print_param = [&](const std::string &vname) {
+            if (is_first_param) {
+                is_first_param = false;
+            } else {
+                llvm::outs() << ",";
+            }
+            llvm::outs() << "bool " << vname_regularizer(vname) << "=0";
+        };
+
+        // Offline part: vars computed by the precompute function, and those of them read online kept in the state
+        auto offline = split_offline ? offlineInsts(return_var, original_fparams) : std::vector<bool>(region.count());
+        std::set<std::string> offline_vars, state_names;
+        std::vector<ValueInfo> state_vars;
+        if (split_offline) {
+            for (size_t i = 0; i < region.count(); i++) {
+                if (offline[i]) {
+                    offline_vars.insert(region.insts[i].res.name);
+                }
+            }
+            for (size_t i = 0; i < region.count(); i++) {
+                const auto &inst = region.insts[i];
+                if (offline[i] || inst.op == "//") {
+                    continue;
+                }
+                for (const auto *var : {&inst.lhs, &inst.rhs}) {
+                    auto symbol = region.sym_tbl.find(var->name);
+                    auto is_random = symbol != region.sym_tbl.end() && symbol->second.prop == VProp::RND &&
+                                     !std::count(original_fparams.begin(), original_fparams.end(), var->name);
+                    if ((is_random || offline_vars.count(var->name)) && state_names.insert(var->name).second) {
+                        state_vars.push_back(symbol != region.sym_tbl.end() ? symbol->second : *var);
+                    }
+                }
+            }
+
+            llvm::outs() << "struct " << func_name << "_state {\n";
+            for (const auto &var : state_vars) {
+                llvm::outs() << declaration(var) << ";\n";
+            }
+            llvm::outs() << "};\n";
+
+            llvm::outs() << "void " << func_name << "_precompute(" << func_name << "_state *state";
+            is_first_param = false;
+            for (const auto &vname : random_params) {
+                print_param(vname);
+            }
+            llvm::outs() << "){\n";
+            for (const auto &var : state_vars) {
+                auto name = vname_regularizer(var.name);
+                if (offline_vars.count(var.name)) {
+                    llvm::outs() << "auto &" << name << " = state->" << name << ";\n";
+                } else {
+                    llvm::outs() << "state->" << name << " = " << name << ";\n";
+                }
+            }
+            for (const auto &var : temp_vars) {
+                if (offline_vars.count(var.name) && !state_names.count(var.name)) {
+                    llvm::outs() << declaration(var) << ";\n";
+                }
+            }
+            for (size_t i = 0; i < region.count(); i++) {
+                if (offline[i]) {
+                    llvm::outs() << region.insts[i].toRegularizedString(vname_regularizer) << "\n";
+                }
+            }
+            llvm::outs() << "}\n";
+        }
+
+        // func decl
+        llvm::outs() << "bool " << func_name << "(";
+        is_first_param = true;
+        if (split_offline) {
+            llvm::outs() << "const " << func_name << "_state *state";
+            is_first_param = false;
+        }
+
+        // Find all params declared in the function signature...
+        for (const auto &vname : original_fparams) {
+            print_param(vname);
+        }
+
+        // ...and those random variables introduced by us, unless they are in the state
+        if (!split_offline) {
+            for (const auto &vname : random_params) {
+                print_param(vname);
+            }
+        }
         llvm::outs() << ")";
 
         // Function body
         llvm::outs() << "{\n";
 
         // local variable decl
+        for (const auto &var : state_vars) {
+            auto name = vname_regularizer(var.name);
+            llvm::outs() << "const auto &" << name << " = state->" << name << ";\n";
+        }
         for (const auto &var : temp_vars) {
-            llvm::outs() << "bool " << vname_regularizer(var.name) << ";\n";
+            if (!offline_vars.count(var.name)) {
+                llvm::outs() << declaration(var) << ";\n";
+            }
         }
 
         // insts
-        for (const auto &instruction : region.insts) {
-            llvm::outs() << instruction.toRegularizedString(vname_regularizer) << "\n";
+        for (size_t i = 0; i < region.count(); i++) {
+            if (!offline[i]) {
+                llvm::outs() << region.insts[i].toRegularizedString(vname_regularizer) << "\n";
+            }
+        }
+        if (!return_var.isNone()) {  // otherwise results are written through output params
+            llvm::outs() << "return " << vname_regularizer(return_var.name) << ";\n";
         }
-        llvm::outs() << "return " << vname_regularizer(return_var.name) << ";\n";
         llvm::outs() << "}\n";
     }
 
+private:
+    /// Instructions reading random bits and constants only, directly or through vars computed offline.
+    /// A var is computed offline only if all its defs are, before any online read of it;
+    /// params and the return var are always written online.
+    std::vector<bool> offlineInsts(const ValueInfo &return_var,
+                                   const std::vector<std::string> &original_fparams) const {
+        std::unordered_map<std::string, size_t> last_defs;
+        for (size_t i = 0; i < region.count(); i++) {
+            if (region.insts[i].op != "//") {
+                last_defs[region.insts[i].res.name] = i;
+            }
+        }
+        std::unordered_set<std::string> online(original_fparams.begin(), original_fparams.end());
+        if (!return_var.isNone()) {
+            online.insert(return_var.name);
+        }
+        const auto isOnline = [&](const ValueInfo &var) {
+            if (var.isNone() || var.name == "0" || var.name == "1" || LookupTable::all().count(var.name)) {
+                return false;
+            }
+            if (last_defs.count(var.name)) {
+                return bool(online.count(var.name));
+            }
+            auto symbol = region.sym_tbl.find(var.name);
+            return symbol == region.sym_tbl.end() ||
+                   (symbol->second.prop != VProp::RND && symbol->second.prop != VProp::CST) ||
+                   std::count(original_fparams.begin(), original_fparams.end(), var.name);
+        };
+        /// Operands read by an instruction, bit positions excluded
+        const auto reads = [](const Instruction &inst) -> std::vector<const ValueInfo *> {
+            if (inst.op == "/clear/") {
+                return {};
+            }
+            if (inst.op == "/var=>z3/") {
+                return {&inst.lhs};
+            }
+            if (inst.op == "/z3=>var/") {
+                return {&inst.res, &inst.lhs};
+            }
+            return {&inst.lhs, &inst.rhs};
+        };
+
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = 0; i < region.count(); i++) {
+                const auto &inst = region.insts[i];
+                if (inst.op == "//") {
+                    continue;
+                }
+                if (online.count(inst.res.name)) {
+                    // An online read sees the value of a var computed offline after all its defs
+                    for (const auto *var : reads(inst)) {
+                        auto last_def = last_defs.find(var->name);
+                        if (last_def != last_defs.end() && last_def->second > i && online.insert(var->name).second) {
+                            changed = true;
+                        }
+                    }
+                    continue;
+                }
+                for (const auto *var : reads(inst)) {
+                    if (isOnline(*var)) {
+                        online.insert(inst.res.name);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::vector<bool> offline(region.count());
+        for (size_t i = 0; i < region.count(); i++) {
+            offline[i] = region.insts[i].op != "//" && !online.count(region.insts[i].res.name);
+        }
+        return offline;
+    }
+
 public:
     Region region;
 };
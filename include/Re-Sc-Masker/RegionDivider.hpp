@@ -13,3 +13,26 @@ public:
     std::vector<Region> regions;
     SymbolTable global_sym_tbl;
 };
+
+/// Group bit gates into the dataflow cones of fanout-free gates: a gate whose result is read once, by a later gate,
+/// joins the region of that gate as long as the region reads at most `max_inputs` distinct bits.
+/// Each region is emitted where its last gate, the only one whose result is read outside of it, was; any other
+/// instruction is a region of its own.
+class ConeRegionDivider : RegionDivider {
+public:
+    ConeRegionDivider(Region &&global_region, unsigned max_inputs);
+    std::vector<Region> regions;
+    SymbolTable global_sym_tbl;
+};
+
+/// Partition the dataflow graph of the instructions into regions of about `region_size` instructions, with few
+/// edges between regions. Regions are grown greedily in a topological order, each next instruction being the ready
+/// one with the most operands defined in the current region, then instructions are moved between adjacent regions
+/// wherever it cuts fewer edges and keeps them balanced. Every instruction depends on the last writes of the bits it
+/// reads and writes, and on the reads since, so the regions keep the original semantics in order.
+class PartitionRegionDivider : RegionDivider {
+public:
+    PartitionRegionDivider(Region &&global_region, size_t region_size);
+    std::vector<Region> regions;
+    SymbolTable global_sym_tbl;
+};
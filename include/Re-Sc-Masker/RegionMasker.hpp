@@ -1,19 +1,44 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/GadgetTemplates.hpp"
 #include "Re-Sc-Masker/Preludes.hpp"
-#include "Re-Sc-Masker/RegionConcatenater.hpp"
 #include "Re-Sc-Masker/RegionDivider.hpp"
-
-template <typename RegionMaskerType>
-class RegionCollector;  // FIXME: remove this after the special hack to handle operator "|" is resolved
+#include "Re-Sc-Masker/RegionSynthesizer.hpp"
+#include "Re-Sc-Masker/WorkStealingPool.hpp"
 
 class RegionMasker : NonCopyable<RegionMasker> {};
 
+struct MaskingOptions {
+    /// Keep masked values as shares across linear operations, see `SCM_SHARE_LINEAR_OPS`; implied above order 1
+    bool share_linear_ops = SCM_SHARE_LINEAR_OPS;
+    /// Masking order d, masked values being split into d+1 shares
+    unsigned order = SCM_MASKING_ORDER;
+    AndGadget and_gadget = SCM_AND_GADGET;
+    GadgetCostWeights cost_weights{SCM_GADGET_COST_INSTRUCTION, SCM_GADGET_COST_RANDOM, SCM_GADGET_COST_LATENCY};
+    /// Mask each region of several gates by a program synthesized for it as a whole, see `SCM_SYNTHESIZE_REGIONS`
+    bool synthesize_regions = SCM_SYNTHESIZE_REGIONS;
+    SynthesisOptions synthesis{SCM_SYNTHESIS_TIMEOUT_MS, SCM_SYNTHESIS_MAX_RANDOMS, SCM_SYNTHESIS_THREADS};
+    /// Regions masked in parallel, 0 for one per hardware thread
+    unsigned threads = SCM_MASKING_THREADS;
+};
+
 struct RegionInOut {
     using VarSet = std::unordered_set<ValueInfo>;
     Region r;
@@ -22,46 +47,155 @@ struct RegionInOut {
     RegionInOut(SymbolTable &&sym_tbl) : r(sym_tbl){};
 };
 
-template <typename Divider = TrivialRegionDivider>
-class TrivialRegionMasker : RegionMasker {
-public:
-    TrivialRegionMasker(Divider &&divided) : global_sym_tbl(std::move(divided.global_sym_tbl)) {
-        for (auto &&region : divided.regions) {
-            regions_io.emplace_back(mask_one(std::move(region)));
+/// What masking has computed for each bit
+struct MaskingState {
+    /// A bit as d+1 shares, xor-ed together to get its value. "0" stands for a share known to be 0.
+    using Shares = std::vector<std::string>;
+    /// Sharings a shared bit is computed from, sorted
+    using Origins = std::vector<std::uint32_t>;
+
+    /// Copy the state of `bit` from `other`, or forget it if `other` has none
+    void copy(const MaskingState &other, const std::string &bit) {
+        copyKey(other.shares, shares, bit);
+        copyKey(other.origins, origins, bit);
+        copyKey(other.plain_origins, plain_origins, bit);
+        copyKey(other.recombined, recombined, bit);
+    }
+
+    /// bit -> its current shares, for bits masked share-wise
+    std::unordered_map<std::string, Shares> shares;
+    /// bit -> the sharings its shares are computed from
+    std::unordered_map<std::string, Origins> origins;
+    /// Sharing of each plain bit, the same whenever it is shared again, so that its sharings are never independent
+    std::unordered_map<std::string, std::uint32_t> plain_origins;
+    /// Shared bits whose plain value is stored in the bit as well
+    std::unordered_set<std::string> recombined;
+
+private:
+    static void copyKey(const auto &from, auto &to, const std::string &key) {
+        to.erase(key);
+        if (auto known = from.find(key); known != from.end()) {
+            to.insert(*known);
         }
     }
-    void dump() const {
-        llvm::errs() << "\n(trivial masked)\n";
+};
 
-        for (const auto &rio : regions_io) {
-            rio.r.dump();
-            for (const auto &in : rio.ins) {
-                llvm::errs() << in.name << "(in)\n";
+/// The masking of regions of `TrivialRegionMasker`, against the state of the bits they touch only.
+/// Regions touching different bits are thus masked in parallel, each by a context of its own seeded with the state
+/// of its bits. Fresh names and sharings are numbered within the context, then renumbered by `TrivialRegionMasker`
+/// after those of the regions before, see `fresh_names` and `FRESH_ORIGIN`.
+class RegionMaskingContext : private NonCopyable<RegionMaskingContext> {
+public:
+    using Shares = MaskingState::Shares;
+    using Origins = MaskingState::Origins;
+
+    /// Fresh names are `FRESH` followed by their index in `fresh_names`
+    static constexpr std::string_view FRESH = "\x01";
+    /// Sharings first drawn by a context are numbered from `FRESH_ORIGIN` on
+    static constexpr std::uint32_t FRESH_ORIGIN = std::uint32_t{1} << 31;
+
+    /// `complemented` ANDs read the complements of their operands, see `TrivialRegionMasker::foldComplements`
+    RegionMaskingContext(const MaskingOptions &opts, const SymbolTable &global_sym_tbl,
+                         const std::unordered_set<std::string> &complemented)
+        : opts(opts), global_sym_tbl(global_sym_tbl), complemented(complemented) {}
+
+    /// The Boolean function computed by a region of several gates, see `ConeRegionDivider`
+    struct RegionFunction {
+        /// Bits read by the region, input i of the truth table being `leaves[i]`
+        std::vector<std::string> leaves;
+        std::uint64_t truth_table;
+        /// Cost of masking the region gate by gate
+        unsigned bound;
+    };
+
+    /// The function of a region of secret bit gates, of which only the last one is read outside of the region,
+    /// if it has an AND or an OR (linear regions are masked share-wise for free) and reads secret bits only
+    std::optional<RegionFunction> functionOf(const Region &region) const {
+        static const std::vector<std::string> GATES = {"^", "==", "&", "&&", "|", "||", "!", "~"};
+        if (region.count() < 2) {
+            return std::nullopt;
+        }
+        auto and_cost = gadget::costOf(gadget::choose(opts.and_gadget, 1, true, opts.cost_weights), 1);
+        auto and_weighted =
+            opts.cost_weights.instruction * and_cost.instructions + opts.cost_weights.random * and_cost.randoms;
+        RegionFunction function{{}, 0, 0};
+        std::unordered_set<std::string> defined;
+        auto is_nonlinear = false;
+        for (const auto &inst : region.insts) {
+            if (inst.res.width != 1 || std::find(GATES.begin(), GATES.end(), inst.op) == GATES.end()) {
+                return std::nullopt;
             }
-            for (const auto &out : rio.outs) {
-                llvm::errs() << out.name << "(out)\n";
+            for (const auto *operand : {&inst.lhs, &inst.rhs}) {
+                if (operand->isNone() || defined.count(operand->name) ||
+                    std::find(function.leaves.begin(), function.leaves.end(), operand->name) !=
+                        function.leaves.end()) {
+                    continue;
+                }
+                if (isPublic(operand->name) || isRandom(operand->name)) {
+                    return std::nullopt;
+                }
+                function.leaves.push_back(operand->name);
+            }
+            defined.insert(inst.res.name);
+            is_nonlinear |= inst.op == "&" || inst.op == "&&" || inst.op == "|" || inst.op == "||";
+
+            // Gate by gate: share-wise linear gates, and a gadget and NOTs for ANDs and ORs
+            if (inst.op == "^") {
+                function.bound += 2 * opts.cost_weights.instruction;
+            } else if (inst.op == "==") {
+                function.bound += 3 * opts.cost_weights.instruction;
+            } else if (inst.op == "!" || inst.op == "~") {
+                function.bound += opts.cost_weights.instruction;
+            } else if (inst.op == "&" || inst.op == "&&") {
+                function.bound += and_weighted;
+            } else {
+                function.bound += and_weighted + 3 * opts.cost_weights.instruction;
             }
         }
-        llvm::errs() << "\nglobal sym tbl:\n";
-        for (const auto &[varname, vinfo] : global_sym_tbl) {
-            llvm::errs() << varname << " " << vinfo.toString() << "\n";
+        if (!is_nonlinear || function.leaves.size() > 6) {
+            return std::nullopt;
         }
-        llvm::errs() << "\n----\n";
+        for (unsigned x = 0; x < (1u << function.leaves.size()); x++) {
+            std::unordered_map<std::string, bool> values;
+            for (size_t i = 0; i < function.leaves.size(); i++) {
+                values[function.leaves[i]] = x >> i & 1;
+            }
+            for (const auto &inst : region.insts) {
+                auto a = values.at(inst.lhs.name), b = inst.isUnaryOp() ? false : values.at(inst.rhs.name);
+                const auto &op = inst.op;
+                values[inst.res.name] = op == "^" ? a != b
+                                        : op == "==" ? a == b
+                                        : op == "&" || op == "&&" ? a && b
+                                        : op == "|" || op == "||" ? a || b
+                                                                  : !a;
+            }
+            function.truth_table |= std::uint64_t{values.at(region.insts.back().res.name)} << x;
+        }
+        return function;
     }
 
-private:
-    /// return a masked version of one region
-    RegionInOut mask_one(Region &&originalRegion) noexcept {
-        assert(originalRegion.count() == 1 || (originalRegion.dump(), false));  // trivial divider only
-
+    /// return a masked version of one region, by `program` if given and if it can be
+    RegionInOut mask_one(Region &&originalRegion, const RegionFunction *function = nullptr,
+                         const MaskedProgram *program = nullptr) noexcept {
         RegionInOut masked_region_in_out(std::move(originalRegion.sym_tbl));
+        if (program && mask_synthesized(masked_region_in_out.r, originalRegion.insts.back(), *function, *program)) {
+            return masked_region_in_out;
+        }
 
         // mask each instruction
         for (auto &&inst : originalRegion.insts) {
-            if (inst.op == "//") {
+            // Comments and public computation (see `TaintPass`) are kept as-is
+            if (inst.op == "//" || inst.res.prop == VProp::PUB) {
+                state.shares.erase(inst.res.name);
+                state.origins.erase(inst.res.name);
                 masked_region_in_out.r.insts.emplace_back(std::move(inst));
                 continue;
             }
+            // The gadgets below are first-order only
+            if (opts.share_linear_ops || opts.order > 1) {
+                mask_shared(masked_region_in_out.r, std::move(inst));
+                continue;
+            }
 
             // update in vars for this region
             masked_region_in_out.ins.insert(inst.lhs);
@@ -77,230 +211,663 @@ private:
         return masked_region_in_out;
     }
 
-    TrivialRegionMasker(TrivialRegionMasker &&other) noexcept {}
-    TrivialRegionMasker &operator=(TrivialRegionMasker &&other) noexcept {
-        if (this != &other) {
-            regions_io = std::move(other.regions_io);
+    /// The state of the bits of the regions masked by this context
+    MaskingState state;
+    /// The bit each fresh share is named after, or empty for a fresh random bit, in the order they were drawn
+    std::vector<std::string> fresh_names;
+    std::uint32_t origin_count = 0;
+    std::map<AndGadget, size_t> gadget_counts;
+    size_t synthesized_count = 0;
+
+private:
+    /// Mask a region by a program synthesized for its function, unless the shares of its leaves are not independent
+    /// from each other, as the program expects
+    bool mask_synthesized(Region &r, const Instruction &root, const RegionFunction &function,
+                          const MaskedProgram &program) {
+        std::vector<std::string> signals;
+        Origins leaf_origins;
+        for (const auto &leaf : function.leaves) {
+            auto s = sharesOf(r, leaf);
+            auto o = originsOf(leaf);
+            Origins common;
+            std::set_intersection(leaf_origins.begin(), leaf_origins.end(), o.begin(), o.end(),
+                                  std::back_inserter(common));
+            if (!common.empty() || s[0] == "0" || s[0] == "1" || s[1] == "0" || s[1] == "1") {
+                return false;
+            }
+            leaf_origins = unite(leaf_origins, o);
+            signals.insert(signals.end(), s.begin(), s.end());
         }
-        return *this;
+        r.insts.emplace_back("//", "synthesized: " + root.toString());
+        const auto &res = root.res.name;
+        for (unsigned j = 0; j < program.randoms; j++) {
+            signals.push_back(newRandom(r));
+        }
+        for (const auto &op : program.ops) {
+            signals.push_back(emitShare(r, op.op, res, signals[op.lhs], op.op == "!" ? "" : signals[op.rhs]));
+        }
+        state.shares[res] = {signals[program.res[0]], signals[program.res[1]]};
+        state.origins[res] = program.fresh ? Origins{newOrigin()} : leaf_origins;
+        state.recombined.erase(res);
+        synthesized_count++;
+        return true;
     }
 
-private:
-    void issueNewInst(std::vector<Instruction> &newInsts, std::string_view op, const ValueInfo &t, const ValueInfo &a,
-                      const ValueInfo &b) {
-        newInsts.emplace_back(op, t, a, b);
+    /// Fill the slots of a gadget and emit its instructions at once
+    void instantiate(Region &r, const gadget::Template &gadget, const Instruction &inst) {
+        std::vector<ValueInfo> slots(gadget::T0 + gadget.temps.size());
+        slots[gadget::A] = inst.lhs;
+        slots[gadget::B] = inst.rhs;
+        slots[gadget::RES] = inst.res;
+        for (std::uint8_t i = 0; i < gadget.rand_count; i++) {
+            slots[gadget::R1 + i] = r.sym_tbl.at(newRandom(r));
+        }
+        for (size_t i = 0; i < gadget.temps.size(); i++) {
+            const auto &temp = gadget.temps[i];
+            auto &var = slots[gadget::T0 + i] =
+                ValueInfo{inst.res.name + std::string(temp.suffix), 1, temp.prop, nullptr};
+            r.sym_tbl[var.name] = var;
+        }
+        r.sym_tbl[inst.res.name] = inst.res;
+
+        r.insts.reserve(r.insts.size() + gadget.ops.size());
+        for (const auto &op : gadget.ops) {
+            r.insts.emplace_back(op.op, slots[op.res], slots[op.lhs], slots[op.rhs]);
+        }
     }
 
     /// Maske a single instruction, appending masked instruction(s) to the end of the region
     void mask_n_update(Region &r, const Instruction &inst) {
-        const auto &A = inst.lhs;
-        const auto &B = inst.rhs;
         const auto &op = inst.op;
-        const auto &res = inst.res;
-
-        if (inst.op == "//") {
-            r.insts.emplace_back(inst);
+        if (op == "==") {
+            instantiate(r, gadget::EQ, inst);
             return;
-        }
-        // TRICK: A|B == !( (!A) & (!B) )
-        // Should NOT use this trick to decouple Masker and other components
-        if (op == "|" || op == "||") {
-            ValueInfo nA(res.name + "ornA", 1, VProp::UNK, nullptr);
-            ValueInfo nB(res.name + "ornB", 1, VProp::UNK, nullptr);
-            ValueInfo andNN(res.name + "orand", 1, VProp::MASKED, nullptr);
-            Region temp_region;
-            temp_region.sym_tbl[nA.name] = nA;
-            temp_region.sym_tbl[nB.name] = nB;
-            temp_region.sym_tbl[andNN.name] = andNN;
-            r.sym_tbl[res.name] = res;
-
-            temp_region.insts.emplace_back("!", nA, A, ValueInfo());
-            temp_region.insts.emplace_back("!", nB, B, ValueInfo());
-            temp_region.insts.emplace_back("&&", andNN, nA, nB);
-            temp_region.insts.emplace_back("!", res, andNN, ValueInfo());
-
-            TrivialRegionDivider real_divided(std::move(temp_region));
-            TrivialRegionMasker real_masked(std::move(real_divided));
-            RegionCollector real_collected(std::move(real_masked));
-            RegionConcatenater real_concatenated(std::move(real_collected));
-
-            r.sym_tbl.insert(std::make_move_iterator(real_concatenated.region.sym_tbl.begin()),
-                             std::make_move_iterator(real_concatenated.region.sym_tbl.end()));
-            r.insts.insert(r.insts.end(), std::make_move_iterator(real_concatenated.region.insts.begin()),
-                           std::make_move_iterator(real_concatenated.region.insts.end()));
+        } else if (op == "^") {
+            instantiate(r, gadget::XOR, inst);
+            return;
+        } else if (op == "!" || op == "~") {
+            instantiate(r, gadget::NOT, inst);
+            return;
+        } else if (op == "&" || op == "&&") {
+            instantiate(r, complemented.count(inst.res.name) ? gadget::NOR : gadget::AND, inst);
+            return;
+        } else if (op == "|" || op == "||") {
+            instantiate(r, gadget::OR, inst);
             return;
         }
 
-        else if (op == "==") {
-            // EQ: T=(A==B) -> T=!(A^B) ->
-            // mA=A^r1;
-            // mB=B^r2;
-            // mT=mA^mB;
-            // mR=r1^r2;
-            // T_=mT^r3;
-            // mC = T_^mR;
-            // Tr3 = ~mC;
-            // T = Tr3^r3;
-
-            ValueInfo r1 = ValueInfo::getNewRand();
-            ValueInfo r2 = ValueInfo::getNewRand();
-            ValueInfo mA(res.name + "xormA", 1, VProp::MASKED, nullptr);
-            ValueInfo mB(res.name + "xormB", 1, VProp::MASKED, nullptr);
-            ValueInfo mR(res.name + "xormR", 1, VProp::MASKED, nullptr);
-            ValueInfo mT(res.name + "xormT", 1, VProp::MASKED, nullptr);
-            ValueInfo T_(res.name + "xormT_", 1, VProp::MASKED, nullptr);
-            ValueInfo mC(res.name + "xormC", 1, VProp::MASKED, nullptr);
-            ValueInfo Tr3(res.name + "xormTr3", 1, VProp::MASKED, nullptr);
-            ValueInfo r3 = ValueInfo::getNewRand();
-
-            r.sym_tbl[r1.name] = r1;
-            r.sym_tbl[r2.name] = r2;
-            r.sym_tbl[r3.name] = r3;
-            r.sym_tbl[mA.name] = mA;
-            r.sym_tbl[mB.name] = mB;
-            r.sym_tbl[mR.name] = mR;
-            r.sym_tbl[mT.name] = mT;
-            r.sym_tbl[T_.name] = T_;
-            r.sym_tbl[mC.name] = mC;
-            r.sym_tbl[Tr3.name] = Tr3;
-            r.sym_tbl[res.name] = res;
-
-            issueNewInst(r.insts, "^", mA, A, r1);
-            issueNewInst(r.insts, "^", mB, B, r2);
-            issueNewInst(r.insts, "^", mT, mA, mB);
-            issueNewInst(r.insts, "^", mR, r1, r2);
-            issueNewInst(r.insts, "^", T_, mT, r3);
-            issueNewInst(r.insts, "^", mC, T_, mR);
-            issueNewInst(r.insts, "!", Tr3, mC, ValueInfo());
-            issueNewInst(r.insts, "^", res, Tr3, r3);
+        // default
+        r.insts.emplace_back(inst);
+        return;
+    }
 
+    /// Mask a single instruction on shares, appending the instructions to the end of the region.
+    /// Linear operations are done share by share, ANDs by the gadget chosen by `gadget::choose`.
+    /// Other instructions read plain values, which are recombined from their shares first.
+    void mask_shared(Region &r, Instruction &&inst) {
+        const auto &op = inst.op;
+        const auto &res = inst.res.name;
+        if (op == "=") {
+            auto a = sharesOf(r, inst.lhs.name);
+            state.origins[res] = originsOf(inst.lhs.name);
+            state.shares[res] = std::move(a);
+        } else if (op == "!" || op == "~") {
+            auto a = sharesOf(r, inst.lhs.name);
+            a[0] = emitShare(r, "!", res, a[0], "");
+            state.origins[res] = originsOf(inst.lhs.name);
+            state.shares[res] = std::move(a);
+        } else if (op == "^" || op == "==") {
+            auto sa = sharesOf(r, inst.lhs.name);
+            auto sb = sharesOf(r, inst.rhs.name);
+            Shares c(sa.size());
+            for (size_t i = 0; i < c.size(); i++) {
+                c[i] = emitShare(r, "^", res, sa[i], sb[i]);
+            }
+            if (op == "==") {
+                c[0] = emitShare(r, "!", res, c[0], "");
+            }
+            state.origins[res] = unite(originsOf(inst.lhs.name), originsOf(inst.rhs.name));
+            state.shares[res] = std::move(c);
+        } else if (op == "&" || op == "&&") {
+            auto a = sharesOf(r, inst.lhs.name);
+            auto b = sharesOf(r, inst.rhs.name);
+            state.shares[res] = andShares(r, res, a, b, originsOf(inst.lhs.name), originsOf(inst.rhs.name));
+        } else if (op == "|" || op == "||") {  // A|B == !((!A) & (!B))
+            auto a = sharesOf(r, inst.lhs.name);
+            auto b = sharesOf(r, inst.rhs.name);
+            a[0] = emitShare(r, "!", res, a[0], "");
+            b[0] = emitShare(r, "!", res, b[0], "");
+            auto c = andShares(r, res, a, b, originsOf(inst.lhs.name), originsOf(inst.rhs.name));
+            c[0] = emitShare(r, "!", res, c[0], "");
+            state.shares[res] = std::move(c);
+        } else {
+            recombine(r, inst.lhs.name);
+            if (!inst.isUnaryOp()) {
+                recombine(r, inst.rhs.name);
+            }
+            state.shares.erase(res);
+            state.origins.erase(res);
+            r.insts.emplace_back(std::move(inst));
             return;
-        } else if (op == "^") {
-            // XOR: T=A^B ->
-            // mA=A^r1;
-            // mB=B^r2;
-            // mT=mA^mB;
-            // mR=r1^r2;
-            // T=mT^mR;
-
-            ValueInfo r1 = ValueInfo::getNewRand();
-            ValueInfo r2 = ValueInfo::getNewRand();
-            ValueInfo mA(res.name + "xormA", 1, VProp::MASKED, nullptr);
-            ValueInfo mB(res.name + "xormB", 1, VProp::MASKED, nullptr);
-            ValueInfo mR(res.name + "xormR", 1, VProp::MASKED, nullptr);
-            ValueInfo mT(res.name + "xormT", 1, VProp::MASKED, nullptr);
-
-            r.sym_tbl[r1.name] = r1;
-            r.sym_tbl[r2.name] = r2;
-            r.sym_tbl[mA.name] = mA;
-            r.sym_tbl[mB.name] = mB;
-            r.sym_tbl[mR.name] = mR;
-            r.sym_tbl[mT.name] = mT;
-            r.sym_tbl[res.name] = res;
-
-            issueNewInst(r.insts, "^", mA, A, r1);
-            issueNewInst(r.insts, "^", mB, B, r2);
-            issueNewInst(r.insts, "^", mT, mA, mB);
-            issueNewInst(r.insts, "^", mR, r1, r2);
-            issueNewInst(r.insts, "^", res, mR, mT);
+        }
+        state.recombined.erase(res);
+    }
 
-            return;
+    /// Shares of `a & b`, recording the sharings they are computed from.
+    /// A public operand is ANDed share-wise, otherwise the gadget depends on whether the operands are shared
+    /// independently. The outputs of SNI and PINI gadgets are fresh sharings, those of DOM are not.
+    Shares andShares(Region &r, const std::string &res, const Shares &a, const Shares &b, const Origins &oa,
+                     const Origins &ob) {
+        auto is_plain = [](const Shares &x) {
+            return std::all_of(x.begin() + 1, x.end(), [](const auto &s) { return s == "0"; });
+        };
+        if (is_plain(a) || is_plain(b)) {
+            const auto &pub = is_plain(a) ? a[0] : b[0];
+            const auto &var = is_plain(a) ? b : a;
+            Shares c(var.size());
+            for (size_t i = 0; i < c.size(); i++) {
+                c[i] = emitShare(r, "&&", res, var[i], pub);
+            }
+            state.origins[res] = unite(oa, ob);
+            return c;
         }
 
-        else if (op == "!" || op == "~") {
-            // NOT: T=!A ->
-            // mA=A^r1;
-            // mT=!mA;
-            // T=mT^r1
+        Origins common;
+        std::set_intersection(oa.begin(), oa.end(), ob.begin(), ob.end(), std::back_inserter(common));
+        auto gadget = gadget::choose(opts.and_gadget, opts.order, common.empty(), opts.cost_weights);
+        gadget_counts[gadget]++;
+        switch (gadget) {
+            case AndGadget::DOM:
+                state.origins[res] = unite(oa, ob);
+                return domShares(r, res, a, b);
+            case AndGadget::HPC1:
+                state.origins[res] = {newOrigin()};
+                return domShares(r, res, a, refreshShares(r, res, b));
+            default:
+                state.origins[res] = {newOrigin()};
+                return iswShares(r, res, a, b);
+        }
+    }
 
-            ValueInfo r1 = ValueInfo::getNewRand();
-            ValueInfo mA(res.name + "notmA", 1, VProp::MASKED, nullptr);
-            ValueInfo mT(res.name + "notmT", 1, VProp::MASKED, nullptr);
+    /// c_i = a_i b_i ^ sum_{j != i} r_ij, r_ij random for i < j, r_ij = (r_ji ^ a_j b_i) ^ a_i b_j otherwise
+    Shares iswShares(Region &r, const std::string &res, const Shares &a, const Shares &b) {
+        auto n = a.size();
+        /// r_ij at i * n + j
+        std::vector<std::string> rnds(n * n);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = i + 1; j < n; j++) {
+                rnds[i * n + j] = newRandom(r);
+            }
+        }
+        Shares c(n);
+        for (size_t i = 0; i < n; i++) {
+            std::vector<std::string> terms;
+            for (size_t j = 0; j < n; j++) {
+                if (i < j) {
+                    terms.push_back(rnds[i * n + j]);
+                } else if (j < i) {
+                    auto term = emitShare(r, "^", res, rnds[j * n + i], emitShare(r, "&&", res, a[j], b[i]));
+                    terms.push_back(emitShare(r, "^", res, term, emitShare(r, "&&", res, a[i], b[j])));
+                }
+            }
+            c[i] = emitShare(r, "&&", res, a[i], b[i]);
+            for (const auto &term : terms) {
+                c[i] = emitShare(r, "^", res, c[i], term);
+            }
+        }
+        return c;
+    }
 
-            r.sym_tbl[r1.name] = r1;
-            r.sym_tbl[mA.name] = mA;
-            r.sym_tbl[mT.name] = mT;
-            r.sym_tbl[res.name] = res;
+    /// c_i = a_i b_i ^ sum_{j != i} (a_i b_j ^ r_ij), r_ij = r_ji random, the terms summed by a balanced tree
+    Shares domShares(Region &r, const std::string &res, const Shares &a, const Shares &b) {
+        auto n = a.size();
+        auto rnds = pairRandoms(r, n);
+        Shares c(n);
+        for (size_t i = 0; i < n; i++) {
+            std::vector<std::string> terms{emitShare(r, "&&", res, a[i], b[i])};
+            for (size_t j = 0; j < n; j++) {
+                if (j != i) {
+                    auto cross = emitShare(r, "&&", res, a[i], b[j]);
+                    terms.push_back(emitShare(r, "^", res, cross, rnds[i * n + j]));
+                }
+            }
+            while (terms.size() > 1) {
+                std::vector<std::string> sums;
+                for (size_t k = 0; k + 1 < terms.size(); k += 2) {
+                    sums.push_back(emitShare(r, "^", res, terms[k], terms[k + 1]));
+                }
+                if (terms.size() % 2) {
+                    sums.push_back(terms.back());
+                }
+                terms = std::move(sums);
+            }
+            c[i] = terms[0];
+        }
+        return c;
+    }
 
-            issueNewInst(r.insts, "^", mA, A, r1);
-            issueNewInst(r.insts, "!", mT, mA, ValueInfo());
-            issueNewInst(r.insts, "^", res, mT, r1);
+    /// SNI refresh: b_i ^ sum_{j != i} r_ij, r_ij = r_ji random, accumulated share by share
+    Shares refreshShares(Region &r, const std::string &res, const Shares &b) {
+        auto n = b.size();
+        auto rnds = pairRandoms(r, n);
+        Shares c(b);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < n; j++) {
+                if (j != i) {
+                    c[i] = emitShare(r, "^", res, c[i], rnds[i * n + j]);
+                }
+            }
+        }
+        return c;
+    }
 
-            return;
+    /// A fresh random bit r_ij = r_ji for each pair of shares i != j, at i * n + j
+    std::vector<std::string> pairRandoms(Region &r, size_t n) {
+        std::vector<std::string> rnds(n * n);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = i + 1; j < n; j++) {
+                rnds[i * n + j] = rnds[j * n + i] = newRandom(r);
+            }
+        }
+        return rnds;
+    }
+
+    std::string newRandom(Region &r) {
+        auto rnd = freshName("");
+        r.sym_tbl[rnd] = ValueInfo{rnd, 1, VProp::RND, nullptr};
+        return rnd;
+    }
+
+    /// A name numbered once the regions before are masked: the next share of `bit`, or the next random bit if empty
+    std::string freshName(const std::string &bit) {
+        fresh_names.push_back(bit);
+        return std::string(FRESH) + std::to_string(fresh_names.size() - 1);
+    }
+
+    /// Shares of a bit. Public, random and constant bits are shared with 0s, plain secret bits are refreshed.
+    Shares sharesOf(Region &r, const std::string &bit) {
+        auto known = state.shares.find(bit);
+        if (known != state.shares.end()) {
+            return known->second;
+        }
+        Shares s(opts.order + 1, "0");
+        s[0] = bit;
+        if (isPublic(bit) || isRandom(bit)) {
+            return s;
+        }
+        for (size_t i = 1; i < s.size(); i++) {
+            s[i] = newRandom(r);
+            s[0] = emitShare(r, "^", bit, s[0], s[i]);
+        }
+        state.recombined.insert(bit);
+        state.origins[bit] = {plainOrigin(bit)};
+        return state.shares[bit] = s;
+    }
+
+    /// Sharings a bit is computed from; random bits are sharings of their own
+    Origins originsOf(const std::string &bit) {
+        auto known = state.origins.find(bit);
+        if (known != state.origins.end()) {
+            return known->second;
         }
+        return isRandom(bit) ? Origins{plainOrigin(bit)} : Origins{};
+    }
+
+    std::uint32_t plainOrigin(const std::string &bit) {
+        auto known = state.plain_origins.find(bit);
+        return known != state.plain_origins.end() ? known->second : state.plain_origins[bit] = newOrigin();
+    }
 
-        else if (op == "&" || op == "&&") {
-            // AND: T = A & B ->
-            // mA = A ^ r1;
-            // mB = B ^ r2;
-            // negmB = !mB;
-            // mAr2 = mA & r2;
-            // negr3 = !r3;
-            // tmp1 = negmB & r3;
-            // tmp2 = mB & mA;
-            // tmp3 = !mAr2;
-            // tmp4 = negr3 | r2;
-            // tmp5 = tmp1 | tmp2;
-            // tmp6 = tmp3 ^ tmp4;
-            // T = tmp5 ^ tmp6;
-
-            ValueInfo r1 = ValueInfo::getNewRand();
-            ValueInfo r2 = ValueInfo::getNewRand();
-            ValueInfo r3 = ValueInfo::getNewRand();
-            ValueInfo mA(res.name + "andmA", 1, VProp::MASKED, nullptr);
-            ValueInfo mB(res.name + "andmB", 1, VProp::MASKED, nullptr);
-            ValueInfo negmB(res.name + "andneg1", 1, VProp::UNK, nullptr);
-            ValueInfo mAr2(res.name + "andr2", 1, VProp::UNK, nullptr);
-            ValueInfo negr3(res.name + "andneg2", r3.width, VProp::UNK, nullptr);
-            ValueInfo tmp1(res.name + "andtmp1", 1, VProp::UNK, nullptr);
-            ValueInfo tmp2(res.name + "andtmp2", 1, VProp::UNK, nullptr);
-            ValueInfo tmp3(res.name + "andtmp3", 1, VProp::UNK, nullptr);
-            ValueInfo tmp4(res.name + "andtmp4", 1, VProp::UNK, nullptr);
-            ValueInfo tmp5(res.name + "andtmp5", 1, VProp::UNK, nullptr);
-            ValueInfo tmp6(res.name + "andtmp6", 1, VProp::UNK, nullptr);
-
-            r.sym_tbl[r1.name] = r1;
-            r.sym_tbl[r2.name] = r2;
-            r.sym_tbl[r3.name] = r3;
-            r.sym_tbl[mA.name] = mA;
-            r.sym_tbl[mB.name] = mB;
-            r.sym_tbl[negmB.name] = negmB;
-            r.sym_tbl[mAr2.name] = mAr2;
-            r.sym_tbl[negr3.name] = negr3;
-            r.sym_tbl[tmp1.name] = tmp1;
-            r.sym_tbl[tmp2.name] = tmp2;
-            r.sym_tbl[tmp3.name] = tmp3;
-            r.sym_tbl[tmp4.name] = tmp4;
-            r.sym_tbl[tmp5.name] = tmp5;
-            r.sym_tbl[tmp6.name] = tmp6;
-            r.sym_tbl[res.name] = res;
-
-            // Mask A and B with random values
-            issueNewInst(r.insts, "^", mA, A, r1);
-            issueNewInst(r.insts, "^", mB, B, r2);
-            issueNewInst(r.insts, "!", negmB, mB, ValueInfo());
-            issueNewInst(r.insts, "&&", mAr2, mA, r2);
-            issueNewInst(r.insts, "!", negr3, r3, ValueInfo());
-            issueNewInst(r.insts, "&&", tmp1, negmB, r3);
-            issueNewInst(r.insts, "&&", tmp2, mB, mA);
-            issueNewInst(r.insts, "!", tmp3, mAr2, ValueInfo());
-            issueNewInst(r.insts, "||", tmp4, negr3, r2);
-            issueNewInst(r.insts, "||", tmp5, tmp1, tmp2);
-            issueNewInst(r.insts, "^", tmp6, tmp3, tmp4);
-            issueNewInst(r.insts, "^", res, tmp5, tmp6);
+    std::uint32_t newOrigin() { return FRESH_ORIGIN + origin_count++; }
 
+    static Origins unite(const Origins &a, const Origins &b) {
+        Origins res;
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(res));
+        return res;
+    }
+
+    /// Store the value of a shared bit into the bit itself, once per definition
+    void recombine(Region &r, const std::string &bit) {
+        auto known = state.shares.find(bit);
+        if (known == state.shares.end() || state.recombined.count(bit)) {
             return;
         }
+        std::vector<std::string> terms;
+        std::copy_if(known->second.begin(), known->second.end(), std::back_inserter(terms),
+                     [](const auto &s) { return s != "0"; });
+        auto operand = [](const std::string &x) {
+            return ValueInfo{x, 1, x == "1" ? VProp::CST : VProp::MASKED, nullptr};
+        };
+        ValueInfo var{bit, 1, VProp::UNK, nullptr};
+        if (terms.size() < 2) {
+            r.insts.emplace_back("=", var, terms.empty() ? ValueInfo{"0", 1, VProp::CST, nullptr} : operand(terms[0]),
+                                 ValueInfo{});
+        } else {
+            auto sum = terms[0];
+            for (size_t i = 1; i + 1 < terms.size(); i++) {
+                sum = emitShare(r, "^", bit, sum, terms[i]);
+            }
+            r.insts.emplace_back("^", var, operand(sum), operand(terms.back()));
+        }
+        state.recombined.insert(bit);
+    }
 
-        // default
-        r.insts.emplace_back(inst);
-        return;
+    /// A new share `a op b`, folding the constant shares; `b` is empty for `!`
+    std::string emitShare(Region &r, std::string_view op, const std::string &res, const std::string &a,
+                          const std::string &b) {
+        auto is_const = [](const std::string &x) { return x == "0" || x == "1"; };
+        if (op == "!" && is_const(a)) {
+            return a == "0" ? "1" : "0";
+        }
+        if (op == "^" && (a == "0" || b == "0")) {
+            return a == "0" ? b : a;
+        }
+        if (op == "&&" && (a == "0" || b == "0")) {
+            return "0";
+        }
+        if (op == "&&" && (a == "1" || b == "1")) {
+            return a == "1" ? b : a;
+        }
+        ValueInfo share{freshName(res), 1, VProp::MASKED, nullptr};
+        r.sym_tbl[share.name] = share;
+        auto operand = [](const std::string &x) {
+            return ValueInfo{x, 1, x == "0" || x == "1" ? VProp::CST : VProp::MASKED, nullptr};
+        };
+        r.insts.emplace_back(op, share, operand(a), b.empty() ? ValueInfo{} : operand(b));
+        return share.name;
+    }
+
+    bool isPublic(const std::string &bit) const {
+        if (bit == "0" || bit == "1") {
+            return true;
+        }
+        auto var = global_sym_tbl.find(bit);
+        return var != global_sym_tbl.end() && (var->second.prop == VProp::PUB || var->second.prop == VProp::CST);
+    }
+
+    bool isRandom(const std::string &bit) const {
+        auto var = global_sym_tbl.find(bit);
+        return var != global_sym_tbl.end() && var->second.prop == VProp::RND;
+    }
+
+    const MaskingOptions &opts;
+    const SymbolTable &global_sym_tbl;
+    const std::unordered_set<std::string> &complemented;
+};
+
+template <typename Divider = TrivialRegionDivider>
+class TrivialRegionMasker : RegionMasker {
+public:
+    TrivialRegionMasker(Divider &&divided, const MaskingOptions &opts = {})
+        : opts(opts), global_sym_tbl(std::move(divided.global_sym_tbl)) {
+        auto &regions = divided.regions;
+        const auto n = regions.size();
+        if (!opts.share_linear_ops && opts.order <= 1) {
+            foldComplements(regions);
+        }
+
+        // The functions of the regions are synthesized at once, each distinct one once
+        std::vector<std::optional<RegionMaskingContext::RegionFunction>> functions(n);
+        std::vector<RegionSynthesizer::Goal> goals;
+        std::map<std::pair<unsigned, std::uint64_t>, size_t> goal_ids;
+        std::vector<size_t> region_goals(n);
+        if (opts.synthesize_regions && opts.order == 1 && opts.share_linear_ops) {
+            RegionMaskingContext probe(this->opts, global_sym_tbl, complemented);
+            for (size_t i = 0; i < n; i++) {
+                functions[i] = probe.functionOf(regions[i]);
+                if (functions[i]) {
+                    auto inputs = unsigned(functions[i]->leaves.size());
+                    auto [goal, is_new] = goal_ids.try_emplace({inputs, functions[i]->truth_table}, goals.size());
+                    if (is_new) {
+                        goals.push_back({functions[i]->truth_table, inputs, functions[i]->bound});
+                    }
+                    region_goals[i] = goal->second;
+                }
+            }
+        }
+        RegionSynthesizer synthesized(goals, opts.cost_weights, opts.synthesis);
+
+        // A region is masked once the last region before it touching any of its bits is merged, the state of its
+        // bits being final then. Regions are merged in order, so that the result does not depend on the threads.
+        std::vector<std::vector<std::string>> footprints(n);
+        std::vector<std::vector<size_t>> released(n);
+        std::vector<size_t> roots;
+        std::unordered_map<std::string, size_t> last_regions;
+        for (size_t j = 0; j < n; j++) {
+            footprints[j] = footprintOf(regions[j]);
+            std::optional<size_t> after;
+            for (const auto &bit : footprints[j]) {
+                auto [last, is_new] = last_regions.try_emplace(bit, j);
+                if (!is_new) {
+                    after = std::max(after.value_or(0), last->second);
+                    last->second = j;
+                }
+            }
+            (after ? released[*after] : roots).push_back(j);
+        }
+
+        std::vector<std::unique_ptr<RegionMaskingContext>> contexts(n);
+        std::vector<std::optional<RegionInOut>> results(n);
+        size_t merged = 0;
+        std::mutex mutex;
+        WorkStealingPool(opts.threads, roots, [&](size_t j, const WorkStealingPool::Push &push) {
+            auto context = std::make_unique<RegionMaskingContext>(this->opts, global_sym_tbl, complemented);
+            {
+                std::lock_guard lock(mutex);
+                for (const auto &bit : footprints[j]) {
+                    context->state.copy(state, bit);
+                }
+            }
+            const auto *program = functions[j] ? &synthesized.get()[region_goals[j]] : nullptr;
+            auto masked = program && *program
+                              ? context->mask_one(std::move(regions[j]), &*functions[j], &**program)
+                              : context->mask_one(std::move(regions[j]));
+
+            std::vector<size_t> ready;
+            {
+                std::lock_guard lock(mutex);
+                results[j].emplace(std::move(masked));
+                contexts[j] = std::move(context);
+                for (; merged < n && contexts[merged]; merged++) {
+                    merge(*contexts[merged], *results[merged], footprints[merged]);
+                    contexts[merged].reset();
+                    ready.insert(ready.end(), released[merged].begin(), released[merged].end());
+                }
+            }
+            for (auto k : ready) {
+                push(k);
+            }
+        });
+        for (auto &result : results) {
+            regions_io.emplace_back(std::move(*result));
+        }
+        llvm::errs() << "===TrivialRegionMasker: order " << opts.order << ", " << gadget_counts[AndGadget::ISW]
+                     << " ISW, " << gadget_counts[AndGadget::DOM] << " DOM, " << gadget_counts[AndGadget::HPC1]
+                     << " HPC1 gadgets, " << synthesized_count << "/"
+                     << std::count_if(functions.begin(), functions.end(), [](const auto &f) { return f.has_value(); })
+                     << " regions synthesized===\n";
+    }
+    void dump() const {
+        llvm::errs() << "\n(trivial masked)\n";
+
+        for (const auto &rio : regions_io) {
+            rio.r.dump();
+            for (const auto &in : rio.ins) {
+                llvm::errs() << in.name << "(in)\n";
+            }
+            for (const auto &out : rio.outs) {
+                llvm::errs() << out.name << "(out)\n";
+            }
+        }
+        llvm::errs() << "\nglobal sym tbl:\n";
+        for (const auto &[varname, vinfo] : global_sym_tbl) {
+            llvm::errs() << varname << " " << vinfo.toString() << "\n";
+        }
+        llvm::errs() << "\n----\n";
     }
 
+    TrivialRegionMasker(TrivialRegionMasker &&other) noexcept {}
+    TrivialRegionMasker &operator=(TrivialRegionMasker &&other) noexcept {
+        if (this != &other) {
+            regions_io = std::move(other.regions_io);
+        }
+        return *this;
+    }
+
+private:
+    /// Fold the NOTs read once around ANDs and ORs into the gadgets masking them gate by gate, as complements of
+    /// shares: `(!a) & (!b)` and `!(a | b)` are masked as NORs, `!((!a) & (!b))`, the ORs of the AIG, as ORs.
+    /// The gates are rewritten to read the operands of the NOTs, which are dropped, in whichever region they are.
+    void foldComplements(std::vector<Region> &regions) {
+        std::unordered_map<std::string, unsigned> reads;
+        for (const auto &region : regions) {
+            for (const auto &inst : region.insts) {
+                if (inst.op == "//") {
+                    continue;
+                }
+                reads[inst.lhs.name]++;
+                if (!inst.isUnaryOp()) {
+                    reads[inst.rhs.name]++;
+                }
+            }
+        }
+
+        // The gate defining each bit, as its region and index
+        std::unordered_map<std::string, std::pair<size_t, size_t>> defs;
+        std::set<std::pair<size_t, size_t>> dropped;
+        auto def_of = [&](const ValueInfo &bit, std::initializer_list<std::string_view> ops) -> Instruction * {
+            auto def = defs.find(bit.name);
+            if (def == defs.end() || reads[bit.name] != 1) {
+                return nullptr;
+            }
+            auto &inst = regions[def->second.first].insts[def->second.second];
+            return std::find(ops.begin(), ops.end(), inst.op) != ops.end() ? &inst : nullptr;
+        };
+        auto drop = [&](const Instruction &inst) {
+            dropped.insert(defs.at(inst.res.name));
+            global_sym_tbl.erase(inst.res.name);
+        };
+        for (size_t j = 0; j < regions.size(); j++) {
+            for (size_t i = 0; i < regions[j].insts.size(); i++) {
+                auto &inst = regions[j].insts[i];
+                if (inst.op == "//" || inst.res.prop == VProp::PUB) {
+                    continue;
+                }
+                if (inst.op == "&" || inst.op == "&&") {
+                    auto *a = def_of(inst.lhs, {"!", "~"});
+                    auto *b = def_of(inst.rhs, {"!", "~"});
+                    if (a && b && a != b) {
+                        drop(*a);
+                        drop(*b);
+                        inst.lhs = a->lhs;
+                        inst.rhs = b->lhs;
+                        complemented.insert(inst.res.name);
+                    }
+                } else if (inst.op == "!" || inst.op == "~") {
+                    if (auto *nor = def_of(inst.lhs, {"&", "&&"}); nor && complemented.erase(nor->res.name)) {
+                        drop(*nor);
+                        inst = Instruction("|", inst.res, nor->lhs, nor->rhs);
+                    } else if (auto *orr = def_of(inst.lhs, {"|", "||"})) {
+                        drop(*orr);
+                        inst = Instruction("&&", inst.res, orr->lhs, orr->rhs);
+                        complemented.insert(inst.res.name);
+                    }
+                }
+                defs[inst.res.name] = {j, i};
+            }
+        }
+        for (auto it = dropped.rbegin(); it != dropped.rend(); ++it) {
+            auto &insts = regions[it->first].insts;
+            regions[it->first].sym_tbl.erase(insts[it->second].res.name);
+            insts.erase(insts.begin() + std::ptrdiff_t(it->second));
+        }
+    }
+
+    /// Bits an instruction of the region reads or defines; numbers (constants, bit indices) are never masked
+    static std::vector<std::string> footprintOf(const Region &region) {
+        auto is_number = [](const std::string &name) {
+            return std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; });
+        };
+        std::vector<std::string> bits;
+        std::unordered_set<std::string> seen;
+        for (const auto &inst : region.insts) {
+            if (inst.op == "//") {
+                continue;
+            }
+            for (const auto *var : {&inst.res, &inst.lhs, &inst.rhs}) {
+                if (!is_number(var->name) && seen.insert(var->name).second) {
+                    bits.push_back(var->name);
+                }
+            }
+        }
+        return bits;
+    }
+
+    /// Number the fresh names and sharings of a masked region after those of the regions merged before,
+    /// then store the state of the bits it touched
+    void merge(RegionMaskingContext &context, RegionInOut &masked, const std::vector<std::string> &footprint) {
+        std::vector<std::string> names;
+        for (const auto &bit : context.fresh_names) {
+            names.push_back(bit.empty() ? ValueInfo::getNewRand().name : bit + "sh" + std::to_string(share_count++));
+        }
+        auto rename = [&](std::string &name) {
+            if (name.starts_with(RegionMaskingContext::FRESH)) {
+                name = names[std::stoul(name.substr(RegionMaskingContext::FRESH.size()))];
+            }
+        };
+        auto renumber = [&](std::uint32_t &origin) {
+            if (origin >= RegionMaskingContext::FRESH_ORIGIN) {
+                origin = origin - RegionMaskingContext::FRESH_ORIGIN + origin_count;
+            }
+        };
+
+        for (auto &inst : masked.r.insts) {
+            rename(inst.res.name);
+            rename(inst.lhs.name);
+            rename(inst.rhs.name);
+        }
+        SymbolTable sym_tbl;
+        for (auto &[name, var] : masked.r.sym_tbl) {
+            rename(var.name);
+            sym_tbl[var.name] = std::move(var);
+        }
+        masked.r.sym_tbl = std::move(sym_tbl);
+        for (auto &[bit, shares] : context.state.shares) {
+            std::for_each(shares.begin(), shares.end(), rename);
+        }
+        for (auto &[bit, origins] : context.state.origins) {
+            std::for_each(origins.begin(), origins.end(), renumber);
+        }
+        for (auto &[bit, origin] : context.state.plain_origins) {
+            renumber(origin);
+        }
+        for (const auto &bit : footprint) {
+            state.copy(context.state, bit);
+        }
+
+        origin_count += context.origin_count;
+        for (const auto &[gadget, count] : context.gadget_counts) {
+            gadget_counts[gadget] += count;
+        }
+        synthesized_count += context.synthesized_count;
+    }
+
+    MaskingOptions opts;
+    /// The state of the bits after the regions merged so far
+    MaskingState state;
+    std::uint32_t origin_count = 0;
+    size_t share_count = 0;
+    std::map<AndGadget, size_t> gadget_counts;
+    size_t synthesized_count = 0;
+    /// Results of the ANDs of complements, masked as NORs
+    std::unordered_set<std::string> complemented;
+
 public:
     std::vector<RegionInOut> regions_io;
     SymbolTable global_sym_tbl;
 };
 
 template <typename Divider>
-TrivialRegionMasker(Divider &&) -> TrivialRegionMasker<std::decay_t<Divider>>;
\ No newline at end of file
+TrivialRegionMasker(Divider &&) -> TrivialRegionMasker<std::decay_t<Divider>>;
+template <typename Divider>
+TrivialRegionMasker(Divider &&, const MaskingOptions &) -> TrivialRegionMasker<std::decay_t<Divider>>;
\ No newline at end of file
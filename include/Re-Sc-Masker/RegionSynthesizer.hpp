@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Re-Sc-Masker/GadgetTemplates.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Limits of synthesizing masked regions
+struct SynthesisOptions {
+    /// Time limit (ms) of synthesizing one region, 0 for unlimited
+    unsigned timeout_ms;
+    /// Most fresh random bits of a synthesized region
+    unsigned max_randoms;
+    /// Regions synthesized at once, 0 for one per hardware thread
+    unsigned threads;
+};
+
+/// A first-order masked program of a Boolean function of a few bits, input i being shared as (x_i ^ m_i, m_i).
+/// Signals 2i and 2i+1 are the shares of input i, followed by the fresh random bits, then by the result of each op.
+struct MaskedProgram {
+    struct Op {
+        /// "^", "&&" or "!"
+        std::string_view op;
+        std::uint8_t lhs, rhs;
+    };
+    unsigned randoms = 0;
+    std::vector<Op> ops;
+    /// Signals of the shares of the result
+    std::uint8_t res[2];
+    /// The result is shared independently of the inputs, its second share being uniform whatever the inputs and
+    /// their masks are. Otherwise it is only independent of other sharings than those of the inputs.
+    bool fresh = false;
+};
+
+/// Synthesize the cheapest first-order masked program of Boolean functions of degree 2 at most by Z3, under the
+/// gadget cost weights (latency aside). For each number of random bits, programs of fewer ops than the cheapest so
+/// far are searched until none is found or time runs out; see `search` for the encoding of programs and of their
+/// security. Distinct functions are synthesized in parallel, one Z3 context each.
+class RegionSynthesizer : private NonCopyable<RegionSynthesizer> {
+public:
+    struct Goal {
+        /// Bit p is the value of the function where input i is bit i of p
+        std::uint64_t truth_table;
+        unsigned inputs;
+        /// Cost of masking the function otherwise; only cheaper programs are searched
+        unsigned bound;
+    };
+
+    RegionSynthesizer(const std::vector<Goal> &goals, const GadgetCostWeights &weights, const SynthesisOptions &opts);
+
+    /// The program of each goal, none if nothing cheaper than its bound was found in time
+    const std::vector<std::optional<MaskedProgram>> &get() const { return programs; }
+
+private:
+    static std::optional<MaskedProgram> synthesize(const Goal &goal, const GadgetCostWeights &weights,
+                                                   const SynthesisOptions &opts);
+
+private:
+    std::vector<std::optional<MaskedProgram>> programs;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Secret-dependence analysis of a bit-level region.
+/// `VProp::SECRET` inputs, and inputs of unknown class, taint every value computed from them.
+/// Instructions reading only public, random or constant values get `VProp::PUB` results, which the masker emits
+/// unmasked; every other result is reset to `VProp::UNK` so that it is masked.
+class TaintPass : private NonCopyable<TaintPass> {
+public:
+    explicit TaintPass(Region &&origin_region);
+
+    /// Return the region with the results of public instructions marked
+    Region get();
+
+private:
+    bool isTainted(const ValueInfo &var) const;
+
+private:
+    Region region;
+    /// Bits and words currently holding secret-dependent values
+    std::unordered_set<std::string> tainted;
+    /// Bits and words defined in the region so far
+    std::unordered_set<std::string> defined;
+    size_t public_count = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+/// Threads running tasks until none is left. Each thread runs the tasks of its own deque from the back, the latest
+/// pushed first, and steals from the front of the deques of the others once it runs out; the tasks pushed by a task
+/// go to the deque of its thread, so that dependent tasks tend to run where their inputs were just computed.
+class WorkStealingPool : private NonCopyable<WorkStealingPool> {
+public:
+    using Push = std::function<void(size_t)>;
+
+    /// Run `work` from the tasks `roots` on `threads` threads, the calling one included (0 for one per hardware
+    /// thread), until every task pushed has run. `work(task, push)` may `push` more tasks.
+    WorkStealingPool(unsigned threads, const std::vector<size_t> &roots,
+                     const std::function<void(size_t, const Push &)> &work);
+};
@@ -1,3 +1,8 @@
+#include <stdint.h>
+
+typedef unsigned char fiat_25519_uint1;
+typedef signed char fiat_25519_int1;
+
 void fiat_25519_subborrowx_u51(uint64_t* out1, fiat_25519_uint1* out2, fiat_25519_uint1 arg1, uint64_t arg2, uint64_t arg3) {
   int64_t x1;
   fiat_25519_int1 x2;
@@ -0,0 +1,55 @@
+#include "Re-Sc-Masker/Aig.hpp"
+
+#include <string>
+#include <utility>
+
+Aig::Lit Aig::mkInput(const std::string &name) {
+    auto [it, inserted] = inputs.try_emplace(name, nodes.size());
+    if (inserted) {
+        nodes.push_back(Node{NodeKind::Input, FALSE, FALSE, name});
+    }
+    return litOf(it->second);
+}
+
+Aig::Lit Aig::mkAnd(Lit a, Lit b) {
+    if (a == FALSE || b == FALSE || a == neg(b)) {
+        return FALSE;
+    }
+    if (a == TRUE || a == b) {
+        return b;
+    }
+    if (b == TRUE) {
+        return a;
+    }
+    return mkGate(NodeKind::And, a, b);
+}
+
+Aig::Lit Aig::mkXor(Lit a, Lit b) {
+    // Complemented fanins are moved to the output: !a ^ b == !(a ^ b)
+    Lit c = isNeg(a) ^ isNeg(b);
+    a &= ~Lit(1);
+    b &= ~Lit(1);
+    if (a == b) {
+        return FALSE ^ c;
+    }
+    if (a == FALSE) {
+        return b ^ c;
+    }
+    if (b == FALSE) {
+        return a ^ c;
+    }
+    return mkGate(NodeKind::Xor, a, b) ^ c;
+}
+
+Aig::Lit Aig::mkGate(NodeKind kind, Lit a, Lit b) {
+    if (a > b) {  // gates are commutative
+        std::swap(a, b);
+    }
+    auto &table = kind == NodeKind::And ? and_table : xor_table;
+    auto [it, inserted] = table.try_emplace(std::uint64_t(a) << 32 | b, nodes.size());
+    if (inserted) {
+        nodes.push_back(Node{kind, a, b, ""});
+        (kind == NodeKind::And ? and_count : xor_count)++;
+    }
+    return litOf(it->second);
+}
@@ -0,0 +1,203 @@
+#include "Re-Sc-Masker/AigPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/BitBlastPass.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+AigPass::AigPass(Region &&blasted_region, const AigOptions &opts) : opts(opts), origin(std::move(blasted_region)) {
+    llvm::errs() << "===AigPass: started===\n";
+    size_t gate_count = 0;
+    for (const auto &inst : origin.insts) {
+        const auto &op = inst.op;
+        if (op == "//") {
+            continue;
+        }
+        if (op == "/var=>z3/") {
+            auto input_count = aig.size();
+            bits[inst.res.name] = aig.mkInput(inst.res.name);
+            if (aig.size() != input_count) {
+                steps.emplace_back(inst, Aig::FALSE);
+            }
+            continue;
+        }
+        if (op == "/z3=>var/") {
+            steps.emplace_back(inst, litOf(inst.lhs));
+            continue;
+        }
+        if (op.starts_with("/")) {  // `/clear/` and pseudo instructions on words
+            steps.emplace_back(inst, Aig::FALSE);
+            continue;
+        }
+
+        gate_count++;
+        auto a = litOf(inst.lhs);
+        auto b = inst.isUnaryOp() ? Aig::FALSE : litOf(inst.rhs);
+        Aig::Lit res;
+        if (op == "=") {
+            res = a;
+        } else if (op == "!" || op == "~") {
+            res = Aig::neg(a);
+        } else if (op == "^") {
+            res = aig.mkXor(a, b);
+        } else if (op == "&" || op == "&&") {
+            res = aig.mkAnd(a, b);
+        } else if (op == "|" || op == "||") {
+            res = aig.mkOr(a, b);
+        } else if (op == "==") {
+            res = aig.mkEq(a, b);
+        } else {
+            llvm::errs() << "===AigPass: unsupported op " << op << ", region kept as-is===\n";
+            supported = false;
+            return;
+        }
+        bits[inst.res.name] = res;
+    }
+    rewrite();
+    emit();
+    llvm::errs() << "===AigPass: " << gate_count << " instructions -> " << region.count() << "===\n";
+}
+
+Aig::Lit AigPass::litOf(const ValueInfo &var) {
+    if (var.name == "0" || var.name == "1") {
+        return var.name == "1" ? Aig::TRUE : Aig::FALSE;
+    }
+    auto lit = bits.find(var.name);
+    if (lit != bits.end()) {
+        return lit->second;
+    }
+    // A bit read before being defined in the region
+    return bits[var.name] = aig.mkInput(var.name);
+}
+
+void AigPass::rewrite() {
+    for (unsigned round = 0; round < opts.rewrite_rounds; round++) {
+        std::vector<Aig::Lit> output_lits;
+        for (const auto &[inst, lit] : steps) {
+            if (inst.op == "/z3=>var/") {
+                output_lits.push_back(lit);
+            }
+        }
+        AigRewriter rewriter(aig, output_lits, opts.cost);
+        llvm::errs() << "AIG rewriting round " << round << ": " << rewriter.rewritten_count << " cuts rewritten\n";
+        if (rewriter.rewritten_count == 0) {
+            break;
+        }
+        for (auto &[inst, lit] : steps) {
+            if (inst.op == "/z3=>var/") {
+                lit = rewriter.map(lit);
+            }
+        }
+        aig = std::move(rewriter.aig);
+    }
+}
+
+void AigPass::emit() {
+    region.sym_tbl = origin.sym_tbl;
+
+    // Only the cone of the outputs is emitted
+    std::vector<bool> needed(aig.size());
+    for (const auto &[inst, lit] : steps) {
+        if (inst.op == "/z3=>var/") {
+            needed[Aig::nodeOf(lit)] = true;
+        }
+    }
+    for (auto id = aig.size() - 1; id > 0; id--) {
+        const auto &node = aig.node(id);
+        if (needed[id] && (node.kind == Aig::NodeKind::And || node.kind == Aig::NodeKind::Xor)) {
+            needed[Aig::nodeOf(node.a)] = true;
+            needed[Aig::nodeOf(node.b)] = true;
+        }
+    }
+
+    for (auto &&[inst, lit] : steps) {
+        if (inst.op == "/var=>z3/") {
+            if (needed[Aig::nodeOf(aig.mkInput(inst.res.name))]) {
+                region.insts.emplace_back(std::move(inst));
+            }
+            continue;
+        }
+        if (inst.op == "/z3=>var/") {
+            if (lit == Aig::FALSE) {  // the var has been cleared already
+                continue;
+            }
+            emitCone(lit);
+            inst.lhs = ValueInfo{nameOf(lit), 1, VProp::CST, nullptr};
+        }
+        region.insts.emplace_back(std::move(inst));
+    }
+    llvm::errs() << "AIG: " << and_count << " ANDs, " << xor_count << " XORs, " << neg_names.size() << " NOTs\n";
+}
+
+/// Gates are emitted in topological order, i.e. by increasing node id
+void AigPass::emitCone(Aig::Lit lit) {
+    std::vector<std::uint32_t> stack{Aig::nodeOf(lit)}, cone;
+    std::unordered_set<std::uint32_t> visited;
+    while (!stack.empty()) {
+        auto id = stack.back();
+        stack.pop_back();
+        if (id == 0 || names.count(id) || !visited.insert(id).second) {
+            continue;
+        }
+        cone.push_back(id);
+        const auto &node = aig.node(id);
+        if (node.kind == Aig::NodeKind::And || node.kind == Aig::NodeKind::Xor) {
+            stack.push_back(Aig::nodeOf(node.a));
+            stack.push_back(Aig::nodeOf(node.b));
+        }
+    }
+    std::sort(cone.begin(), cone.end());
+
+    for (auto id : cone) {
+        const auto &node = aig.node(id);
+        if (node.kind == Aig::NodeKind::Input) {
+            region.sym_tbl.try_emplace(node.name, ValueInfo{node.name, 1, VProp::UNK, nullptr});
+            names[id] = node.name;
+            continue;
+        }
+        auto a = nameOf(node.a);
+        auto b = nameOf(node.b);
+        auto name = Z3VInfo::getNewName();
+        auto res = ValueInfo{name, 1, VProp::UNK, nullptr};
+        region.sym_tbl[name] = res;
+        region.insts.emplace_back(node.kind == Aig::NodeKind::And ? "&&" : "^", res, region.sym_tbl[a],
+                                  region.sym_tbl[b]);
+        (node.kind == Aig::NodeKind::And ? and_count : xor_count)++;
+        names[id] = name;
+    }
+}
+
+std::string AigPass::nameOf(Aig::Lit lit) {
+    if (lit == Aig::FALSE || lit == Aig::TRUE) {
+        return lit == Aig::TRUE ? "1" : "0";
+    }
+    auto id = Aig::nodeOf(lit);
+    if (!Aig::isNeg(lit)) {
+        return names.at(id);
+    }
+    // Each complemented node is materialized once
+    auto neg_name = neg_names.find(id);
+    if (neg_name != neg_names.end()) {
+        return neg_name->second;
+    }
+    auto name = Z3VInfo::getNewName();
+    auto res = ValueInfo{name, 1, VProp::UNK, nullptr};
+    region.sym_tbl[name] = res;
+    region.insts.emplace_back("!", res, region.sym_tbl[names.at(id)], ValueInfo{});
+    return neg_names[id] = name;
+}
+
+Region AigPass::get() {
+    if (!supported) {
+        return origin;
+    }
+    llvm::errs() << "AIG region:\n";
+    region.dump();
+    return region;
+}
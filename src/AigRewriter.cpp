@@ -0,0 +1,314 @@
+#include "Re-Sc-Masker/AigRewriter.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+/// Truth tables of the cut inputs
+constexpr std::uint16_t INPUT_TT[AigRewriter::CUT_SIZE] = {0xAAAA, 0xCCCC, 0xF0F0, 0xFF00};
+constexpr size_t MAX_CUTS = 8;  // non-trivial cuts kept for each node
+}  // namespace
+
+AigRewriter::AigRewriter(const Aig &src, const std::vector<Aig::Lit> &outputs, const MaskedCost &cost)
+    : src(src), cost(cost), mapped(src.size(), Aig::FALSE), cuts(src.size()), refs(src.size()) {
+    auto is_gate = [&](std::uint32_t id) {
+        auto kind = src.node(id).kind;
+        return kind == Aig::NodeKind::And || kind == Aig::NodeKind::Xor;
+    };
+
+    // Nodes not reaching any output are dropped, and not counted as fanouts
+    std::vector<bool> live(src.size());
+    for (auto lit : outputs) {
+        live[Aig::nodeOf(lit)] = true;
+        refs[Aig::nodeOf(lit)]++;
+    }
+    for (auto id = src.size() - 1; id > 0; id--) {
+        if (live[id] && is_gate(id)) {
+            for (auto fanin : {src.node(id).a, src.node(id).b}) {
+                live[Aig::nodeOf(fanin)] = true;
+                refs[Aig::nodeOf(fanin)]++;
+            }
+        }
+    }
+
+    const auto &lib = library();
+    for (std::uint32_t id = 1; id < src.size(); id++) {
+        const auto &node = src.node(id);
+        cuts[id].push_back(Cut{{id}, 1});
+        if (node.kind == Aig::NodeKind::Input) {  // inputs are kept even if unused
+            mapped[id] = aig.mkInput(node.name);
+            continue;
+        }
+        if (!live[id]) {
+            continue;
+        }
+        enumerateCuts(id);
+
+        // Find the cut whose library implementation saves the most
+        const Cut *best_cut = nullptr;
+        const Impl *best_impl = nullptr;
+        int best_gain = 0;
+        for (size_t i = 1; i < cuts[id].size(); i++) {
+            const auto &cut = cuts[id][i];
+            const auto &impl = lib[truthTable(id, cut)];
+            if (impl.mc == 0xff) {
+                continue;
+            }
+            int gain = int(mffcCost(id, cut)) - int(implCost(impl));
+            if (gain > best_gain) {
+                best_gain = gain;
+                best_cut = &cut;
+                best_impl = &impl;
+            }
+        }
+        if (best_impl) {
+            mapped[id] = buildImpl(*best_impl, *best_cut);
+            rewritten_count++;
+        } else if (node.kind == Aig::NodeKind::And) {
+            mapped[id] = aig.mkAnd(map(node.a), map(node.b));
+        } else {
+            mapped[id] = aig.mkXor(map(node.a), map(node.b));
+        }
+    }
+}
+
+/// Every 4-input function with multiplicative complexity <= 2, indexed by its truth table.
+/// Among implementations with the fewest ANDs, the one with the fewest XOR/NOT gates is kept.
+const std::vector<AigRewriter::Impl> &AigRewriter::library() {
+    static const std::vector<Impl> lib = [] {
+        std::vector<Impl> lib(1 << 16);
+        auto eval = [](std::uint8_t mask, std::uint16_t g1, std::uint16_t g2) {
+            std::uint16_t value = mask & AFFINE_ONE ? 0xFFFF : 0;
+            for (int i = 0; i < CUT_SIZE; i++) {
+                if ((mask >> i) & 1) {
+                    value ^= INPUT_TT[i];
+                }
+            }
+            if (mask & AFFINE_G1) {
+                value ^= g1;
+            }
+            if (mask & AFFINE_G2) {
+                value ^= g2;
+            }
+            return value;
+        };
+        auto xors = [](std::uint8_t mask) {
+            auto signals = std::popcount(std::uint8_t(mask & ~AFFINE_ONE));
+            return signals ? signals - 1 : 0;
+        };
+        auto nots = [](std::uint8_t mask) { return mask & AFFINE_ONE ? 1 : 0; };
+        auto offer = [&](std::uint16_t f, Impl impl) {
+            auto &entry = lib[f];
+            if (impl.mc > entry.mc) {
+                return;
+            }
+            impl.xors = xors(impl.out);
+            impl.nots = nots(impl.out);
+            if (impl.mc >= 1) {
+                impl.xors += xors(impl.a1) + xors(impl.b1);
+                impl.nots += nots(impl.a1) + nots(impl.b1);
+            }
+            if (impl.mc >= 2) {
+                impl.xors += xors(impl.a2) + xors(impl.b2);
+                impl.nots += nots(impl.a2) + nots(impl.b2);
+            }
+            if (impl.mc < entry.mc || impl.xors + impl.nots < entry.xors + entry.nots) {
+                entry = impl;
+            }
+        };
+
+        // Affine functions of the cut inputs, and the ones usable as AND operands (i.e. not constant)
+        std::vector<std::uint8_t> affines, operands;
+        for (std::uint8_t v = 0; v < 32; v++) {
+            std::uint8_t mask = (v & 0xf) | (v & 0x10 ? AFFINE_ONE : 0);
+            affines.push_back(mask);
+            if (v & 0xf) {
+                operands.push_back(mask);
+            }
+        }
+        for (auto l : affines) {
+            offer(eval(l, 0, 0), Impl{0, 0, 0, 0, 0, l});
+        }
+
+        std::unordered_set<std::uint16_t> g1_seen;
+        for (size_t i = 0; i < operands.size(); i++) {
+            for (size_t j = i + 1; j < operands.size(); j++) {
+                auto a1 = operands[i], b1 = operands[j];
+                std::uint16_t g1 = eval(a1, 0, 0) & eval(b1, 0, 0);
+                if (!g1_seen.insert(g1).second) {
+                    continue;
+                }
+                for (auto l : affines) {
+                    offer(g1 ^ eval(l, 0, 0), Impl{1, a1, b1, 0, 0, std::uint8_t(l | AFFINE_G1)});
+                }
+
+                // The second AND may also use the output of the first one
+                std::vector<std::uint8_t> operands2;
+                for (auto op : operands) {
+                    operands2.push_back(op);
+                    operands2.push_back(op | AFFINE_G1);
+                }
+                operands2.push_back(AFFINE_G1);
+                operands2.push_back(AFFINE_G1 | AFFINE_ONE);
+                std::unordered_set<std::uint16_t> g2_seen;
+                for (size_t p = 0; p < operands2.size(); p++) {
+                    for (size_t q = p + 1; q < operands2.size(); q++) {
+                        auto a2 = operands2[p], b2 = operands2[q];
+                        std::uint16_t g2 = eval(a2, g1, 0) & eval(b2, g1, 0);
+                        if (!g2_seen.insert(g2).second) {
+                            continue;
+                        }
+                        for (auto l : affines) {
+                            auto f = g2 ^ eval(l, 0, 0);
+                            offer(f, Impl{2, a1, b1, a2, b2, std::uint8_t(l | AFFINE_G2)});
+                            offer(f ^ g1, Impl{2, a1, b1, a2, b2, std::uint8_t(l | AFFINE_G1 | AFFINE_G2)});
+                        }
+                    }
+                }
+            }
+        }
+        return lib;
+    }();
+    return lib;
+}
+
+unsigned AigRewriter::implCost(const Impl &impl) const {
+    return impl.mc * cost.and_cost + impl.xors * cost.xor_cost + impl.nots * cost.not_cost;
+}
+
+Aig::Lit AigRewriter::buildImpl(const Impl &impl, const Cut &cut) {
+    Aig::Lit inputs[CUT_SIZE];
+    for (int i = 0; i < CUT_SIZE; i++) {  // the function does not depend on missing inputs
+        inputs[i] = i < cut.size ? mapped[cut.leaves[i]] : Aig::FALSE;
+    }
+    auto affine = [&](std::uint8_t mask, Aig::Lit g1, Aig::Lit g2) {
+        Aig::Lit value = mask & AFFINE_ONE ? Aig::TRUE : Aig::FALSE;
+        for (int i = 0; i < CUT_SIZE; i++) {
+            if ((mask >> i) & 1) {
+                value = aig.mkXor(value, inputs[i]);
+            }
+        }
+        if (mask & AFFINE_G1) {
+            value = aig.mkXor(value, g1);
+        }
+        if (mask & AFFINE_G2) {
+            value = aig.mkXor(value, g2);
+        }
+        return value;
+    };
+    Aig::Lit g1 = Aig::FALSE, g2 = Aig::FALSE;
+    if (impl.mc >= 1) {
+        g1 = aig.mkAnd(affine(impl.a1, g1, g2), affine(impl.b1, g1, g2));
+    }
+    if (impl.mc >= 2) {
+        g2 = aig.mkAnd(affine(impl.a2, g1, g2), affine(impl.b2, g1, g2));
+    }
+    return affine(impl.out, g1, g2);
+}
+
+/// Merge the cuts of the fanins, keeping the smallest ones
+void AigRewriter::enumerateCuts(std::uint32_t id) {
+    const auto &node = src.node(id);
+    std::vector<Cut> merged;
+    for (const auto &ca : cuts[Aig::nodeOf(node.a)]) {
+        for (const auto &cb : cuts[Aig::nodeOf(node.b)]) {
+            Cut cut{{}, 0};
+            auto a = ca.leaves.begin(), a_end = a + ca.size;
+            auto b = cb.leaves.begin(), b_end = b + cb.size;
+            bool fits = true;
+            while (a != a_end || b != b_end) {  // leaves are sorted
+                std::uint32_t leaf;
+                if (b == b_end || (a != a_end && *a < *b)) {
+                    leaf = *a++;
+                } else if (a == a_end || *b < *a) {
+                    leaf = *b++;
+                } else {
+                    leaf = *a++;
+                    b++;
+                }
+                if (cut.size == CUT_SIZE) {
+                    fits = false;
+                    break;
+                }
+                cut.leaves[cut.size++] = leaf;
+            }
+            if (fits && std::none_of(merged.begin(), merged.end(), [&](const Cut &c) {
+                    return c.size == cut.size && std::equal(c.leaves.begin(), c.leaves.begin() + c.size,
+                                                            cut.leaves.begin());
+                })) {
+                merged.push_back(cut);
+            }
+        }
+    }
+    std::stable_sort(merged.begin(), merged.end(), [](const Cut &x, const Cut &y) { return x.size < y.size; });
+    if (merged.size() > MAX_CUTS) {
+        merged.resize(MAX_CUTS);
+    }
+    cuts[id].insert(cuts[id].end(), merged.begin(), merged.end());
+}
+
+/// Truth table of a node in terms of the leaves of one of its cuts
+std::uint16_t AigRewriter::truthTable(std::uint32_t root, const Cut &cut) const {
+    std::unordered_map<std::uint32_t, std::uint16_t> tts;
+    for (int i = 0; i < cut.size; i++) {
+        tts[cut.leaves[i]] = INPUT_TT[i];
+    }
+    auto eval = [&](auto &&self, std::uint32_t id) -> std::uint16_t {
+        auto tt = tts.find(id);
+        if (tt != tts.end()) {
+            return tt->second;
+        }
+        const auto &node = src.node(id);
+        auto fanin = [&](Aig::Lit lit) -> std::uint16_t {
+            return self(self, Aig::nodeOf(lit)) ^ (Aig::isNeg(lit) ? 0xFFFF : 0);
+        };
+        std::uint16_t value = node.kind == Aig::NodeKind::And ? fanin(node.a) & fanin(node.b)
+                                                                : fanin(node.a) ^ fanin(node.b);
+        tts[id] = value;
+        return value;
+    };
+    return eval(eval, root);
+}
+
+unsigned AigRewriter::gateCost(std::uint32_t id) const {
+    const auto &node = src.node(id);
+    if (node.kind == Aig::NodeKind::Xor) {
+        return cost.xor_cost;
+    }
+    return cost.and_cost + cost.not_cost * (Aig::isNeg(node.a) + Aig::isNeg(node.b));
+}
+
+/// Cost of the gates which would be freed if the root were computed from the cut directly,
+/// i.e. the maximum fanout-free cone of the root bounded by the cut
+unsigned AigRewriter::mffcCost(std::uint32_t root, const Cut &cut) {
+    auto is_leaf = [&](std::uint32_t id) {
+        return std::find(cut.leaves.begin(), cut.leaves.begin() + cut.size, id) != cut.leaves.begin() + cut.size;
+    };
+    unsigned total = 0;
+    std::vector<std::uint32_t> stack{root}, touched;
+    while (!stack.empty()) {
+        auto id = stack.back();
+        stack.pop_back();
+        total += gateCost(id);
+        for (auto fanin : {src.node(id).a, src.node(id).b}) {
+            auto fanin_id = Aig::nodeOf(fanin);
+            auto kind = src.node(fanin_id).kind;
+            if (is_leaf(fanin_id) || (kind != Aig::NodeKind::And && kind != Aig::NodeKind::Xor)) {
+                continue;
+            }
+            touched.push_back(fanin_id);
+            if (--refs[fanin_id] == 0) {
+                stack.push_back(fanin_id);
+            }
+        }
+    }
+    for (auto id : touched) {
+        refs[id]++;
+    }
+    return total;
+}
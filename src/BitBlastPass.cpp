@@ -1,18 +1,26 @@
 #include "Re-Sc-Masker/BitBlastPass.hpp"
 
+#include <llvm-16/llvm/Support/ErrorHandling.h>
 #include <llvm-16/llvm/Support/raw_ostream.h>
 #include <z3++.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <iterator>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 
+#include "Re-Sc-Masker/BitCircuit.hpp"
+#include "Re-Sc-Masker/LookupTable.hpp"
 #include "Re-Sc-Masker/Preludes.hpp"
 
 std::uint32_t Z3VInfo::max_topo_id = 0;
 
-Z3BitBlastPass::Z3BitBlastPass(const ValueInfo &ret, Region &&origin_region) {
+Z3BitBlastPass::Z3BitBlastPass(const ValueInfo &ret, Region &&origin_region, const BitBlastOptions &opts)
+    : opts(opts), z3ctx(std::make_unique<z3::context>()) {
     auto &st = origin_region.sym_tbl;
     blasted_region.sym_tbl = st;
 
@@ -21,60 +29,244 @@ Z3BitBlastPass::Z3BitBlastPass(const ValueInfo &ret, Region &&origin_region) {
     // (e.g. `a==b`) into an assignment `a=b` or `b=a` (the one with smaller topo sort id should be RHS).
     calc_topo(origin_region);
 
-    // TODO: blast var to bits for fparams.
+    // Find the last instruction touching each var, so that its Z3 objects can be released afterwards
+    calc_last_use(origin_region);
 
     llvm::errs() << "===BitBlastPass: started===\n";
 
-    // Iterate over all vars to register bits in all variables
-    // first: name; second: var (ValueInfo)
-    for (const auto &[var_name, var_info] : st) {
-        z3::expr var_z3bv = z3ctx.bv_const(var_name.c_str(), var_info.width);
+    // NOTE: Z3 bit vectors, bits and mask constraints are created lazily by `touchVar`,
+    // when an instruction uses the var for the first time.
 
-        // register the corresponding Z3 bitvec for the var
-        var2bitvec.emplace(var_info, var_z3bv);
+    // Register for the return value
+    // TODO: we assume the the return value is a var here. In the future this may be an expr
+    this->ret = ret;
+    if (!ret.isNone()) {  // `void` functions only write output params
+        output_vars.push_back(ret);
+    }
 
-        // we have #width bits for each var
-        var2bits[var_info].resize(var_info.width);
+    // TODO: we should also treat pointers in fparam as "output" values
+    // ...
+
+    // Find sums feeding other sums, which are compressed together
+    calc_sum_trees(origin_region);
 
-        // now create each bit in Z3 ("var_name#i")
-        for (auto i = 0; i < var_info.width; i++) {
-            std::string var_bit_name = var_name + "#" + std::to_string(i);
-            z3::expr bit_i = z3ctx.bool_const(var_bit_name.c_str());
-            auto mask = z3ctx.bv_val((uint64_t(1) << i), var_info.width);
-            var2bits[var_info][i] = std::optional<z3::expr>(bit_i);
-            var2masks[var_info].emplace_back(bit_i == ((var_z3bv & mask) == mask));
+    // Bit-blast each instructions
+    for (size_t i = 0; i < origin_region.insts.size(); i++) {
+        varbit2id.clear();
+        id2varbit.clear();
+        blast(std::move(origin_region.insts[i]), i);
+        releaseDeadVars(i);
+        // No Z3 object is alive between instructions except the cached ones
+        if (opts.ctx_recycle_period && goals_in_ctx >= opts.ctx_recycle_period) {
+            recycleContext();
         }
+    }
+    // Outputs are assembled from bits
+    for (const auto &vinfo : output_vars) {
+        materializeWord(vinfo.name, true);
+    }
+    llvm::errs() << "===BitBlastPass: " << goal_count << " goals, " << fallback_count << " direct fallbacks===\n";
+    if (opts.arith_masking) {
+        llvm::errs() << "===BitBlastPass: " << b2a_count << " Boolean to arithmetic, " << a2b_count
+                     << " arithmetic to Boolean conversions===\n";
+    }
+    if (opts.word_masking) {
+        llvm::errs() << "===BitBlastPass: " << word_inst_count << " instructions masked on words, " << w2b_count
+                     << " words converted to bits===\n";
+    }
+}
 
-        if (var_info.prop == VProp::PUB || var_info.prop == VProp::SECRET) {  // Only for input variables
-            llvm::errs() << "inserting input bits for " << var_name << "\n";
-            splitVar2Bits(var_info);
+/// Record the index of the last instruction using each var.
+/// Vars never used by any instruction will never be registered in Z3.
+void Z3BitBlastPass::calc_last_use(const Region &r) {
+    for (size_t i = 0; i < r.insts.size(); i++) {
+        const auto &inst = r.insts[i];
+        last_use[inst.res] = i;
+        last_use[inst.lhs] = i;
+        if (!inst.isUnaryOp()) {
+            last_use[inst.rhs] = i;
         }
     }
+    for (const auto &[var, i] : last_use) {
+        dying_at[i].push_back(var);
+    }
+}
 
-    // Register for the return value
-    // TODO: we assume the the return value is a var here. In the future this may be an expr
-    this->ret = ret;
-    const std::string &var_name = ret.name;
-    z3::expr z3var = z3ctx.bv_const(var_name.c_str(), ret.width);
-    var2bits[ret].resize(ret.width);
+bool Z3BitBlastPass::isArithMasked(const Instruction &inst) const {
+    if (!opts.arith_masking || getBitWidth(inst.res.width) < 2 || inst.isUnaryOp()) {
+        return false;
+    }
+    auto is_public = [](const ValueInfo &var) { return var.prop == VProp::CST || var.prop == VProp::PUB; };
+    if (is_public(inst.lhs) && is_public(inst.rhs)) {
+        return false;
+    }
+    return inst.op == "+" || inst.op == "-" ||
+           (inst.op == "*" && (inst.lhs.prop == VProp::CST || inst.rhs.prop == VProp::CST));
+}
+
+/// Bits are moved around for free by `wire`, so copies, shifts and masks by constants are only done on words
+/// if their operand is on words already. Other operands must be inputs, public or on words as well.
+bool Z3BitBlastPass::isWordMasked(const Instruction &inst) const {
+    const auto width = getBitWidth(inst.res.width);
+    if (!opts.word_masking || width < 2 || width > 64) {
+        return false;
+    }
+    // Narrower operands on words are zero-extended, see `booleanSharesOf`
+    auto on_words = [&](const ValueInfo &var) {
+        return boolean_vars.count(var.name) && (getBitWidth(var.width) >= width || !isSigned(var.width));
+    };
+    auto shareable = [&](const ValueInfo &var) {
+        auto is_input = !written_vars.count(var.name) && getBitWidth(var.width) == width;
+        return var.prop == VProp::CST || var.prop == VProp::PUB || on_words(var) ||
+               (is_input && var.prop == VProp::SECRET);
+    };
+    const auto &op = inst.op;
+    if (op == "=") {
+        return on_words(inst.lhs);
+    }
+    if (op == "~") {
+        return shareable(inst.lhs) && inst.lhs.prop != VProp::CST && inst.lhs.prop != VProp::PUB;
+    }
+    if (op == "<<" || op == ">>") {
+        return inst.rhs.prop == VProp::CST && std::stoull(inst.rhs.name, nullptr, 0) < uint64_t(width) &&
+               on_words(inst.lhs) && !(op == ">>" && isSigned(inst.lhs.width));
+    }
+    if (op != "^" && op != "&" && op != "|") {
+        return false;
+    }
+    if (inst.lhs.prop == VProp::CST || inst.rhs.prop == VProp::CST) {
+        return on_words(inst.lhs) || on_words(inst.rhs);
+    }
+    auto is_public = [](const ValueInfo &var) { return var.prop == VProp::PUB; };
+    return !(is_public(inst.lhs) && is_public(inst.rhs)) && shareable(inst.lhs) && shareable(inst.rhs);
+}
+
+bool Z3BitBlastPass::isBlastedDirectly(const std::string &op) const {
+    if (op == "+" || op == "-") {
+        return opts.direct_only || opts.arith.adder_arch != AdderArch::Z3;
+    }
+    if (op == "*") {
+        return opts.direct_only || opts.arith.multiplier_arch != MultiplierArch::Z3;
+    }
+    return false;
+}
+
+/// Find the sums, differences and products used only once, as an operand of a sum (or the minuend of a difference)
+/// of the same width. Their bits are left in carry-save form, so that a whole tree of additions (e.g. a
+/// multiply-accumulate) is compressed by full adders at once and needs a single carry-propagate adder.
+void Z3BitBlastPass::calc_sum_trees(const Region &r) {
+    if (!opts.carry_save_sums) {
+        return;
+    }
+    auto reads = [](const Instruction &inst, const std::string &name) {
+        return inst.op != "//" && (inst.lhs.name == name || (!inst.isUnaryOp() && inst.rhs.name == name));
+    };
+    auto writes = [](const Instruction &inst, const std::string &name) {
+        return inst.op != "//" && inst.res.name == name;
+    };
+    for (size_t i = 0; i < r.insts.size(); i++) {
+        const auto &def = r.insts[i];
+        const auto &name = def.res.name;
+        if (!isBlastedDirectly(def.op) || def.res.prop != VProp::UNK || isArithMasked(def)) {
+            continue;
+        }
+        // The next instruction touching the var must use it...
+        auto j = i + 1;
+        while (j < r.insts.size() && !reads(r.insts[j], name) && !writes(r.insts[j], name)) {
+            j++;
+        }
+        if (j == r.insts.size() || !reads(r.insts[j], name)) {
+            continue;
+        }
+        const auto &use = r.insts[j];
+        auto summed = (use.op == "+" && (use.lhs.name == name) != (use.rhs.name == name)) ||
+                      (use.op == "-" && use.lhs.name == name && use.rhs.name != name);
+        if (!summed || !isBlastedDirectly(use.op) || isArithMasked(use) ||
+            getBitWidth(use.res.width) != getBitWidth(def.res.width)) {
+            continue;
+        }
+        // ...and the value must be dead afterwards
+        auto dead = writes(use, name);
+        for (auto k = j + 1; !dead; k++) {
+            if (k == r.insts.size()) {  // the return value is read at the end
+                dead = name != ret.name;
+                break;
+            }
+            if (writes(r.insts[k], name)) {
+                dead = !reads(r.insts[k], name);
+                break;
+            }
+            if (reads(r.insts[k], name)) {
+                break;
+            }
+        }
+        if (dead) {
+            carry_save_defs.insert(i);
+        }
+    }
+    llvm::errs() << carry_save_defs.size() << " instructions kept in carry-save form\n";
+}
 
-    for (auto i = 0; i < ret.width; i++) {
+/// Register the Z3 bit vector, bits and mask constraints of a var on its first use
+void Z3BitBlastPass::touchVar(const ValueInfo &var) {
+    if (var.isNone() || var.prop == VProp::CST || var2bitvec.count(var)) {
+        return;
+    }
+    const auto &var_name = var.name;
+    const auto width = getBitWidth(var.width);
+    z3::expr var_z3bv = z3ctx->bv_const(var_name.c_str(), width);
+
+    // register the corresponding Z3 bitvec for the var
+    var2bitvec.emplace(var, var_z3bv);
+
+    // we have #width bits for each var
+    var2bits[var].resize(width);
+
+    // now create each bit in Z3 ("var_name#i")
+    for (auto i = 0; i < width; i++) {
         std::string var_bit_name = var_name + "#" + std::to_string(i);
-        z3::expr bit_i = z3ctx.bool_const(var_bit_name.c_str());
-        var2bits[ret][i] = std::optional<z3::expr>(bit_i);
+        z3::expr bit_i = z3ctx->bool_const(var_bit_name.c_str());
+        auto mask = z3ctx->bv_val((uint64_t(1) << i), width);
+        var2bits[var][i] = std::optional<z3::expr>(bit_i);
+        var2masks[var].emplace_back(bit_i == ((var_z3bv & mask) == mask));
     }
 
-    // TODO: we should also treat pointers in fparam as "output" values
-    // ...
+    if (var.prop == VProp::OUTPUT && std::none_of(output_vars.begin(), output_vars.end(),
+                                                  [&](const ValueInfo &o) { return o.name == var_name; })) {
+        output_vars.push_back(var);
+    }
 
-    // Bit-blast each instructions
-    for (auto &&inst : origin_region.insts) {
-        varbit2id.clear();
-        id2varbit.clear();
-        blast(std::move(inst));
+    if (!var_splited.count(var) && (var.prop == VProp::PUB || var.prop == VProp::SECRET)) {  // Only for inputs
+        llvm::errs() << "inserting input bits for " << var_name << "\n";
+        splitVar2Bits(var);
     }
 }
 
+/// Drop Z3 objects of vars whose last use is the `i`-th instruction
+void Z3BitBlastPass::releaseDeadVars(size_t i) {
+    auto dying = dying_at.find(i);
+    if (dying == dying_at.end()) {
+        return;
+    }
+    for (const auto &var : dying->second) {
+        var2bitvec.erase(var);
+        var2masks.erase(var);
+        var2bits.erase(var);
+    }
+    dying_at.erase(dying);
+}
+
+/// Every Z3 object must be dropped before its context; vars are registered again by `touchVar` on their next use.
+/// Bits keep the same names across contexts, and nothing else refers to Z3 internals after a goal is extracted.
+void Z3BitBlastPass::recycleContext() {
+    llvm::errs() << "Recycling Z3 context after " << goal_count << " goals\n";
+    var2bitvec.clear();
+    var2bits.clear();
+    var2masks.clear();
+    z3ctx = std::make_unique<z3::context>();
+    goals_in_ctx = 0;
+}
+
 /// Calculate topo sort order id (tid) for each var.
 /// All vars have tid=0 initially;
 /// For each `C = A ^ B`, tid_C = 1 + max(tid_A, tid_B)
@@ -95,79 +287,319 @@ void Z3BitBlastPass::calc_topo(const Region &r) {
 }
 
 /// Bit-Blast a single instruction
-void Z3BitBlastPass::blast(Instruction &&inst) {
+void Z3BitBlastPass::blast(Instruction &&inst, size_t inst_idx) {
     blasted_region.insts.emplace_back("//", inst.toString());
     inst.dump();
 
-    z3::goal goal(z3ctx);
-    for (const auto &mask : var2masks[inst.lhs]) {
-        goal.add(mask);
+    touchVar(inst.res);
+    touchVar(inst.lhs);
+    if (!inst.isUnaryOp()) {
+        touchVar(inst.rhs);
     }
-    for (const auto &mask : var2masks[inst.res]) {
-        goal.add(mask);
+
+    if (isArithMasked(inst)) {
+        blastArith(inst);
+        return;
     }
+    if (isWordMasked(inst)) {
+        blastWord(inst);
+        return;
+    }
+    // Other instructions read the bits of their operands
+    materializeWord(inst.lhs.name);
     if (!inst.isUnaryOp()) {
-        for (const auto &mask : var2masks[inst.rhs]) {
-            goal.add(mask);
+        materializeWord(inst.rhs.name);
+    }
+    written_vars.insert(inst.res.name);
+    arith_vars.erase(inst.res.name);
+    boolean_vars.erase(inst.res.name);
+    word_pending.erase(inst.res.name);
+
+    if (inst.op == "[]") {
+        redefine(inst.res, inst.res == inst.rhs);
+        blastLookup(inst);
+    } else if (!wire(inst)) {
+        // The old value of the result is still needed if it is also an operand
+        redefine(inst.res, inst.res == inst.lhs || inst.res == inst.rhs);
+        // Arithmetic is built from the selected circuits, unless it is left to Z3
+        if (opts.direct_only || isBlastedDirectly(inst.op)) {
+            directBlast(inst, carry_save_defs.count(inst_idx));
+        } else if (!blastWithZ3(inst)) {
+            fallback_count++;
+            directBlast(inst, carry_save_defs.count(inst_idx));
+        }
+    }
+    if (var_splited.count(inst.res) && inst.res.prop == VProp::PUB ||
+        inst.res.prop == VProp::SECRET) {  // first def only
+        splitVar2Bits(inst.res);
+    }
+    // bits -> result
+}
+
+/// Encode the instruction as a Z3 goal, then extract bit-level instructions from the simplified goal
+bool Z3BitBlastPass::blastWithZ3(const Instruction &inst) {
+    // `x = x op y` would be an equation on a single `x`.
+    // Operands of different widths are blasted directly, except for shifts by a var which only Z3 encodes
+    auto is_shift = inst.op == "<<" || inst.op == ">>";
+    auto encodable = [&](const ValueInfo &var) {
+        return var.isNone() || var.prop == VProp::CST ||
+               ((is_shift || getBitWidth(var.width) == getBitWidth(inst.res.width)) && var != inst.res);
+    };
+    if (!encodable(inst.lhs) || !encodable(inst.rhs)) {
+        return false;
+    }
+    // Shifted operands are extended to the widest one, and the result is truncated
+    auto width = getBitWidth(inst.res.width);
+    for (const auto &var : {inst.lhs, inst.rhs}) {
+        if (!var.isNone() && var.prop != VProp::CST) {
+            width = std::max(width, getBitWidth(var.width));
         }
     }
+    auto fit = [&](const z3::expr &value) {
+        auto res_width = getBitWidth(inst.res.width);
+        return res_width < width ? value.extract(res_width - 1, 0) : value;
+    };
+
+    z3::goal goal(*z3ctx);
+    // Operand bits wired to constants are folded into the operand instead of being constrained by masks
+    auto constBits = [&](const ValueInfo &var) {
+        uint64_t cmask = 0, cval = 0;
+        for (size_t i = 0; i < var2bits[var].size() && i < 64; i++) {
+            auto alias = bit_alias.find(var.name + "#" + std::to_string(i));
+            if (alias != bit_alias.end() && BitCircuit::isConst(alias->second)) {
+                cmask |= uint64_t(1) << i;
+                cval |= uint64_t(alias->second == "1") << i;
+            }
+        }
+        return std::make_pair(cmask, cval);
+    };
+    auto addMasks = [&](const ValueInfo &var) {
+        if (var.isNone() || var.prop == VProp::CST) {
+            return;
+        }
+        auto [cmask, cval] = constBits(var);
+        const auto &masks = var2masks[var];
+        for (size_t i = 0; i < masks.size(); i++) {
+            if (i >= 64 || !((cmask >> i) & 1)) {
+                goal.add(masks[i]);
+            }
+        }
+    };
+    auto operand = [&](const ValueInfo &var) {
+        if (var.prop == VProp::CST) {  // literals are truncated or zero-extended to the result
+            uint64_t value = std::stoull(var.name, nullptr, 0);
+            return z3ctx->bv_val(value, width);
+        }
+        auto expr = var2bitvec[var].value();
+        auto [cmask, cval] = constBits(var);
+        auto var_width = getBitWidth(var.width);
+        if (cmask) {
+            expr = (expr & z3ctx->bv_val(~cmask, var_width)) | z3ctx->bv_val(cval, var_width);
+        }
+        if (var_width < width) {
+            expr = isSigned(var.width) ? z3::sext(expr, width - var_width) : z3::zext(expr, width - var_width);
+        }
+        return expr;
+    };
+
+    addMasks(inst.lhs);
+    addMasks(inst.res);
+    addMasks(inst.rhs);
     if (inst.op == "=") {
         // Assign operation: a = b
         auto target_expr = var2bitvec[inst.res].value();
-        auto left_expr = var2bitvec[inst.lhs].value();
+        auto left_expr = operand(inst.lhs);
 
-        goal.add(target_expr == left_expr);
+        goal.add(target_expr == fit(left_expr));
     } else if (inst.op == "^") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr ^ right_expr));
+        goal.add(target_expr == fit(left_expr ^ right_expr));
     } else if (inst.op == "|" || inst.op == "or") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr | right_expr));
+        goal.add(target_expr == fit(left_expr | right_expr));
     } else if (inst.op == "&" || inst.op == "and") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr & right_expr));
+        goal.add(target_expr == fit(left_expr & right_expr));
     } else if (inst.op == "~" || inst.op == "not") {
-        auto left_expr = var2bitvec[inst.lhs].value();
+        auto left_expr = operand(inst.lhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (~left_expr));
+        goal.add(target_expr == fit(~left_expr));
     } else if (inst.op == "*") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr * right_expr));
+        goal.add(target_expr == fit(left_expr * right_expr));
     } else if (inst.op == "+") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr + right_expr));
+        goal.add(target_expr == fit(left_expr + right_expr));
     } else if (inst.op == "-") {
-        auto left_expr = var2bitvec[inst.lhs].value();
-        auto right_expr = var2bitvec[inst.rhs].value();
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
         auto target_expr = var2bitvec[inst.res].value();
-        goal.add(target_expr == (left_expr - right_expr));
-    } else if (inst.op == "!") {
-        llvm::errs() << "Not implemented: " << inst.op << "\n";
+        goal.add(target_expr == fit(left_expr - right_expr));
+    } else if (inst.op == "<<") {
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
+        auto target_expr = var2bitvec[inst.res].value();
+        goal.add(target_expr == fit(z3::shl(left_expr, right_expr)));
+    } else if (inst.op == ">>") {
+        auto left_expr = operand(inst.lhs);
+        auto right_expr = operand(inst.rhs);
+        auto target_expr = var2bitvec[inst.res].value();
+        goal.add(target_expr == fit(isSigned(inst.lhs.width) ? z3::ashr(left_expr, right_expr)
+                                                              : z3::lshr(left_expr, right_expr)));
     } else {
-        llvm::errs() << "Not implemented: " << inst.op << "\n";
+        llvm::errs() << "Not implemented in Z3: " << inst.op << "\n";
+        return false;
     }
 
-    solve_and_extract(goal);
-    if (var_splited.count(inst.res) && inst.res.prop == VProp::PUB ||
-        inst.res.prop == VProp::SECRET) {  // first def only
-        splitVar2Bits(inst.res);
+    goal_count++;
+    goals_in_ctx++;
+    return solve_and_extract(goal);
+}
+
+/// Bits of a var referred by other instructions, zero/sign-extended or truncated to `width`.
+/// Constants are split into constant bits.
+BitCircuit::Bits Z3BitBlastPass::bitsOf(const ValueInfo &var, int width) {
+    const auto var_width = getBitWidth(var.width);
+    BitCircuit::Bits bits;
+    bits.reserve(std::max(width, var_width));
+    for (auto i = 0; i < var_width; i++) {
+        if (var.prop == VProp::CST) {
+            auto value = std::stoull(var.name, nullptr, 0);
+            bits.emplace_back(i < 64 && ((value >> i) & 1) ? "1" : "0");
+        } else {
+            bits.emplace_back(resolveBit(var.name + "#" + std::to_string(i), var.prop));
+        }
     }
-    // bits -> result
+    auto fill = isSigned(var.width) && !bits.empty() ? bits.back() : BitCircuit::Bit{"0"};
+    bits.resize(width, fill);
+    return bits;
+}
+
+/// Follow the alias of a bit, registering the bit if it is a real one
+BitCircuit::Bit Z3BitBlastPass::resolveBit(const std::string &bit, VProp prop) {
+    auto alias = bit_alias.find(bit);
+    if (alias != bit_alias.end()) {
+        return alias->second;
+    }
+    if (!blasted_region.sym_tbl.count(bit)) {
+        blasted_region.sym_tbl[bit] = ValueInfo{bit, 1, prop, nullptr};
+    }
+    return bit;
+}
+
+/// Shifts and masks by constants, extensions and truncations only move bits around.
+/// Result bits become aliases of operand bits (or constants) and no instruction is emitted.
+bool Z3BitBlastPass::wire(const Instruction &inst) {
+    const auto &op = inst.op;
+    const auto width = getBitWidth(inst.res.width);
+    auto is_cst = [](const ValueInfo &v) { return v.prop == VProp::CST; };
+
+    BitCircuit::Bits bits;
+    if (op == "=") {
+        bits = bitsOf(inst.lhs, width);
+    } else if ((op == "<<" || op == ">>") && is_cst(inst.rhs)) {
+        // High bits of a wider operand are shifted into a narrower result
+        auto lhs = bitsOf(inst.lhs, std::max(width, getBitWidth(inst.lhs.width)));
+        auto amount = std::stoull(inst.rhs.name, nullptr, 0);
+        // Arithmetic shift for signed values
+        auto fill = op == ">>" && isSigned(inst.lhs.width) && !lhs.empty() ? lhs.back() : BitCircuit::Bit{"0"};
+        for (size_t i = 0; i < size_t(width); i++) {
+            if (op == "<<") {
+                bits.emplace_back(i >= amount ? lhs[i - amount] : "0");
+            } else {
+                bits.emplace_back(amount < lhs.size() - i ? lhs[i + amount] : fill);
+            }
+        }
+    } else if ((op == "&" || op == "|") && (is_cst(inst.lhs) || is_cst(inst.rhs))) {
+        auto cst = bitsOf(is_cst(inst.lhs) ? inst.lhs : inst.rhs, width);
+        auto var = bitsOf(is_cst(inst.lhs) ? inst.rhs : inst.lhs, width);
+        for (size_t i = 0; i < var.size(); i++) {
+            if (op == "&") {
+                bits.emplace_back(cst[i] == "1" ? var[i] : "0");
+            } else {
+                bits.emplace_back(cst[i] == "1" ? "1" : var[i]);
+            }
+        }
+    } else {
+        return false;
+    }
+
+    blasted_region.insts.emplace_back("//", "wired: " + inst.toString());
+    redefine(inst.res, false);
+    bits = detachSelfBits(inst.res, std::move(bits));
+    for (size_t i = 0; i < bits.size(); i++) {
+        auto var_bit_name = inst.res.name + "#" + std::to_string(i);
+        if (bits[i] == var_bit_name) {  // unchanged
+            continue;
+        }
+        bit_alias[var_bit_name] = bits[i];
+        if (!BitCircuit::isConst(bits[i])) {
+            alias_users[bits[i].substr(0, bits[i].find('#'))].push_back(var_bit_name);
+        }
+    }
+    return true;
+}
+
+/// Called before a var is defined again: bits aliased to its current bits are materialized,
+/// and its own aliases are dropped, or materialized as well if `keep_value` is set
+void Z3BitBlastPass::redefine(const ValueInfo &var, bool keep_value) {
+    BitCircuit circuit(blasted_region);
+    const auto prefix = var.name + "#";
+    auto users = alias_users.find(var.name);
+    if (users != alias_users.end()) {
+        for (const auto &bit : users->second) {
+            auto alias = bit_alias.find(bit);
+            // The user may have been redefined since then
+            if (alias != bit_alias.end() && alias->second.starts_with(prefix)) {
+                auto user_var = bit.substr(0, bit.find('#'));
+                circuit.assign(bit, alias->second, blasted_region.sym_tbl[user_var].prop);
+                bit_alias.erase(alias);
+            }
+        }
+        alias_users.erase(users);
+    }
+    for (auto i = 0; i < getBitWidth(var.width); i++) {
+        auto alias = bit_alias.find(prefix + std::to_string(i));
+        if (alias == bit_alias.end()) {
+            continue;
+        }
+        if (keep_value) {
+            circuit.assign(alias->first, alias->second, var.prop);
+        }
+        bit_alias.erase(alias);
+    }
+}
+
+/// Copy the bits of `var` that move to another position,
+/// otherwise they would be overwritten before being read
+BitCircuit::Bits Z3BitBlastPass::detachSelfBits(const ValueInfo &var, BitCircuit::Bits &&bits) {
+    BitCircuit circuit(blasted_region);
+    const auto prefix = var.name + "#";
+    std::unordered_map<BitCircuit::Bit, BitCircuit::Bit> copies;
+    for (size_t i = 0; i < bits.size(); i++) {
+        if (bits[i].starts_with(prefix) && bits[i] != prefix + std::to_string(i)) {
+            auto copy = copies.find(bits[i]);
+            if (copy == copies.end()) {
+                copy = copies.emplace(bits[i], circuit.mkCopy(bits[i])).first;
+            }
+            bits[i] = copy->second;
+        }
+    }
+    return bits;
 }
 
 void Z3BitBlastPass::splitVar2Bits(const ValueInfo &var) {
-    auto z3bits = var2bits[var];
-    for (unsigned i = 0; i < z3bits.size(); ++i) {
+    for (auto i = 0; i < getBitWidth(var.width); ++i) {
         auto var_bit_name = var.name + "#" + std::to_string(i);
         blasted_region.insts.emplace_back(Instruction{"/var=>z3/", ValueInfo{var_bit_name, 1, VProp::CST, nullptr}, var,
                                                       ValueInfo{std::to_string(i), 1, VProp::CST, nullptr}});
@@ -175,7 +607,412 @@ void Z3BitBlastPass::splitVar2Bits(const ValueInfo &var) {
     var_splited.insert(var);
 }
 
+/// The circuit is built aside to get its masked cost, then compared with the cost of recomputing the table as
+/// emitted by `recomputeLookup`, both under `ArithOptions::masked_cost`.
+void Z3BitBlastPass::blastLookup(const Instruction &inst) {
+    blasted_region.insts.emplace_back("//", "lookup: " + inst.toString());
+    auto &table = LookupTable::all().at(inst.lhs.name);
+    const auto width = size_t(getBitWidth(inst.res.width));
+    // Index bits beyond the table are ignored, entries beyond the table read as 0
+    const auto index_width = std::min<size_t>(table.indexWidth(), getBitWidth(inst.rhs.width));
+    auto index = bitsOf(inst.rhs, int(index_width));
+    std::vector<uint64_t> entries(size_t{1} << index_width, 0);
+    for (size_t x = 0; x < entries.size() && x < table.entries.size(); x++) {
+        entries[x] = width < 64 ? table.entries[x] & ((uint64_t{1} << width) - 1) : table.entries[x];
+    }
+
+    Region circuit_region;
+    BitCircuit circuit(circuit_region, directArith());
+    auto bits = circuit.lookup(entries, index, width);
+    auto circuit_cost = circuit.maskedCost(circuit_region);
+    const auto &cost = opts.arith.masked_cost;
+    const auto mask_bits = index_width + width;  // one fresh random bit per index bit and per result bit
+    constexpr size_t random_cost = 1;            // drawing a fresh random bit
+    constexpr size_t move_cost = 1;              // packing a bit into a word, or extracting it back
+    constexpr size_t word_cost = 1;              // declaring one of the words of `recomputeLookup`
+    constexpr size_t words = 4;                  // the masks, the masked table, the masked index, the result
+    // Each mask bit is packed once, then either xored into the index and packed, or extracted from the result and
+    // xored out of it
+    auto recompute_cost = opts.lut_recompute_cost_per_entry * entries.size() +
+                          (random_cost + cost.xor_cost + 2 * move_cost) * mask_bits + word_cost * words;
+
+    auto masking = opts.lut_masking;
+    if (masking == LutMasking::Auto) {
+        masking = recompute_cost < circuit_cost ? LutMasking::Recompute : LutMasking::Circuit;
+    }
+    if (std::all_of(index.begin(), index.end(), BitCircuit::isConst)) {  // folded into constants
+        masking = LutMasking::Circuit;
+    }
+    auto report = inst.toString() + " " +
+                  (masking == LutMasking::Circuit ? "bitsliced circuit, " + std::to_string(circuit.and_count) + " ANDs"
+                                                  : std::string("table recomputation")) +
+                  " (masked cost: circuit " + std::to_string(circuit_cost) + ", recomputation " +
+                  std::to_string(recompute_cost) + ")";
+    llvm::errs() << "Lookup: " << report << "\n";
+    blasted_region.insts.emplace_back("//", "lookup masked by " + report);
+    table.reports.emplace_back(std::move(report));
+
+    if (masking == LutMasking::Circuit) {
+        for (auto &&circuit_inst : circuit_region.insts) {
+            blasted_region.insts.emplace_back(std::move(circuit_inst));
+        }
+        blasted_region.sym_tbl.merge(circuit_region.sym_tbl);
+    } else {
+        bits = recomputeLookup(inst.lhs.name, index, width);
+    }
+
+    BitCircuit assigner(blasted_region);
+    bits = detachSelfBits(inst.res, std::move(bits));
+    for (size_t i = 0; i < bits.size(); i++) {
+        auto var_bit_name = inst.res.name + "#" + std::to_string(i);
+        if (bits[i] != var_bit_name) {
+            assigner.assign(var_bit_name, bits[i], inst.res.prop);
+        }
+    }
+}
+
+/// The table is recomputed under fresh masks `min` and `mout`: masked[a] = table[a ^ min] ^ mout.
+/// The index is masked by `min` before the lookup, and the result is unmasked by `mout` afterwards.
+/// Both are XOR gates, masked again by the masker like any other gate.
+BitCircuit::Bits Z3BitBlastPass::recomputeLookup(const std::string &table_name, const BitCircuit::Bits &index,
+                                                 size_t width) {
+    BitCircuit circuit(blasted_region);
+    const auto index_width = index.size();
+    BitCircuit::Bits masks;  // min, then mout
+    for (size_t i = 0; i < index_width + width; i++) {
+        auto r = ValueInfo::getNewRand();
+        blasted_region.sym_tbl[r.name] = r;
+        masks.emplace_back(r.name);
+    }
+    auto packed_masks = packBits(masks);
+
+    auto masked_name = table_name + "_m" + std::to_string(LookupTable::all().at(table_name).reports.size());
+    ValueInfo masked{masked_name, Width(width), VProp::UNK, nullptr};
+    blasted_region.sym_tbl[masked_name] = masked;
+    blasted_region.insts.emplace_back("/lut-recompute/", masked,
+                                      ValueInfo{table_name, Width(width), VProp::CST, nullptr}, packed_masks);
+
+    BitCircuit::Bits masked_index;
+    for (size_t i = 0; i < index_width; i++) {
+        masked_index.emplace_back(circuit.mkXor(index[i], masks[i]));
+    }
+    auto looked_up_name = Z3VInfo::getNewName();
+    ValueInfo looked_up{looked_up_name, Width(width), VProp::UNK, nullptr};
+    blasted_region.sym_tbl[looked_up_name] = looked_up;
+    blasted_region.insts.emplace_back("/lut/", looked_up, masked, packBits(masked_index));
+
+    BitCircuit::Bits res;
+    for (size_t j = 0; j < width; j++) {
+        auto bit = Z3VInfo::getNewName();
+        blasted_region.sym_tbl[bit] = ValueInfo{bit, 1, VProp::UNK, nullptr};
+        blasted_region.insts.emplace_back("/var=>z3/", ValueInfo{bit, 1, VProp::CST, nullptr}, looked_up,
+                                          ValueInfo{std::to_string(j), 1, VProp::CST, nullptr});
+        res.emplace_back(circuit.mkXor(bit, masks[index_width + j]));
+    }
+    return res;
+}
+
+ValueInfo Z3BitBlastPass::packBits(const BitCircuit::Bits &bits) {
+    auto name = Z3VInfo::getNewName();
+    ValueInfo word{name, Width(bits.size()), VProp::UNK, nullptr};
+    blasted_region.sym_tbl[name] = word;
+    blasted_region.insts.emplace_back("/clear/", word, ValueInfo{"0", 1, VProp::CST, nullptr}, ValueInfo{});
+    for (size_t i = 0; i < bits.size(); i++) {
+        if (bits[i] == "0") {
+            continue;
+        }
+        blasted_region.insts.emplace_back("/z3=>var/", word, ValueInfo{bits[i], 1, VProp::CST, nullptr},
+                                          ValueInfo{std::to_string(i), 1, VProp::CST, nullptr});
+    }
+    return word;
+}
+
+BitCircuit::Bits Z3BitBlastPass::unpackWord(const ValueInfo &word, int width) {
+    if (word.prop == VProp::CST) {
+        return bitsOf(word, width);
+    }
+    BitCircuit::Bits bits;
+    for (auto i = 0; i < width; i++) {
+        auto bit = Z3VInfo::getNewName();
+        blasted_region.sym_tbl[bit] = ValueInfo{bit, 1, VProp::UNK, nullptr};
+        blasted_region.insts.emplace_back("/var=>z3/", ValueInfo{bit, 1, VProp::CST, nullptr}, word,
+                                          ValueInfo{std::to_string(i), 1, VProp::CST, nullptr});
+        bits.emplace_back(bit);
+    }
+    return bits;
+}
+
+/// A constant word of `width` low bits set, e.g. to clear the meaningless high bits of a word
+static ValueInfo lowBits(int width) {
+    return ValueInfo{width < 64 ? std::to_string((uint64_t{1} << width) - 1) : "0xffffffffffffffff", Width(width),
+                     VProp::CST, nullptr};
+}
+
+/// A value x is held as arithmetic shares (A, R), x == A + R mod 2^n, R being computed from fresh random words.
+/// Sums, differences and products by constants are computed share-wise on whole words, drawing no random bits
+/// unless both operands are masked by a common random word, in which case one of them is refreshed first.
+/// Bits are only computed once a bitwise operation or the output needs them, see `materializeWord`.
+void Z3BitBlastPass::blastArith(const Instruction &inst) {
+    blasted_region.insts.emplace_back("//", "arithmetic masking: " + inst.toString());
+    const auto width = getBitWidth(inst.res.width);
+    WordShares res;
+    if (inst.op == "*") {
+        const auto &factor = inst.lhs.prop == VProp::CST ? inst.lhs : inst.rhs;
+        auto x = arithSharesOf(inst.lhs.prop == VProp::CST ? inst.rhs : inst.lhs, width);
+        res = WordShares{emitWordOp("/mul/", x.masked, factor, width), emitWordOp("/mul/", x.mask, factor, width),
+                         std::move(x.randoms)};
+    } else {
+        auto x = arithSharesOf(inst.lhs, width);
+        auto y = arithSharesOf(inst.rhs, width);
+        std::vector<std::string> common;
+        std::set_intersection(x.randoms.begin(), x.randoms.end(), y.randoms.begin(), y.randoms.end(),
+                              std::back_inserter(common));
+        if (!common.empty()) {  // (A - S, R + S)
+            auto fresh = randomWord(width);
+            y.masked = emitWordOp("/sub/", y.masked, fresh, width);
+            y.mask = emitWordOp("/add/", y.mask, fresh, width);
+            y.randoms.insert(std::upper_bound(y.randoms.begin(), y.randoms.end(), fresh.name), fresh.name);
+        }
+        const auto *op = inst.op == "+" ? "/add/" : "/sub/";
+        res.masked = emitWordOp(op, x.masked, y.masked, width);
+        res.mask = emitWordOp(op, x.mask, y.mask, width);
+        std::set_union(x.randoms.begin(), x.randoms.end(), y.randoms.begin(), y.randoms.end(),
+                       std::back_inserter(res.randoms));
+    }
+    redefine(inst.res, false);
+    written_vars.insert(inst.res.name);
+    boolean_vars.erase(inst.res.name);
+    arith_vars[inst.res.name] = std::move(res);
+    word_pending[inst.res.name] = inst.res;
+}
+
+/// Boolean-to-arithmetic conversion by Goubin's method: x is first masked by a random word r (see `booleanSharesOf`),
+/// then A == (x' ^ r) - r is computed from x' == x ^ r without unmasking x, as y -> (x' ^ y) - y is affine:
+/// A == [(x' ^ g) - g] ^ x' ^ [(x' ^ (r ^ g)) - (r ^ g)], with another random word g.
+Z3BitBlastPass::WordShares Z3BitBlastPass::arithSharesOf(const ValueInfo &var, int width) {
+    auto known = arith_vars.find(var.name);
+    if (known != arith_vars.end() && getBitWidth(var.width) >= width) {
+        return known->second;
+    }
+    const ValueInfo zero{"0", Width(width), VProp::CST, nullptr};
+    if (var.prop == VProp::CST) {
+        return WordShares{var, zero, {}};
+    }
+    auto computed = boolean_vars.count(var.name) > 0;
+    auto x = booleanSharesOf(var, width);
+    if (x.mask.prop == VProp::CST) {  // public
+        return WordShares{x.masked, zero, {}};
+    }
+
+    b2a_count++;
+    blasted_region.insts.emplace_back("//", "Boolean to arithmetic masking: " + var.name);
+    // The mask of a computed value is not a random word of its own
+    if (computed) {
+        auto fresh = randomWord(width);
+        x.masked = emitWordOp("/xor/", x.masked, fresh, width);
+        x.mask = emitWordOp("/xor/", x.mask, fresh, width);
+        x.randoms.insert(std::upper_bound(x.randoms.begin(), x.randoms.end(), fresh.name), fresh.name);
+    }
+    const auto &masked = x.masked, &r = x.mask;
+    auto g = randomWord(width);
+    auto t = emitWordOp("/sub/", emitWordOp("/xor/", masked, g, width), g, width);
+    t = emitWordOp("/xor/", t, masked, width);
+    auto rg = emitWordOp("/xor/", r, g, width);
+    auto u = emitWordOp("/sub/", emitWordOp("/xor/", masked, rg, width), rg, width);
+    return WordShares{emitWordOp("/xor/", t, u, width), r, std::move(x.randoms)};
+}
+
+/// A value x is held as Boolean shares of whole words (M, R), x == M ^ R, so that a bitwise operation on n bits is
+/// masked by a handful of word instructions instead of n masked bits. XORs, NOTs and shifts by constants are
+/// computed share-wise, ANDs and ORs by `andWords`. Operands masked by a common random word are refreshed first.
+/// Bits are only computed once another operation or the output needs them, see `materializeWord`.
+void Z3BitBlastPass::blastWord(const Instruction &inst) {
+    blasted_region.insts.emplace_back("//", "word masking: " + inst.toString());
+    word_inst_count++;
+    const auto width = getBitWidth(inst.res.width);
+    const auto &op = inst.op;
+    const auto ones = lowBits(width);
+    // Shifted operands are read at their own width, as high bits may be shifted in
+    const auto is_shift = op == "<<" || op == ">>";
+    const auto lhs_width = is_shift ? std::max(width, getBitWidth(inst.lhs.width)) : width;
+    auto x = booleanSharesOf(inst.lhs, lhs_width);
+    WordShares res;
+    if (op == "=") {
+        res = std::move(x);
+    } else if (op == "~") {
+        res = WordShares{emitWordOp("/xor/", x.masked, ones, width), x.mask, std::move(x.randoms)};
+    } else if (is_shift) {
+        auto shift = [&](const ValueInfo &share) {
+            if (op == "<<") {
+                return emitWordOp("/shl/", share, inst.rhs, width);
+            }
+            // High bits of the word are not meaningful
+            return emitWordOp("/shr/", emitWordOp("/and/", share, lowBits(lhs_width), lhs_width), inst.rhs, width);
+        };
+        res = WordShares{shift(x.masked), shift(x.mask), std::move(x.randoms)};
+    } else {
+        auto y = booleanSharesOf(inst.rhs, width);
+        std::vector<std::string> common;
+        std::set_intersection(x.randoms.begin(), x.randoms.end(), y.randoms.begin(), y.randoms.end(),
+                              std::back_inserter(common));
+        if (!common.empty()) {  // (M ^ S, R ^ S)
+            auto fresh = randomWord(width);
+            y.masked = emitWordOp("/xor/", y.masked, fresh, width);
+            y.mask = emitWordOp("/xor/", y.mask, fresh, width);
+            y.randoms.insert(std::upper_bound(y.randoms.begin(), y.randoms.end(), fresh.name), fresh.name);
+        }
+        if (op == "^") {
+            res.masked = emitWordOp("/xor/", x.masked, y.masked, width);
+            res.mask = emitWordOp("/xor/", x.mask, y.mask, width);
+            std::set_union(x.randoms.begin(), x.randoms.end(), y.randoms.begin(), y.randoms.end(),
+                           std::back_inserter(res.randoms));
+        } else if (op == "&") {
+            res = andWords(x, y, width);
+        } else {  // A|B == ~((~A) & (~B))
+            x.masked = emitWordOp("/xor/", x.masked, ones, width);
+            y.masked = emitWordOp("/xor/", y.masked, ones, width);
+            res = andWords(x, y, width);
+            res.masked = emitWordOp("/xor/", res.masked, ones, width);
+        }
+    }
+    redefine(inst.res, false);
+    written_vars.insert(inst.res.name);
+    arith_vars.erase(inst.res.name);
+    boolean_vars[inst.res.name] = std::move(res);
+    word_pending[inst.res.name] = inst.res;
+}
+
+/// ISW on words: c0 = a0 b0 ^ r, c1 = a1 b1 ^ ((r ^ a0 b1) ^ a1 b0), r a fresh random word.
+/// The operands must not share a random word, and the result is masked by r only.
+Z3BitBlastPass::WordShares Z3BitBlastPass::andWords(const WordShares &x, const WordShares &y, int width) {
+    if (x.mask.prop == VProp::CST || y.mask.prop == VProp::CST) {  // a public operand is ANDed share-wise
+        const auto &pub = x.mask.prop == VProp::CST ? x.masked : y.masked;
+        const auto &var = x.mask.prop == VProp::CST ? y : x;
+        return WordShares{emitWordOp("/and/", var.masked, pub, width), emitWordOp("/and/", var.mask, pub, width),
+                          var.randoms};
+    }
+    auto r = randomWord(width);
+    auto cross = emitWordOp("/xor/", r, emitWordOp("/and/", x.masked, y.mask, width), width);
+    cross = emitWordOp("/xor/", cross, emitWordOp("/and/", x.mask, y.masked, width), width);
+    return WordShares{emitWordOp("/xor/", emitWordOp("/and/", x.masked, y.masked, width), r, width),
+                      emitWordOp("/xor/", emitWordOp("/and/", x.mask, y.mask, width), cross, width),
+                      {r.name}};
+}
+
+/// Boolean shares of an operand. Inputs not written yet are masked as words; other values are masked bit by bit by
+/// a random word r, then packed. Either way, the mask is a fresh random word.
+Z3BitBlastPass::WordShares Z3BitBlastPass::booleanSharesOf(const ValueInfo &var, int width) {
+    auto known = boolean_vars.find(var.name);
+    if (known != boolean_vars.end() && getBitWidth(var.width) >= width) {
+        return known->second;
+    }
+    if (known != boolean_vars.end() && !isSigned(var.width)) {  // zero-extended
+        const auto ones = lowBits(getBitWidth(var.width));
+        return WordShares{emitWordOp("/and/", known->second.masked, ones, width),
+                          emitWordOp("/and/", known->second.mask, ones, width), known->second.randoms};
+    }
+    const ValueInfo zero{"0", Width(width), VProp::CST, nullptr};
+    if (var.prop == VProp::CST) {
+        return WordShares{var, zero, {}};
+    }
+    auto is_input = !written_vars.count(var.name) && getBitWidth(var.width) == width;
+    if (var.prop == VProp::PUB) {
+        return WordShares{is_input ? var : packBits(bitsOf(var, width)), zero, {}};
+    }
+    if (is_input && var.prop == VProp::SECRET) {
+        auto r = randomWord(width);
+        return WordShares{emitWordOp("/xor/", var, r, width), r, {r.name}};
+    }
+
+    // Extended to the width of the result from its bits
+    materializeWord(var.name);
+    auto bits = bitsOf(var, width);
+    BitCircuit circuit(blasted_region);
+    BitCircuit::Bits random_bits, masked_bits;
+    auto r = randomWord(width, &random_bits);
+    for (auto i = 0; i < width; i++) {
+        masked_bits.emplace_back(circuit.mkXor(bits[i], random_bits[i]));
+    }
+    return WordShares{packBits(masked_bits), r, {r.name}};
+}
+
+/// Conversion of word shares to bits. Boolean shares are split and xor-ed bit by bit; arithmetic shares are added by
+/// a circuit, whose carries are masked like any other gate. The bits of an output are unmasked anyway, so its shares
+/// are recombined on words at once instead.
+void Z3BitBlastPass::materializeWord(const std::string &name, bool is_output) {
+    auto pending = word_pending.find(name);
+    if (pending == word_pending.end()) {
+        return;
+    }
+    auto var = std::move(pending->second);
+    word_pending.erase(pending);
+
+    const auto width = getBitWidth(var.width);
+    BitCircuit::Bits bits;
+    auto boolean = boolean_vars.find(name);
+    if (is_output) {
+        blasted_region.insts.emplace_back("//", "recombined output: " + name);
+        const auto &shares = boolean != boolean_vars.end() ? boolean->second : arith_vars.at(name);
+        bits = unpackWord(
+            emitWordOp(boolean != boolean_vars.end() ? "/xor/" : "/add/", shares.masked, shares.mask, width), width);
+    } else if (boolean != boolean_vars.end()) {
+        w2b_count++;
+        blasted_region.insts.emplace_back("//", "word to bit masking: " + name);
+        BitCircuit circuit(blasted_region);
+        auto masked = unpackWord(boolean->second.masked, width);
+        auto mask = unpackWord(boolean->second.mask, width);
+        for (auto i = 0; i < width; i++) {
+            bits.emplace_back(circuit.mkXor(masked[i], mask[i]));
+        }
+    } else {
+        a2b_count++;
+        blasted_region.insts.emplace_back("//", "arithmetic to Boolean masking: " + name);
+        const auto &shares = arith_vars.at(name);
+        BitCircuit circuit(blasted_region, directArith());
+        bits = circuit.add(unpackWord(shares.masked, width), unpackWord(shares.mask, width));
+    }
+    BitCircuit circuit(blasted_region);
+    for (auto i = 0; i < width; i++) {
+        circuit.assign(name + "#" + std::to_string(i), bits[i], var.prop);
+    }
+}
+
+ValueInfo Z3BitBlastPass::emitWordOp(std::string_view op, const ValueInfo &lhs, const ValueInfo &rhs, int width) {
+    auto is_zero = [](const ValueInfo &var) { return var.prop == VProp::CST && var.name == "0"; };
+    if ((op == "/add/" || op == "/xor/") && is_zero(lhs)) {
+        return rhs;
+    }
+    if ((op == "/add/" || op == "/sub/" || op == "/xor/") && is_zero(rhs)) {
+        return lhs;
+    }
+    if ((op == "/mul/" || op == "/and/") && (is_zero(lhs) || is_zero(rhs))) {
+        return ValueInfo{"0", Width(width), VProp::CST, nullptr};
+    }
+    auto name = Z3VInfo::getNewName();
+    ValueInfo word{name, Width(width), VProp::UNK, nullptr};
+    blasted_region.sym_tbl[name] = word;
+    blasted_region.insts.emplace_back(op, word, lhs, rhs);
+    return word;
+}
+
+ValueInfo Z3BitBlastPass::randomWord(int width, BitCircuit::Bits *bits) {
+    BitCircuit::Bits random_bits;
+    for (auto i = 0; i < width; i++) {
+        auto r = ValueInfo::getNewRand();
+        blasted_region.sym_tbl[r.name] = r;
+        random_bits.emplace_back(r.name);
+    }
+    if (bits) {
+        *bits = random_bits;
+    }
+    return packBits(random_bits);
+}
+
 Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state, int depth) {
+    if (goal_deadline && std::chrono::steady_clock::now() > *goal_deadline) {
+        throw z3::exception("traversal timeout");
+    }
+
     // utils
     auto name_to_z3id = [](std::string str) {  // e.g. "k!3" -> 3
         size_t pos = str.find('!');
@@ -220,11 +1057,18 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
     if (e.is_var()) {
         llvm::errs() << "var: " << e.to_string() << "\n";
         return Z3VInfo(e.to_string(), Z3VType::Other);
+    } else if (e.is_true() || e.is_false()) {
+        llvm::errs() << "bool: " << e.to_string() << "\n";
+        return Z3VInfo(e.is_true() ? "1" : "0", Z3VType::Other);
     } else if (e.is_const()) {  // a Z3 var
         llvm::errs() << "const: " << e.to_string() << "\n";
         auto potential_varbit = id2varbit.find(name_to_z3id(e.to_string()));
         if (potential_varbit != id2varbit.end()) {  // this Z3 var corresponds to a var in the region
             auto varbit_name = potential_varbit->second;
+            if (depth == 1) {  //! top-level var: the bit is constantly true
+                blasted_region.insts.emplace_back("=", ValueInfo{varbit_name, 1, VProp::UNK, nullptr},
+                                                  ValueInfo{"1", 1, VProp::CST, nullptr}, ValueInfo{});
+            }
             llvm::errs() << "topo id: " << e.to_string() << " - " << var2topo[varbit_name2varname(varbit_name)] << "\n";
             return Z3VInfo(varbit_name, Z3VType::Other, var2topo[varbit_name2varname(varbit_name)]);
         }
@@ -236,6 +1080,11 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
 
         auto oprand = traverseZ3Model(e.arg(0), state, depth + 1);
 
+        if (depth == 1 && e.arg(0).is_const()) {  //! top-level NOT of a var: the bit is constantly false
+            blasted_region.insts.emplace_back("=", ValueInfo{oprand.name, 1, VProp::UNK, nullptr},
+                                              ValueInfo{"0", 1, VProp::CST, nullptr}, ValueInfo{});
+            return Z3VInfo(oprand.name, Z3VType::Other);
+        }
         if (depth == 1) {  //! top-level NOT: rewrite `not (v==expr)` to `v=!expr;`
             auto &last_inst = blasted_region.insts.back();
             assert(last_inst.op == "=" && "top-level NOT should always come after an equivalence (move-assignment)");
@@ -245,7 +1094,7 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
 
         std::string temp_name = Z3VInfo::getNewName();
         auto new_var = ValueInfo{temp_name, width, VProp::UNK, nullptr};
-        blasted_region.sym_tbl[temp_name] = new_var;
+        defineTraversed(new_var);
 
         // NOTE: Use `!` instead of `~` for boolean variables!
         // `~bool_var` will always return true!
@@ -286,8 +1135,16 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
                 auto origin_var = varbit_name.substr(0, varbit_name.find('#'));
                 assert(blasted_region.sym_tbl.count(origin_var));
                 auto origin_vinfo = blasted_region.sym_tbl[origin_var];
+                // The bit may be wired to a bit of another var
+                if (auto alias = bit_alias.find(varbit_name); alias != bit_alias.end()) {
+                    varbit_name = alias->second;
+                    origin_var = varbit_name.substr(0, varbit_name.find('#'));
+                    origin_vinfo = BitCircuit::isConst(varbit_name) ? ValueInfo{varbit_name, 1, VProp::CST, nullptr}
+                                                                    : blasted_region.sym_tbl[origin_var];
+                }
 
                 id2varbit[alias_id] = varbit_name;
+                traversed_ids.push_back(alias_id);
                 blasted_region.insts.emplace_back("//", varbit_name + " -> " + std::to_string(alias_id));
                 varbit2id[varbit_name] = alias_id;
                 id2topo[alias_id] = var2topo[varbit_name];
@@ -295,7 +1152,9 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
                 llvm::errs() << "id2varbit[" << alias_id << "] = " << varbit_name << "\n";
 
                 // The property of the Z3 var is the same as the origin variable
-                blasted_region.sym_tbl[varbit_name] = ValueInfo{varbit_name, 1, origin_vinfo.prop, nullptr};
+                if (!BitCircuit::isConst(varbit_name)) {
+                    defineTraversed(ValueInfo{varbit_name, 1, origin_vinfo.prop, nullptr});
+                }
                 return Z3VInfo{"!ALIAS", Z3VType::Other};
             }
         }
@@ -317,9 +1176,33 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
                     // lhs==rhs -> lhs=rhs / rhs=lhs
                     // !(lhs==rhs) => lhs=!rhs / rhs!=lhs
                     assert(e.num_args() == 2 && "Wrong arg count for top-level `==` op.");
+                    // `!v == expr` where `v` is the bit being defined: move the NOT to the other side,
+                    // otherwise the NOT would be materialized before `v` is defined
+                    auto def_topo = [&](const z3::expr &b) -> int64_t {  // -1 if `b` is not a writable bit
+                        if (!b.is_const()) {
+                            return -1;
+                        }
+                        auto varbit = id2varbit.find(name_to_z3id(b.to_string()));
+                        if (varbit == id2varbit.end() || !blasted_region.sym_tbl.count(varbit->second)) {
+                            return -1;
+                        }
+                        auto prop = blasted_region.sym_tbl[varbit->second].prop;
+                        if (prop == VProp::RND || prop == VProp::SECRET || prop == VProp::PUB) {
+                            return -1;
+                        }
+                        return var2topo[varbit_name2varname(varbit->second)];
+                    };
+                    auto lhs_e = e.arg(0), rhs_e = e.arg(1);
+                    for (auto [side, other] : {std::pair{&lhs_e, &rhs_e}, std::pair{&rhs_e, &lhs_e}}) {
+                        if (side->is_not() && def_topo(side->arg(0)) > def_topo(*other)) {
+                            *side = side->arg(0);
+                            *other = other->is_not() ? other->arg(0) : !*other;
+                            break;
+                        }
+                    }
                     // No more assignments(statements) inside lower layers
-                    auto lhs = traverseZ3Model(e.arg(0), state | NEED_EXPRESSION, depth + 1);
-                    auto rhs = traverseZ3Model(e.arg(1), state | NEED_EXPRESSION, depth + 1);
+                    auto lhs = traverseZ3Model(lhs_e, state | NEED_EXPRESSION, depth + 1);
+                    auto rhs = traverseZ3Model(rhs_e, state | NEED_EXPRESSION, depth + 1);
                     auto temp_name = Z3VInfo::getNewName();
                     Width width = 1;
 
@@ -412,7 +1295,7 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
 
                     auto new_var = ValueInfo{temp_name, width, VProp::UNK,
                                              nullptr};  // !FIXME: we should not assign a new temp var
-                    blasted_region.sym_tbl[temp_name] = new_var;
+                    defineTraversed(new_var);
                     llvm::errs() << "New inst. depth:" << depth << " op" << name << " temp_name=" << temp_name << "\n";
                     blasted_region.insts.emplace_back(opname2operator(name, width), new_var,
                                                       ValueInfo{prev.name, width, VProp::UNK, nullptr},
@@ -438,13 +1321,13 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
             auto ncond_expr_name = Z3VInfo::getNewName();       // i.e. !cond
             auto result_name = Z3VInfo::getNewName() + "_ite";  // i.e. !cond
             auto then_expr = ValueInfo{then_expr_name, width, VProp::UNK, nullptr};
-            blasted_region.sym_tbl[then_expr_name] = then_expr;
+            defineTraversed(then_expr);
             auto else_expr = ValueInfo{else_expr_name, width, VProp::UNK, nullptr};
-            blasted_region.sym_tbl[else_expr_name] = else_expr;
+            defineTraversed(else_expr);
             auto ncond_expr = ValueInfo{ncond_expr_name, width, VProp::UNK, nullptr};
-            blasted_region.sym_tbl[ncond_expr_name] = ncond_expr;
+            defineTraversed(ncond_expr);
             auto result_expr = ValueInfo{result_name, width, VProp::UNK, nullptr};
-            blasted_region.sym_tbl[result_name] = result_expr;
+            defineTraversed(result_expr);
 
             blasted_region.insts.emplace_back("!", ncond_expr, ValueInfo{cond_z3.name, width, VProp::UNK, nullptr},
                                               ValueInfo{});
@@ -468,28 +1351,59 @@ Z3VInfo Z3BitBlastPass::traverseZ3Model(const z3::expr &e, TraversingState state
     }
     return Z3VInfo{};
 }
-void Z3BitBlastPass::solve_and_extract(const z3::goal &goal) {
+bool Z3BitBlastPass::solve_and_extract(const z3::goal &goal) {
+    auto &ctx = *z3ctx;
+    // Limits are tactic params, while the timeout is enforced on the whole tactic
+    auto limited = [&]() {
+        z3::params p{ctx};
+        if (opts.goal_max_steps) {
+            p.set("max_steps", opts.goal_max_steps);
+        }
+        if (opts.goal_max_memory_mb) {
+            p.set("max_memory", opts.goal_max_memory_mb);
+        }
+        return p;
+    };
+
     // Set bit-blasting tactic
-    z3::tactic simplify{z3ctx, "simplify"};
+    z3::tactic simplify = with(z3::tactic{ctx, "simplify"}, limited());
 
-    z3::tactic t{z3ctx, "bit-blast"};
-    z3::params p{z3ctx};
+    z3::tactic t{ctx, "bit-blast"};
+    z3::params p = limited();
     p.set("blast_full", true);
     z3::tactic bit_blast = with(t, p);
 
-    z3::tactic simplify_again{z3ctx, "simplify"};
+    z3::tactic simplify_again = with(z3::tactic{ctx, "simplify"}, limited());
 
     auto optimize_tactic = simplify & bit_blast & simplify_again;
+    if (opts.goal_timeout_ms) {
+        optimize_tactic = z3::try_for(optimize_tactic, opts.goal_timeout_ms);
+    }
 
-    // Apply the tactic to blast
-    z3::apply_result result = optimize_tactic(goal);
-
-    llvm::errs() << "------------------\n";
-
-    llvm::errs() << "- Z3 tree:\n";
-    for (unsigned i = 0; i < result.size(); ++i) {
-        llvm::errs() << result[i].as_expr().to_string() << "\n";
-        traverseZ3Model(result[i].as_expr(), 0, 0);
+    // The timeout also covers the traversal, whose output is discarded if it is not finished in time
+    goal_deadline.reset();
+    if (opts.goal_timeout_ms) {
+        goal_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(opts.goal_timeout_ms);
+    }
+    auto insts_before = blasted_region.insts.size();
+    traversed_syms.clear();
+    traversed_ids.clear();
+    try {
+        // Apply the tactic to blast
+        z3::apply_result result = optimize_tactic(goal);
+
+        llvm::errs() << "------------------\n";
+
+        llvm::errs() << "- Z3 tree:\n";
+        for (unsigned i = 0; i < result.size(); ++i) {
+            llvm::errs() << result[i].as_expr().to_string() << "\n";
+            traverseZ3Model(result[i].as_expr(), 0, 0);
+        }
+    } catch (const z3::exception &e) {
+        llvm::errs() << "Z3 gave up on the goal: " << e.msg() << "\n";
+        blasted_region.insts.resize(insts_before);
+        rollbackTraversal();
+        return false;
     }
 
     // Dump varbit2id
@@ -499,21 +1413,189 @@ void Z3BitBlastPass::solve_and_extract(const z3::goal &goal) {
     }
 
     llvm::errs() << "------------------\n";
+    return true;
+}
+
+void Z3BitBlastPass::defineTraversed(const ValueInfo &var) {
+    auto &st = blasted_region.sym_tbl;
+    auto known = st.find(var.name);
+    traversed_syms.emplace_back(var.name, known != st.end() ? std::optional{known->second} : std::nullopt);
+    st[var.name] = var;
+}
+
+void Z3BitBlastPass::rollbackTraversal() {
+    auto &st = blasted_region.sym_tbl;
+    for (auto it = traversed_syms.rbegin(); it != traversed_syms.rend(); ++it) {
+        if (it->second) {
+            st[it->first] = *it->second;
+        } else {
+            st.erase(it->first);
+        }
+    }
+    for (auto id : traversed_ids) {
+        varbit2id.erase(id2varbit[id]);
+        id2varbit.erase(id);
+        id2topo.erase(id);
+    }
+    traversed_syms.clear();
+    traversed_ids.clear();
+}
+
+/// Blast the instruction with plain gates.
+/// No simplification is done, but its cost is predictable: O(width) gates for bitwise and additive ops,
+/// O(width^2) for multiplication.
+void Z3BitBlastPass::directBlast(const Instruction &inst, bool carry_save) {
+    blasted_region.insts.emplace_back("//", "direct blast: " + inst.toString());
+
+    const auto width = getBitWidth(inst.res.width);
+    BitCircuit circuit(blasted_region, directArith());
+    auto lhs = bitsOf(inst.lhs, width);
+    auto rhs = inst.isUnaryOp() ? BitCircuit::Bits{} : bitsOf(inst.rhs, width);
+    BitCircuit::Bits res;
+    const auto &op = inst.op;
+    if (op == "=") {
+        res = lhs;
+    } else if (op == "^" || op == "|" || op == "or" || op == "&" || op == "and") {
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (op == "^") {
+                res.emplace_back(circuit.mkXor(lhs[i], rhs[i]));
+            } else if (op == "|" || op == "or") {
+                res.emplace_back(circuit.mkOr(lhs[i], rhs[i]));
+            } else {
+                res.emplace_back(circuit.mkAnd(lhs[i], rhs[i]));
+            }
+        }
+    } else if (op == "~" || op == "not") {
+        for (const auto &bit : lhs) {
+            res.emplace_back(circuit.mkNot(bit));
+        }
+    } else if (op == "!") {  // logical not: only bit 0 may be set
+        auto any = BitCircuit::Bit{"0"};
+        for (const auto &bit : bitsOf(inst.lhs, getBitWidth(inst.lhs.width))) {
+            any = circuit.mkOr(any, bit);
+        }
+        res.assign(width, "0");
+        if (!res.empty()) {
+            res[0] = circuit.mkNot(any);
+        }
+    } else if ((op == "+" || op == "-" || op == "*") &&
+               (carry_save || pending_sums.count(inst.lhs.name) || pending_sums.count(inst.rhs.name))) {
+        // Part of a sum tree: collect the bits of all operands by weight
+        std::vector<BitCircuit::Bits> columns(width);
+        auto push_operand = [&](const ValueInfo &var, const BitCircuit::Bits &bits) {
+            auto pending = pending_sums.find(var.name);
+            if (var.prop != VProp::CST && pending != pending_sums.end()) {
+                for (size_t i = 0; i < columns.size(); i++) {
+                    std::move(pending->second[i].begin(), pending->second[i].end(), std::back_inserter(columns[i]));
+                }
+                pending_sums.erase(pending);
+                return;
+            }
+            for (size_t i = 0; i < columns.size(); i++) {
+                columns[i].emplace_back(bits[i]);
+            }
+        };
+        if (op == "*") {
+            circuit.pushProduct(columns, 0, lhs, rhs);
+        } else {
+            push_operand(inst.lhs, lhs);
+            if (op == "+") {
+                push_operand(inst.rhs, rhs);
+            } else if (!columns.empty()) {  // a - b == a + ~b + 1
+                for (size_t i = 0; i < columns.size(); i++) {
+                    columns[i].emplace_back(circuit.mkNot(rhs[i]));
+                }
+                columns[0].emplace_back("1");
+            }
+        }
+        if (carry_save) {
+            blasted_region.insts.emplace_back("//", "carry-save: " + inst.toString());
+            pending_sums[inst.res.name] = std::move(columns);
+            return;
+        }
+        res = circuit.sumColumns(std::move(columns));
+    } else if (op == "+") {
+        res = circuit.add(lhs, rhs);
+    } else if (op == "-") {
+        res = circuit.sub(lhs, rhs);
+    } else if (op == "*") {
+        res = circuit.mul(lhs, rhs);
+    } else if (op == "<<" || op == ">>") {
+        res = shiftByVar(circuit, inst);
+    } else {
+        llvm::report_fatal_error("Cannot blast op `" + op + "` in " + inst.toString());
+    }
+
+    res = detachSelfBits(inst.res, std::move(res));
+    for (size_t i = 0; i < res.size(); i++) {
+        auto var_bit_name = inst.res.name + "#" + std::to_string(i);
+        if (res[i] != var_bit_name) {
+            circuit.assign(var_bit_name, res[i], inst.res.prop);
+        }
+    }
+}
+
+/// Barrel shifter, as encoded for Z3 by `blastWithZ3`: operands are extended to the widest one,
+/// each bit k of the amount shifts by 2^k, and amounts of the whole width or more leave only the fill bits.
+BitCircuit::Bits Z3BitBlastPass::shiftByVar(BitCircuit &circuit, const Instruction &inst) {
+    auto width = getBitWidth(inst.res.width);
+    for (const auto &var : {inst.lhs, inst.rhs}) {
+        if (var.prop != VProp::CST) {
+            width = std::max(width, getBitWidth(var.width));
+        }
+    }
+    auto bits = bitsOf(inst.lhs, width);
+    auto amount = bitsOf(inst.rhs, inst.rhs.prop == VProp::CST ? 64 : getBitWidth(inst.rhs.width));
+    const auto left = inst.op == "<<";
+    const auto fill = !left && isSigned(inst.lhs.width) ? bits.back() : BitCircuit::Bit{"0"};
+    // mux(c, x, y) == c ? x : y == y ^ (c & (x ^ y))
+    auto mux = [&](const BitCircuit::Bit &c, const BitCircuit::Bit &x, const BitCircuit::Bit &y) {
+        return circuit.mkXor(y, circuit.mkAnd(c, circuit.mkXor(x, y)));
+    };
+    auto overflow = BitCircuit::Bit{"0"};
+    for (size_t k = 0; k < amount.size(); k++) {
+        if (k >= 63 || (uint64_t(1) << k) >= uint64_t(width)) {
+            overflow = circuit.mkOr(overflow, amount[k]);
+            continue;
+        }
+        const auto step = size_t(1) << k;
+        BitCircuit::Bits shifted(width);
+        for (size_t i = 0; i < size_t(width); i++) {
+            const auto from = left ? (i >= step ? bits[i - step] : BitCircuit::Bit{"0"})
+                                   : (i + step < size_t(width) ? bits[i + step] : fill);
+            shifted[i] = mux(amount[k], from, bits[i]);
+        }
+        bits = std::move(shifted);
+    }
+    for (auto &bit : bits) {
+        bit = mux(overflow, fill, bit);
+    }
+    bits.resize(getBitWidth(inst.res.width));
+    return bits;
+}
+
+ArithOptions Z3BitBlastPass::directArith() const {
+    auto arith = opts.arith;
+    if (arith.adder_arch == AdderArch::Z3) {
+        arith.adder_arch = AdderArch::RippleCarry;
+    }
+    if (arith.multiplier_arch == MultiplierArch::Z3) {
+        arith.multiplier_arch = MultiplierArch::CarrySave;
+    }
+    return arith;
 }
 
 Region Z3BitBlastPass::get() {
     // Assemble output vars from bits at the end of the function body
-    for (const auto &[vinfo, bits] : var2bits) {
-        if (vinfo.prop == VProp::OUTPUT) {
-            blasted_region.insts.emplace_back("/clear/", vinfo, ValueInfo{"0", 1, VProp::CST, nullptr}, ValueInfo{});
-            for (unsigned i = 0; i < bits.size(); ++i) {
-                if (bits[i].has_value()) {
-                    auto var_bit_name = vinfo.name + "#" + std::to_string(i);
-                    blasted_region.insts.emplace_back("/z3=>var/", vinfo,
-                                                      ValueInfo{var_bit_name, 1, VProp::CST, nullptr},
-                                                      ValueInfo{std::to_string(i), 1, VProp::CST, nullptr});
-                }
+    for (const auto &vinfo : output_vars) {
+        blasted_region.insts.emplace_back("/clear/", vinfo, ValueInfo{"0", 1, VProp::CST, nullptr}, ValueInfo{});
+        for (auto i = 0; i < getBitWidth(vinfo.width); ++i) {
+            auto var_bit_name = resolveBit(vinfo.name + "#" + std::to_string(i), vinfo.prop);
+            if (var_bit_name == "0") {
+                continue;
             }
+            blasted_region.insts.emplace_back("/z3=>var/", vinfo, ValueInfo{var_bit_name, 1, VProp::CST, nullptr},
+                                              ValueInfo{std::to_string(i), 1, VProp::CST, nullptr});
         }
     }
 
@@ -0,0 +1,571 @@
+#include "Re-Sc-Masker/BitCircuit.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string>
+
+#include "Re-Sc-Masker/BitBlastPass.hpp"
+#include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+namespace {
+const char *archName(AdderArch arch) {
+    switch (arch) {
+        case AdderArch::Z3:
+            return "z3";
+        case AdderArch::RippleCarry:
+            return "ripple-carry";
+        case AdderArch::BrentKung:
+            return "brent-kung";
+        case AdderArch::KoggeStone:
+            return "kogge-stone";
+        case AdderArch::Auto:
+            return "auto";
+    }
+    return "?";
+}
+
+/// A gate of the AES S-box circuit: `op` is '^', '&' or '=' (XNOR), operands index the signals.
+/// Signals 0..7 are the input bits from the MSB down, gate k defines signal 8+k.
+struct SboxGate {
+    char op;
+    uint8_t a, b;
+};
+
+/// The depth-16 AES S-box circuit of Boyar and Peralta, outputs being the last 8 signals from the MSB down
+constexpr SboxGate AES_SBOX_GATES[] = {
+    {'^', 0, 3}, {'^', 0, 5}, {'^', 0, 6}, {'^', 3, 5}, {'^', 4, 6}, {'^', 8, 12},
+    {'^', 1, 2}, {'^', 7, 13}, {'^', 7, 14}, {'^', 13, 14}, {'^', 1, 5}, {'^', 2, 5},
+    {'^', 10, 11}, {'^', 13, 18}, {'^', 12, 18}, {'^', 12, 19}, {'^', 16, 23}, {'^', 3, 7},
+    {'^', 14, 25}, {'^', 8, 26}, {'^', 6, 7}, {'^', 14, 28}, {'^', 9, 29}, {'^', 9, 17},
+    {'^', 27, 24}, {'^', 10, 23}, {'^', 8, 19}, {'&', 20, 13}, {'&', 30, 15}, {'^', 21, 35},
+    {'&', 26, 7}, {'^', 38, 35}, {'&', 10, 23}, {'&', 29, 16}, {'^', 33, 40}, {'&', 27, 24},
+    {'^', 43, 40}, {'&', 8, 22}, {'&', 11, 34}, {'^', 46, 45}, {'&', 9, 17}, {'^', 48, 45},
+    {'^', 37, 36}, {'^', 39, 31}, {'^', 42, 41}, {'^', 44, 49}, {'^', 50, 47}, {'^', 51, 49},
+    {'^', 52, 47}, {'^', 53, 32}, {'^', 56, 57}, {'&', 56, 54}, {'^', 55, 59}, {'^', 54, 55},
+    {'^', 57, 59}, {'&', 62, 61}, {'&', 60, 58}, {'&', 54, 57}, {'&', 61, 65}, {'^', 61, 59},
+    {'&', 55, 56}, {'&', 58, 68}, {'^', 58, 59}, {'^', 55, 63}, {'^', 66, 67}, {'^', 57, 64},
+    {'^', 69, 70}, {'^', 72, 74}, {'^', 71, 73}, {'^', 71, 72}, {'^', 73, 74}, {'^', 76, 75},
+    {'&', 78, 13}, {'&', 74, 15}, {'&', 73, 7}, {'&', 77, 23}, {'&', 72, 16}, {'&', 71, 24},
+    {'&', 76, 22}, {'&', 79, 34}, {'&', 75, 17}, {'&', 78, 20}, {'&', 74, 30}, {'&', 73, 26},
+    {'&', 77, 10}, {'&', 72, 29}, {'&', 71, 27}, {'&', 76, 8}, {'&', 79, 11}, {'&', 75, 9},
+    {'^', 95, 96}, {'^', 84, 90}, {'^', 80, 82}, {'^', 81, 89}, {'^', 88, 92}, {'^', 83, 95},
+    {'^', 96, 103}, {'^', 80, 101}, {'^', 85, 93}, {'^', 86, 87}, {'^', 87, 102}, {'^', 94, 100},
+    {'^', 82, 85}, {'^', 84, 98}, {'^', 86, 95}, {'^', 89, 99}, {'^', 90, 98}, {'^', 91, 99},
+    {'^', 92, 106}, {'^', 97, 102}, {'^', 98, 99}, {'^', 99, 105}, {'^', 101, 110}, {'^', 116, 100},
+    {'^', 113, 107}, {'^', 104, 108}, {'^', 105, 107}, {'^', 106, 108}, {'^', 109, 112}, {'^', 109, 115},
+    {'^', 104, 122}, {'=', 114, 124}, {'=', 117, 126}, {'^', 104, 119}, {'^', 118, 120}, {'^', 123, 127},
+    {'=', 111, 125}, {'=', 104, 121},
+};
+constexpr size_t AES_SBOX_SIGNALS = 8 + std::size(AES_SBOX_GATES);
+
+bool isAesSbox(const std::vector<uint64_t> &table) {
+    if (table.size() != 256) {
+        return false;
+    }
+    for (uint64_t x = 0; x < 256; x++) {
+        bool signals[AES_SBOX_SIGNALS];
+        for (size_t i = 0; i < 8; i++) {
+            signals[i] = (x >> (7 - i)) & 1;
+        }
+        for (size_t k = 0; k < std::size(AES_SBOX_GATES); k++) {
+            const auto &gate = AES_SBOX_GATES[k];
+            auto a = signals[gate.a], b = signals[gate.b];
+            signals[8 + k] = gate.op == '&' ? a && b : (a != b) ^ (gate.op == '=');
+        }
+        uint64_t y = 0;
+        for (size_t i = 0; i < 8; i++) {
+            y |= uint64_t{signals[AES_SBOX_SIGNALS - 8 + i]} << (7 - i);
+        }
+        if (y != (table[x] & 0xff)) {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace
+
+BitCircuit::Bit BitCircuit::newTemp() {
+    auto name = Z3VInfo::getNewName();
+    region.sym_tbl[name] = ValueInfo{name, 1, VProp::UNK, nullptr};
+    return name;
+}
+
+BitCircuit::Bit BitCircuit::emit(std::string_view op, const Bit &a, const Bit &b) {
+    auto t = newTemp();
+    region.insts.emplace_back(op, ValueInfo{t, 1, VProp::UNK, nullptr}, ValueInfo{a, 1, VProp::UNK, nullptr},
+                              b.empty() ? ValueInfo{} : ValueInfo{b, 1, VProp::UNK, nullptr});
+    auto depth = std::max(andDepth(a), b.empty() ? 0 : andDepth(b));
+    if (depth || op == "&&" || op == "||") {
+        and_depths[t] = depth + (op == "&&" || op == "||");
+    }
+    return t;
+}
+
+unsigned BitCircuit::maskedCost(const Region &region) const {
+    unsigned cost = 0;
+    for (const auto &inst : region.insts) {
+        if (inst.op == "&&" || inst.op == "||") {
+            cost += opts.masked_cost.and_cost;
+        } else if (inst.op == "^") {
+            cost += opts.masked_cost.xor_cost;
+        } else if (inst.op == "!") {
+            cost += opts.masked_cost.not_cost;
+        }
+    }
+    return cost;
+}
+
+unsigned BitCircuit::andDepth(const Bit &b) const {
+    auto depth = and_depths.find(b);
+    return depth == and_depths.end() ? 0 : depth->second;
+}
+
+BitCircuit::Bit BitCircuit::mkNot(const Bit &a) {
+    if (isConst(a)) {
+        return a == "0" ? "1" : "0";
+    }
+    return emit("!", a, "");
+}
+
+BitCircuit::Bit BitCircuit::mkXor(const Bit &a, const Bit &b) {
+    if (a == "0") {
+        return b;
+    }
+    if (b == "0") {
+        return a;
+    }
+    if (a == "1") {
+        return mkNot(b);
+    }
+    if (b == "1") {
+        return mkNot(a);
+    }
+    if (a == b) {
+        return "0";
+    }
+    return emit("^", a, b);
+}
+
+BitCircuit::Bit BitCircuit::mkAnd(const Bit &a, const Bit &b) {
+    if (a == "0" || b == "0") {
+        return "0";
+    }
+    if (a == "1") {
+        return b;
+    }
+    if (b == "1" || a == b) {
+        return a;
+    }
+    and_count++;
+    return emit("&&", a, b);
+}
+
+BitCircuit::Bit BitCircuit::mkOr(const Bit &a, const Bit &b) {
+    if (a == "1" || b == "1") {
+        return "1";
+    }
+    if (a == "0") {
+        return b;
+    }
+    if (b == "0" || a == b) {
+        return a;
+    }
+    and_count++;
+    return emit("||", a, b);
+}
+
+BitCircuit::Bit BitCircuit::mkCopy(const Bit &a) {
+    if (isConst(a)) {
+        return a;
+    }
+    auto t = newTemp();
+    assign(t, a);
+    return t;
+}
+
+void BitCircuit::assign(const Bit &target, const Bit &b, VProp prop) {
+    region.sym_tbl[target] = ValueInfo{target, 1, prop, nullptr};
+    region.insts.emplace_back("=", ValueInfo{target, 1, prop, nullptr},
+                              ValueInfo{b, 1, isConst(b) ? VProp::CST : VProp::UNK, nullptr}, ValueInfo{});
+}
+
+BitCircuit::Bits BitCircuit::add(const Bits &a, const Bits &b, const Bit &cin) {
+    assert(a.size() == b.size());
+    if (opts.adder_arch == AdderArch::Auto) {
+        return addAuto(a, b, cin);
+    }
+    auto and_before = and_count;
+    auto sum = opts.adder_arch == AdderArch::BrentKung || opts.adder_arch == AdderArch::KoggeStone
+                   ? addPrefix(a, b, cin, opts.adder_arch)
+                   : addRipple(a, b, cin);
+    unsigned depth = 0;
+    for (const auto &bit : sum) {
+        depth = std::max(depth, andDepth(bit));
+    }
+    llvm::errs() << "Adder (" << archName(opts.adder_arch) << ", " << a.size() << " bits): " << and_count - and_before
+                 << " ANDs, AND depth " << depth << "\n";
+    return sum;
+}
+
+/// Ripple-carry adder built from full adders with a single AND each:
+/// s = a ^ b ^ c; c' = ((a ^ c) & (b ^ c)) ^ c
+BitCircuit::Bits BitCircuit::addRipple(const Bits &a, const Bits &b, const Bit &cin) {
+    Bits sum;
+    sum.reserve(a.size());
+    Bit carry = cin;
+    for (size_t i = 0; i < a.size(); i++) {
+        auto ac = mkXor(a[i], carry);
+        sum.emplace_back(mkXor(ac, b[i]));
+        if (i + 1 < a.size()) {  // the last carry is dropped
+            carry = mkXor(mkAnd(ac, mkXor(b[i], carry)), carry);
+        }
+    }
+    return sum;
+}
+
+/// Parallel-prefix adder on (generate, propagate) pairs:
+/// (G, P) o (G', P') = (G ^ (P & G'), P & P'), where the XOR stands for an OR as G and P & G' are exclusive.
+/// The carry-in is absorbed into the generate bit of position 0, whose propagate bit is then 0,
+/// so that groups reaching position 0 need no propagate AND.
+BitCircuit::Bits BitCircuit::addPrefix(const Bits &a, const Bits &b, const Bit &cin, AdderArch arch) {
+    const auto n = a.size();
+    if (n == 0) {
+        return {};
+    }
+    Bits p(n);
+    for (size_t i = 0; i < n; i++) {
+        p[i] = mkXor(a[i], b[i]);
+    }
+    // Only the carries into bits 1..n-1 are needed, i.e. the groups [i:0] for i < n - 1
+    const auto m = n - 1;
+    Bits gg(m), pp(p.begin(), p.begin() + m);
+    for (size_t i = 0; i < m; i++) {
+        if (i == 0) {
+            gg[i] = mkXor(mkAnd(mkXor(a[0], cin), mkXor(b[0], cin)), cin);
+            pp[i] = "0";
+        } else {
+            gg[i] = mkAnd(a[i], b[i]);
+        }
+    }
+    auto combine = [&](size_t i, size_t j) {  // [i:k] o [k-1:j'] where j = k-1
+        gg[i] = mkXor(gg[i], mkAnd(pp[i], gg[j]));
+        pp[i] = mkAnd(pp[i], pp[j]);
+    };
+    if (arch == AdderArch::KoggeStone) {
+        for (size_t d = 1; d < m; d *= 2) {
+            for (size_t i = m - 1; i >= d; i--) {  // downwards, so that [i-d] is still the previous level
+                combine(i, i - d);
+            }
+        }
+    } else {
+        size_t top = 1;
+        for (size_t d = 1; d < m; d *= 2) {
+            for (size_t i = 2 * d - 1; i < m; i += 2 * d) {
+                combine(i, i - d);
+            }
+            top = d;
+        }
+        for (size_t d = top / 2; d >= 1; d /= 2) {
+            for (size_t i = 3 * d - 1; i < m; i += 2 * d) {
+                combine(i, i - d);
+            }
+        }
+    }
+
+    Bits sum;
+    sum.reserve(n);
+    sum.emplace_back(mkXor(p[0], cin));
+    for (size_t i = 1; i < n; i++) {
+        sum.emplace_back(mkXor(p[i], gg[i - 1]));
+    }
+    return sum;
+}
+
+/// Build every adder aside, and keep the one with the lowest masked cost plus weighted AND depth
+BitCircuit::Bits BitCircuit::addAuto(const Bits &a, const Bits &b, const Bit &cin) {
+    std::optional<Region> best;
+    BitCircuit::Bits best_sum;
+    unsigned best_cost = 0;
+    AdderArch best_arch = AdderArch::RippleCarry;
+    size_t best_and_count = 0;
+    std::unordered_map<Bit, unsigned> best_depths;
+    for (auto arch : {AdderArch::RippleCarry, AdderArch::BrentKung, AdderArch::KoggeStone}) {
+        Region trial_region;
+        auto trial_opts = opts;
+        trial_opts.adder_arch = arch;
+        BitCircuit trial(trial_region, trial_opts);
+        trial.and_depths = and_depths;
+        auto sum = arch == AdderArch::RippleCarry ? trial.addRipple(a, b, cin) : trial.addPrefix(a, b, cin, arch);
+        unsigned cost = maskedCost(trial_region), depth = 0;
+        for (const auto &bit : sum) {
+            depth = std::max(depth, trial.andDepth(bit));
+        }
+        cost += depth * opts.adder_depth_weight;
+        if (!best || cost < best_cost) {
+            best = std::move(trial_region);
+            best_sum = std::move(sum);
+            best_cost = cost;
+            best_arch = arch;
+            best_and_count = trial.and_count;
+            best_depths = std::move(trial.and_depths);
+        }
+    }
+    llvm::errs() << "Adder (auto, " << a.size() << " bits): chose " << archName(best_arch) << ", "
+                 << best_and_count << " ANDs, cost " << best_cost << "\n";
+    for (auto &&inst : best->insts) {
+        region.insts.emplace_back(std::move(inst));
+    }
+    region.sym_tbl.merge(best->sym_tbl);
+    and_count += best_and_count;
+    and_depths = std::move(best_depths);
+    return best_sum;
+}
+
+BitCircuit::Bits BitCircuit::lookup(const std::vector<uint64_t> &table, const Bits &index, size_t width) {
+    assert(table.size() == (size_t{1} << index.size()));
+    auto and_before = and_count;
+    auto bits = lookupAesSbox(table, index, width);
+    if (!bits) {
+        bits = lookupAnf(table, index, width);
+    }
+    llvm::errs() << "Lookup (" << table.size() << " entries, " << width << " bits): " << and_count - and_before
+                 << " ANDs\n";
+    return *bits;
+}
+
+std::optional<BitCircuit::Bits> BitCircuit::lookupAesSbox(const std::vector<uint64_t> &table, const Bits &index,
+                                                          size_t width) {
+    if (index.size() != 8 || width != 8 || !isAesSbox(table)) {
+        return std::nullopt;
+    }
+    Bits signals(AES_SBOX_SIGNALS);
+    for (size_t i = 0; i < 8; i++) {
+        signals[i] = index[7 - i];
+    }
+    for (size_t k = 0; k < std::size(AES_SBOX_GATES); k++) {
+        const auto &gate = AES_SBOX_GATES[k];
+        const auto &a = signals[gate.a], &b = signals[gate.b];
+        signals[8 + k] = gate.op == '&' ? mkAnd(a, b) : gate.op == '^' ? mkXor(a, b) : mkNot(mkXor(a, b));
+    }
+    Bits res(8);
+    for (size_t i = 0; i < 8; i++) {
+        res[7 - i] = signals[AES_SBOX_SIGNALS - 8 + i];
+    }
+    return res;
+}
+
+/// Each output bit is the xor of the monomials of its algebraic normal form, obtained by the Moebius transform.
+/// A monomial is the AND of a smaller one and its highest variable, so that each one costs a single AND.
+BitCircuit::Bits BitCircuit::lookupAnf(const std::vector<uint64_t> &table, const Bits &index, size_t width) {
+    std::vector<std::optional<Bit>> monomials(table.size());
+    monomials[0] = "1";
+    auto monomial = [&](auto &self, size_t vars) -> Bit {
+        if (!monomials[vars]) {
+            auto highest = std::bit_width(vars) - 1;
+            monomials[vars] = mkAnd(self(self, vars ^ (size_t{1} << highest)), index[highest]);
+        }
+        return *monomials[vars];
+    };
+
+    Bits res;
+    res.reserve(width);
+    for (size_t j = 0; j < width; j++) {
+        std::vector<bool> anf(table.size());
+        for (size_t x = 0; x < table.size(); x++) {
+            anf[x] = (table[x] >> j) & 1;
+        }
+        for (size_t step = 1; step < table.size(); step <<= 1) {
+            for (size_t x = 0; x < table.size(); x++) {
+                if (x & step) {
+                    anf[x] = anf[x] ^ anf[x ^ step];
+                }
+            }
+        }
+        Bit bit = "0";
+        for (size_t vars = 0; vars < table.size(); vars++) {
+            if (anf[vars]) {
+                bit = mkXor(bit, monomial(monomial, vars));
+            }
+        }
+        res.emplace_back(std::move(bit));
+    }
+    return res;
+}
+
+/// a - b == a + ~b + 1
+BitCircuit::Bits BitCircuit::sub(const Bits &a, const Bits &b) {
+    Bits nb;
+    nb.reserve(b.size());
+    for (const auto &bit : b) {
+        nb.emplace_back(mkNot(bit));
+    }
+    return add(a, nb, "1");
+}
+
+BitCircuit::Bits BitCircuit::mul(const Bits &a, const Bits &b) {
+    assert(a.size() == b.size());
+    auto and_before = and_count;
+    std::vector<Bits> columns(a.size());
+    pushProduct(columns, 0, a, b);
+    auto product = sumColumns(std::move(columns));
+    unsigned depth = 0;
+    for (const auto &bit : product) {
+        depth = std::max(depth, andDepth(bit));
+    }
+    llvm::errs() << "Multiplier (" << (opts.multiplier_arch == MultiplierArch::Karatsuba ? "karatsuba" : "carry-save")
+                 << ", " << a.size() << " bits): " << and_count - and_before << " ANDs, AND depth " << depth << "\n";
+    return product;
+}
+
+/// Carry-save accumulation: full adders (a single AND each) reduce every column to at most 2 bits,
+/// which are then summed by one adder.
+/// s = x ^ y ^ z; c = ((x ^ z) & (y ^ z)) ^ z
+BitCircuit::Bits BitCircuit::sumColumns(std::vector<Bits> &&columns) {
+    const auto width = columns.size();
+    // Constant bits are summed up front
+    size_t carry = 0;
+    for (auto &column : columns) {
+        auto ones = carry;
+        Bits bits;
+        for (auto &&bit : column) {
+            if (bit == "1") {
+                ones++;
+            } else if (bit != "0") {
+                bits.emplace_back(std::move(bit));
+            }
+        }
+        if (ones & 1) {
+            bits.emplace_back("1");
+        }
+        carry = ones / 2;
+        column = std::move(bits);
+    }
+
+    while (std::any_of(columns.begin(), columns.end(), [](const Bits &column) { return column.size() > 2; })) {
+        std::vector<Bits> next(width);
+        for (size_t i = 0; i < width; i++) {
+            const auto &column = columns[i];
+            size_t k = 0;
+            for (; k + 3 <= column.size(); k += 3) {
+                const auto &x = column[k], &y = column[k + 1], &z = column[k + 2];
+                auto xz = mkXor(x, z);
+                next[i].emplace_back(mkXor(xz, y));
+                if (i + 1 < width) {  // the last carry is dropped
+                    next[i + 1].emplace_back(mkXor(mkAnd(xz, mkXor(y, z)), z));
+                }
+            }
+            for (; k < column.size(); k++) {
+                next[i].emplace_back(column[k]);
+            }
+        }
+        columns = std::move(next);
+    }
+
+    Bits x(width, "0"), y(width, "0");
+    for (size_t i = 0; i < width; i++) {
+        if (columns[i].size() > 0) {
+            x[i] = columns[i][0];
+        }
+        if (columns[i].size() > 1) {
+            y[i] = columns[i][1];
+        }
+    }
+    return add(x, y);
+}
+
+bool BitCircuit::splitByKaratsuba(const Bits &a, const Bits &b) const {
+    // Halves of less than 4 bits would not shrink: (a0 + a1) has 1 more bit than a0
+    return opts.multiplier_arch == MultiplierArch::Karatsuba && a.size() == b.size() &&
+           a.size() >= std::max(opts.karatsuba_threshold, 4u);
+}
+
+/// Wide operands are split as a = a1 * 2^l + a0.
+/// If the full product is needed, it is built by Karatsuba (see `mulFull`),
+/// otherwise the product of the high halves is truncated or even dropped:
+/// a * b mod 2^w == a0 * b0 + (a1 * b0 + a0 * b1) * 2^l + a1 * b1 * 2^2l mod 2^w
+void BitCircuit::pushProduct(std::vector<Bits> &columns, size_t offset, const Bits &a, const Bits &b) {
+    const auto width = columns.size() - offset;  // bits of the product needed
+    if (!splitByKaratsuba(a, b)) {
+        for (size_t i = 0; i < a.size() && i < width; i++) {
+            for (size_t j = 0; j < b.size() && i + j < width; j++) {
+                columns[offset + i + j].emplace_back(mkAnd(a[i], b[j]));
+            }
+        }
+        return;
+    }
+
+    const auto n = a.size();
+    if (width >= 2 * n) {
+        auto product = mulFull(a, b);
+        for (size_t i = 0; i < product.size(); i++) {
+            columns[offset + i].emplace_back(std::move(product[i]));
+        }
+        return;
+    }
+    const auto l = n - n / 2;
+    pushProduct(columns, offset, Bits(a.begin(), a.begin() + l), Bits(b.begin(), b.begin() + l));
+    if (width > l) {
+        // The low halves keep every bit below the width; the high halves (1 bit shorter for odd n)
+        // are zero-padded to the same size
+        const auto cross = std::min(width - l, l);
+        const auto high = std::min(cross, n - l);
+        auto a1 = Bits(a.begin() + l, a.begin() + l + high), b1 = Bits(b.begin() + l, b.begin() + l + high);
+        a1.resize(cross, "0");
+        b1.resize(cross, "0");
+        pushProduct(columns, offset + l, a1, Bits(b.begin(), b.begin() + cross));
+        pushProduct(columns, offset + l, Bits(a.begin(), a.begin() + cross), b1);
+    }
+    if (width > 2 * l) {
+        pushProduct(columns, offset + 2 * l, Bits(a.begin() + l, a.end()), Bits(b.begin() + l, b.end()));
+    }
+}
+
+/// Karatsuba: with a = a1 * 2^l + a0 and b = b1 * 2^l + b0,
+/// a * b = z2 * 2^2l + (z1 - z2 - z0) * 2^l + z0, where
+/// z0 = a0 * b0; z2 = a1 * b1; z1 = (a0 + a1) * (b0 + b1)
+/// which takes 3 half-width products instead of 4.
+BitCircuit::Bits BitCircuit::mulFull(const Bits &a, const Bits &b) {
+    const auto n = a.size();
+    std::vector<Bits> columns(2 * n);
+    if (!splitByKaratsuba(a, b)) {
+        pushProduct(columns, 0, a, b);
+        return sumColumns(std::move(columns));
+    }
+
+    const auto l = n - n / 2;
+    Bits a0(a.begin(), a.begin() + l), a1(a.begin() + l, a.end());
+    Bits b0(b.begin(), b.begin() + l), b1(b.begin() + l, b.end());
+    auto z0 = mulFull(a0, b0);
+    auto z2 = mulFull(a1, b1);
+    // The sums take 1 more bit
+    a0.push_back("0");
+    b0.push_back("0");
+    a1.resize(l + 1, "0");
+    b1.resize(l + 1, "0");
+    auto z1 = mulFull(add(a0, a1), add(b0, b1));
+
+    for (size_t i = 0; i < z0.size(); i++) {
+        columns[i].emplace_back(z0[i]);
+    }
+    for (size_t i = 0; i < z2.size(); i++) {
+        columns[2 * l + i].emplace_back(z2[i]);
+    }
+    for (size_t i = 0; i < z1.size() && l + i < 2 * n; i++) {
+        columns[l + i].emplace_back(z1[i]);
+    }
+    // -z == ~z + 1
+    for (const auto &z : {z0, z2}) {
+        for (size_t i = 0; l + i < 2 * n; i++) {
+            columns[l + i].emplace_back(i < z.size() ? mkNot(z[i]) : "1");
+        }
+        columns[l].emplace_back("1");
+    }
+    return sumColumns(std::move(columns));
+}
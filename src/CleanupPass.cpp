@@ -0,0 +1,122 @@
+#include "Re-Sc-Masker/CleanupPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+namespace {
+/// Output assembly instructions, which are the roots of liveness
+bool isOutput(const Instruction &inst) { return inst.op == "/clear/" || inst.op == "/z3=>var/"; }
+}  // namespace
+
+CleanupPass::CleanupPass(Region &&origin_region) : region(std::move(origin_region)) {
+    llvm::errs() << "===CleanupPass: started===\n";
+    propagateCopies();
+    eliminateDeadCode();
+    pruneSymbols();
+    llvm::errs() << "===CleanupPass: " << propagated_count << " copies propagated, " << removed_inst_count
+                 << " instructions and " << removed_symbol_count << " symbols removed===\n";
+}
+
+/// Uses of `a` after `a = b` read `b` directly, until either of them is redefined
+void CleanupPass::propagateCopies() {
+    std::unordered_map<std::string, ValueInfo> copies;
+    /// b -> the bits copied from it
+    std::unordered_map<std::string, std::vector<std::string>> copied_to;
+    auto substitute = [&](ValueInfo &var, bool keep_prop) {
+        auto copy = copies.find(var.name);
+        if (copy == copies.end()) {
+            return;
+        }
+        propagated_count++;
+        if (keep_prop) {
+            var.name = copy->second.name;
+        } else {
+            var = copy->second;
+        }
+    };
+    auto kill = [&](const std::string &name) {
+        copies.erase(name);
+        auto users = copied_to.find(name);
+        if (users == copied_to.end()) {
+            return;
+        }
+        for (const auto &user : users->second) {
+            auto copy = copies.find(user);
+            if (copy != copies.end() && copy->second.name == name) {
+                copies.erase(copy);
+            }
+        }
+        copied_to.erase(users);
+    };
+
+    for (auto &inst : region.insts) {
+        if (inst.op == "//") {
+            continue;
+        }
+        if (inst.op == "/z3=>var/") {  // the assembled bit is marked as a constant index-wise, keep it
+            substitute(inst.lhs, true);
+        } else if (!inst.op.starts_with("/")) {
+            substitute(inst.lhs, false);
+            if (!inst.isUnaryOp()) {
+                substitute(inst.rhs, false);
+            }
+        }
+        kill(inst.res.name);
+        if (inst.op == "=" && inst.lhs.prop != VProp::CST && inst.lhs.name != inst.res.name &&
+            getBitWidth(inst.res.width) == 1) {
+            copies[inst.res.name] = inst.lhs;
+            copied_to[inst.lhs.name].push_back(inst.res.name);
+        }
+    }
+}
+
+/// Backward liveness from the output assembly
+void CleanupPass::eliminateDeadCode() {
+    std::unordered_set<std::string> live;
+    std::vector<Instruction> kept;
+    for (auto it = region.insts.rbegin(); it != region.insts.rend(); ++it) {
+        auto &inst = *it;
+        if (inst.op == "//") {
+            kept.emplace_back(std::move(inst));
+            continue;
+        }
+        if (!isOutput(inst) && !live.count(inst.res.name)) {
+            removed_inst_count++;
+            continue;
+        }
+        if (!isOutput(inst)) {
+            live.erase(inst.res.name);
+        }
+        for (const auto *var : {&inst.lhs, &inst.rhs}) {
+            if (!var->isNone() && (var->prop != VProp::CST || inst.op == "/z3=>var/")) {
+                live.insert(var->name);
+            }
+        }
+        kept.emplace_back(std::move(inst));
+    }
+    region.insts.assign(std::make_move_iterator(kept.rbegin()), std::make_move_iterator(kept.rend()));
+}
+
+void CleanupPass::pruneSymbols() {
+    std::unordered_set<std::string> used;
+    for (const auto &inst : region.insts) {
+        if (inst.op == "//") {
+            continue;
+        }
+        for (const auto *var : {&inst.res, &inst.lhs, &inst.rhs}) {
+            if (!var->isNone()) {
+                used.insert(var->name);
+            }
+        }
+    }
+    removed_symbol_count = std::erase_if(region.sym_tbl, [&](const auto &entry) { return !used.count(entry.first); });
+}
+
+Region CleanupPass::get() { return region; }
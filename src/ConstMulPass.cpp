@@ -0,0 +1,122 @@
+#include "Re-Sc-Masker/ConstMulPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <bit>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+ConstMulPass::ConstMulPass(Region &&origin_region) : origin(std::move(origin_region)) {
+    llvm::errs() << "===ConstMulPass: started===\n";
+    region.sym_tbl = origin.sym_tbl;
+    for (auto &&inst : origin.insts) {
+        auto is_cst = [](const ValueInfo &v) { return v.prop == VProp::CST; };
+        if (inst.op == "*" && is_cst(inst.lhs) != is_cst(inst.rhs)) {
+            const auto &cst = is_cst(inst.lhs) ? inst.lhs : inst.rhs;
+            rewrite(inst, is_cst(inst.lhs) ? inst.rhs : inst.lhs, std::stoull(cst.name, nullptr, 0));
+            continue;
+        }
+        // Products computed from a redefined var (or redefined themselves) are outdated
+        if (!inst.op.starts_with("/")) {
+            std::erase_if(products, [&](const auto &p) {
+                return p.first.first == inst.res.name || p.second.first.name == inst.res.name;
+            });
+        }
+        region.insts.emplace_back(std::move(inst));
+    }
+    llvm::errs() << "===ConstMulPass: " << rewritten_count << " multiplications by constants rewritten===\n";
+}
+
+/// Each run of 1s is replaced by its end minus its start: 0111 == 1000 - 0001,
+/// so that no two nonzero digits are adjacent and their number is minimal
+std::vector<std::pair<bool, int>> ConstMulPass::csdDigits(uint64_t c, int width) {
+    std::vector<std::pair<bool, int>> digits;
+    for (int i = 0; i < width && c; i++, c >>= 1) {
+        if (!(c & 1)) {
+            continue;
+        }
+        if ((c & 3) == 3) {  // the carry out of the top bit is dropped, as the product is taken mod 2^width
+            digits.emplace_back(true, i);
+            c += 1;
+        } else {
+            digits.emplace_back(false, i);
+            c -= 1;
+        }
+    }
+    return digits;
+}
+
+void ConstMulPass::rewrite(const Instruction &inst, const ValueInfo &var, uint64_t c) {
+    const auto width = getBitWidth(inst.res.width);
+    if (width < 64) {
+        c &= (uint64_t(1) << width) - 1;
+    }
+    auto cst = [](uint64_t value) { return ValueInfo{std::to_string(value), 1, VProp::CST, nullptr}; };
+    llvm::errs() << "rewriting: " << inst.toString() << "\n";
+    rewritten_count++;
+
+    // Shift an earlier product of the same var by an odd part of the constant
+    const auto shift = c ? std::countr_zero(c) : 0;
+    const auto odd = c >> shift;
+    auto earlier = std::find_if(products.begin(), products.end(), [&](const auto &p) {
+        return p.first == std::make_pair(var.name, odd) && p.second.second <= shift &&
+               getBitWidth(p.second.first.width) == width;
+    });
+    std::vector<Instruction> insts;
+    if (c == 0) {
+        insts.emplace_back("=", inst.res, cst(0), ValueInfo{});
+    } else if (earlier != products.end()) {
+        insts.emplace_back("<<", inst.res, earlier->second.first, cst(shift - earlier->second.second));
+    } else {
+        // Positive digits first, so that the sum starts from a shifted var instead of a negation
+        auto digits = csdDigits(c, width);
+        std::stable_partition(digits.begin(), digits.end(), [](const auto &d) { return !d.first; });
+        ValueInfo sum;
+        for (size_t i = 0; i < digits.size(); i++) {
+            const auto &[negative, pos] = digits[i];
+            auto res = i + 1 == digits.size() ? inst.res : newTemp(inst.res.width);
+            auto shifted = [&](const ValueInfo &target) {
+                insts.emplace_back(pos > 0 ? "<<" : "=", target, var, pos > 0 ? cst(pos) : ValueInfo{});
+            };
+            if (i == 0 && !negative) {
+                shifted(res);
+                sum = res;
+                continue;
+            }
+            auto term = var;
+            if (pos > 0) {
+                term = newTemp(inst.res.width);
+                shifted(term);
+            }
+            insts.emplace_back(negative ? "-" : "+", res, i == 0 ? cst(0) : sum, term);
+            sum = res;
+        }
+    }
+    for (auto &&i : insts) {
+        region.insts.emplace_back(std::move(i));
+    }
+
+    std::erase_if(products, [&](const auto &p) {
+        return p.first.first == inst.res.name || p.second.first.name == inst.res.name;
+    });
+    if (c && var.name != inst.res.name) {
+        products.emplace_back(std::make_pair(var.name, odd), std::make_pair(inst.res, shift));
+    }
+}
+
+ValueInfo ConstMulPass::newTemp(Width width) {
+    static size_t temp_count = 0;
+    std::string name;
+    do {
+        name = "_cm" + std::to_string(temp_count++);
+    } while (region.sym_tbl.count(name));
+    auto vi = ValueInfo{name, width, VProp::UNK, nullptr};
+    region.sym_tbl[name] = vi;
+    return vi;
+}
+
+Region ConstMulPass::get() { return region; }
@@ -0,0 +1,145 @@
+#include "Re-Sc-Masker/ConstPropPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+ConstPropPass::ConstPropPass(Region &&blasted_region) {
+    region.sym_tbl = std::move(blasted_region.sym_tbl);
+    llvm::errs() << "===ConstPropPass: started===\n";
+    for (auto &&inst : blasted_region.insts) {
+        fold(std::move(inst));
+    }
+    llvm::errs() << "===ConstPropPass: " << folded_count << " instructions folded===\n";
+}
+
+std::string ConstPropPass::constOf(const ValueInfo &var) const {
+    if (var.prop == VProp::CST && (var.name == "0" || var.name == "1")) {
+        return var.name;
+    }
+    auto c = consts.find(var.name);
+    if (c == consts.end()) {
+        return "";
+    }
+    return c->second ? "1" : "0";
+}
+
+void ConstPropPass::fold(Instruction &&inst) {
+    const auto &op = inst.op;
+    if (op == "//" || op == "/clear/") {
+        region.insts.emplace_back(std::move(inst));
+        return;
+    }
+    if (op == "/var=>z3/") {  // a fresh input bit
+        consts.erase(inst.res.name);
+        region.insts.emplace_back(std::move(inst));
+        return;
+    }
+    if (op == "/z3=>var/") {
+        auto c = constOf(inst.lhs);
+        if (c == "0") {  // the var has been cleared already
+            folded_count++;
+            return;
+        }
+        if (c == "1") {
+            inst.lhs = ValueInfo{"1", 1, VProp::CST, nullptr};
+        }
+        region.insts.emplace_back(std::move(inst));
+        return;
+    }
+
+    // Bit-level instructions only from here
+    auto a = constOf(inst.lhs);
+    auto b = inst.isUnaryOp() ? std::string{} : constOf(inst.rhs);
+    auto result = [&](bool value) {
+        consts[inst.res.name] = value;
+        folded_count++;
+    };
+    auto copy = [&](const ValueInfo &from) {
+        consts.erase(inst.res.name);
+        folded_count++;
+        region.insts.emplace_back("=", inst.res, from, ValueInfo{});
+    };
+    auto negate = [&](const ValueInfo &from) {
+        consts.erase(inst.res.name);
+        folded_count++;
+        region.insts.emplace_back("!", inst.res, from, ValueInfo{});
+    };
+
+    if (inst.isUnaryOp()) {
+        if (!a.empty()) {
+            if (op == "=") {
+                result(a == "1");
+            } else if (op == "!" || op == "~") {
+                result(a == "0");
+            }
+            if (op == "=" || op == "!" || op == "~") {
+                return;
+            }
+        }
+    } else if (!a.empty() && !b.empty()) {
+        bool x = a == "1", y = b == "1";
+        if (op == "^") {
+            result(x ^ y);
+            return;
+        } else if (op == "&" || op == "&&") {
+            result(x && y);
+            return;
+        } else if (op == "|" || op == "||") {
+            result(x || y);
+            return;
+        } else if (op == "==") {
+            result(x == y);
+            return;
+        }
+    } else if (!a.empty() || !b.empty()) {
+        // One constant operand
+        bool c = (a.empty() ? b : a) == "1";
+        const auto &x = a.empty() ? inst.lhs : inst.rhs;
+        if (op == "^") {  // x ^ 0 -> x, x ^ 1 -> !x
+            c ? negate(x) : copy(x);
+            return;
+        } else if (op == "&" || op == "&&") {  // x & 0 -> 0, x & 1 -> x
+            c ? copy(x) : result(false);
+            return;
+        } else if (op == "|" || op == "||") {  // x | 1 -> 1, x | 0 -> x
+            c ? result(true) : copy(x);
+            return;
+        } else if (op == "==") {  // x == 1 -> x, x == 0 -> !x
+            c ? copy(x) : negate(x);
+            return;
+        }
+    } else if (inst.lhs.name == inst.rhs.name) {
+        if (op == "^") {  // x ^ x -> 0
+            result(false);
+            return;
+        } else if (op == "==") {
+            result(true);
+            return;
+        } else if (op == "&" || op == "&&" || op == "|" || op == "||") {
+            copy(inst.lhs);
+            return;
+        }
+    }
+
+    // Not foldable: still substitute the constants, whose definitions are gone.
+    // Operands of word ops (e.g. `/add/`) keep their width.
+    if (!a.empty()) {
+        inst.lhs = ValueInfo{a, inst.lhs.width, VProp::CST, nullptr};
+    }
+    if (!b.empty()) {
+        inst.rhs = ValueInfo{b, inst.rhs.width, VProp::CST, nullptr};
+    }
+    consts.erase(inst.res.name);
+    region.insts.emplace_back(std::move(inst));
+}
+
+Region ConstPropPass::get() {
+    llvm::errs() << "const-propagated region:\n";
+    region.dump();
+    return region;
+}
@@ -0,0 +1,71 @@
+#include "Re-Sc-Masker/ParamBindingPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+ParamBindingPass::ParamBindingPass(Region &&origin_region, const Bindings &bindings)
+    : region(std::move(origin_region)) {
+    llvm::errs() << "===ParamBindingPass: started===\n";
+    std::unordered_map<std::string, ValueInfo> constants;
+    for (const auto &[name, value] : bindings) {
+        auto var = region.sym_tbl.find(name);
+        if (var == region.sym_tbl.end() || var->second.prop != VProp::PUB) {
+            llvm::errs() << "Cannot bind " << name << ": not a public param, ignored\n";
+            continue;
+        }
+        auto width = getBitWidth(var->second.width);
+        auto truncated = width < 64 ? value & ((uint64_t(1) << width) - 1) : value;
+        // Every value fits 64 bits, and -2^63 does not fit an int64_t
+        auto fits_signed = isSigned(var->second.width) && int64_t(value) < 0 &&
+                           (width >= 64 || int64_t(value) >= -(int64_t(1) << (width - 1)));
+        if (truncated != value && !fits_signed) {
+            llvm::errs() << "Binding " << name << " = " << value << " truncated to " << width << " bits\n";
+        }
+        llvm::errs() << "bound: " << name << " = " << truncated << "\n";
+        constants.emplace(name, ValueInfo{std::to_string(truncated), var->second.width, VProp::CST, nullptr});
+        bound.insert(name);
+    }
+
+    size_t folded_count = 0;
+    for (auto &inst : region.insts) {
+        if (inst.op.starts_with("/")) {  // comments and pseudo instructions
+            continue;
+        }
+        for (auto *var : {&inst.lhs, &inst.rhs}) {
+            auto cst = constants.find(var->name);
+            if (!var->isNone() && var->prop != VProp::CST && cst != constants.end()) {
+                *var = cst->second;
+                folded_count++;
+            }
+        }
+        // A redefined param no longer holds the bound value
+        constants.erase(inst.res.name);
+    }
+    llvm::errs() << "===ParamBindingPass: " << bound.size() << " params bound, " << folded_count
+                 << " operands replaced===\n";
+}
+
+std::optional<ParamBindingPass::Bindings> ParamBindingPass::parseFile(const std::string &path) {
+    Bindings bindings;
+    auto parsed_all = parseAssignments(path, "name = value", [&](const std::string &name, const std::string &value) {
+        size_t parsed = 0;
+        try {
+            bindings[name] = value.starts_with('-') ? uint64_t(std::stoll(value, &parsed, 0))
+                                                    : std::stoull(value, &parsed, 0);
+        } catch (const std::logic_error &) {
+            return false;
+        }
+        return parsed == value.size();
+    });
+    return parsed_all ? std::optional{std::move(bindings)} : std::nullopt;
+}
+
+Region ParamBindingPass::get() { return region; }
@@ -0,0 +1,393 @@
+#include "Re-Sc-Masker/RandomReusePass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+#include <z3++.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+namespace {
+using RandomSet = std::vector<std::uint64_t>;
+
+void set(RandomSet &s, size_t i) { s[i / 64] |= std::uint64_t{1} << (i % 64); }
+bool test(const RandomSet &s, size_t i) { return s[i / 64] >> (i % 64) & 1; }
+bool any(const RandomSet &s) {
+    for (auto w : s) {
+        if (w) {
+            return true;
+        }
+    }
+    return false;
+}
+bool intersects(const RandomSet &a, const RandomSet &b) {
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] & b[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+/// a \ b is not empty
+bool anyOutside(const RandomSet &a, const RandomSet &b) {
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] & ~b[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+RandomReusePass::RandomReusePass(const ValueInfo &return_var, Region &&masked_region,
+                                 const std::vector<std::string> &params, const RandomReuseOptions &opts)
+    : region(std::move(masked_region)) {
+    llvm::errs() << "===RandomReusePass: started===\n";
+    buildNodes(return_var, params);
+    pinUnknowns(opts);
+    mergeRandoms();
+
+    // Rename merged random bits, read directly by name
+    for (auto &inst : region.insts) {
+        for (auto *var : {&inst.lhs, &inst.rhs}) {
+            auto leaf = leaves.find(var->name);
+            if (leaf == leaves.end() || nodes[leaf->second].random < 0) {
+                continue;
+            }
+            auto random = static_cast<size_t>(nodes[leaf->second].random);
+            if (merged_into[random] != random) {
+                var->name = nodes[random_nodes[merged_into[random]]].name;
+            }
+        }
+    }
+    for (size_t random = 0; random < random_nodes.size(); random++) {
+        if (merged_into[random] != random) {
+            region.sym_tbl.erase(nodes[random_nodes[random]].name);
+        }
+    }
+    llvm::errs() << "===RandomReusePass: " << plain_count << " unknown values hold plain values, " << pinned_count
+                 << " are pinned; " << merged_count << " of " << random_nodes.size() << " random bits merged===\n";
+}
+
+void RandomReusePass::buildNodes(const ValueInfo &return_var, const std::vector<std::string> &params) {
+    std::unordered_set<std::string> param_names(params.begin(), params.end());
+    // An output bit holds its final value if the output is cleared once and the bit is written once
+    std::unordered_map<std::string, size_t> clear_counts, write_counts;
+    for (const auto &inst : region.insts) {
+        if (inst.op == "/clear/") {
+            clear_counts[inst.res.name]++;
+        } else if (inst.op == "/z3=>var/") {
+            write_counts[inst.res.name + "#" + inst.rhs.name]++;
+        }
+    }
+    auto isOutput = [&](const std::string &word) {
+        auto symbol = region.sym_tbl.find(word);
+        return word == return_var.name || (symbol != region.sym_tbl.end() && symbol->second.prop == VProp::OUTPUT);
+    };
+    std::unordered_set<std::string> cleared;
+    /// Node holding the current value of each bit or word defined in the region
+    std::unordered_map<std::string, int> current;
+    auto operand = [&](const ValueInfo &var) {
+        if (var.isNone()) {
+            return -1;
+        }
+        auto node = current.find(var.name);
+        if (node != current.end()) {
+            return node->second;
+        }
+        auto symbol = region.sym_tbl.find(var.name);
+        auto prop = symbol == region.sym_tbl.end() ? var.prop : symbol->second.prop;
+        return leafOf(var.name, prop, !param_names.count(var.name));
+    };
+
+    for (const auto &inst : region.insts) {
+        const auto &op = inst.op;
+        if (op == "//") {
+            continue;
+        }
+        Node node{NodeKind::Opaque, -1, -1, "", VProp::UNK, -1};
+        if (op == "/clear/") {  // a constant word
+            cleared.insert(inst.res.name);
+        } else if (op == "/var=>z3/") {
+            auto word = current.find(inst.lhs.name);
+            if (word == current.end()) {  // a bit of a param, random bits of params are never renamed
+                auto symbol = region.sym_tbl.find(inst.lhs.name);
+                auto prop = symbol == region.sym_tbl.end() ? inst.lhs.prop : symbol->second.prop;
+                current[inst.res.name] = leafOf(inst.lhs.name + "#" + inst.rhs.name, prop, false);
+                continue;
+            }
+            node.kind = NodeKind::Extract;
+            node.lhs = word->second;
+        } else if (op == "/z3=>var/") {
+            node.kind = NodeKind::Assemble;
+            node.lhs = operand(inst.res);
+            node.rhs = operand(inst.lhs);
+            if (isOutput(inst.res.name) && cleared.count(inst.res.name) && clear_counts[inst.res.name] == 1 &&
+                write_counts[inst.res.name + "#" + inst.rhs.name] == 1) {
+                output_bits.insert(node.rhs);
+            }
+        } else {
+            if (op == "=") {
+                node.kind = NodeKind::Copy;
+            } else if (op == "!" || op == "~") {
+                node.kind = NodeKind::Not;
+            } else if (op == "^") {
+                node.kind = NodeKind::Xor;
+            } else if (op == "==") {
+                node.kind = NodeKind::Eq;
+            } else if (op == "&" || op == "&&") {
+                node.kind = NodeKind::And;
+            } else if (op == "|" || op == "||") {
+                node.kind = NodeKind::Or;
+            }
+            node.lhs = operand(inst.lhs);
+            node.rhs = operand(inst.rhs);
+        }
+        nodes.push_back(std::move(node));
+        current[inst.res.name] = static_cast<int>(nodes.size() - 1);
+    }
+
+    auto words = (random_nodes.size() + 63) / 64;
+    none = Fact{RandomSet(words), RandomSet(words), false, Dist::SecretIndep};
+    for (const auto &node : nodes) {
+        if (node.kind == NodeKind::Leaf) {
+            facts.push_back(leafFact(node, node.random));
+        } else {
+            facts.push_back(infer(node, node.lhs < 0 ? none : facts[node.lhs], node.rhs < 0 ? none : facts[node.rhs]));
+        }
+    }
+    conflicts.assign(random_nodes.size(), RandomSet(words));
+    scratch.resize(nodes.size());
+    stamps.assign(nodes.size(), 0);
+}
+
+int RandomReusePass::leafOf(const std::string &name, VProp prop, bool is_fresh) {
+    auto [leaf, inserted] = leaves.try_emplace(name, static_cast<int>(nodes.size()));
+    if (!inserted) {
+        return leaf->second;
+    }
+    Node node{NodeKind::Leaf, -1, -1, name, name == "0" || name == "1" ? VProp::CST : prop, -1};
+    if (node.prop == VProp::RND) {
+        node.random = static_cast<int>(random_nodes.size());
+        random_nodes.push_back(leaf->second);
+        fresh.push_back(is_fresh);
+    }
+    nodes.push_back(std::move(node));
+    return leaf->second;
+}
+
+/// A random bit is uniform, public bits and constants are secret-independent.
+/// Bits of any other class are secret.
+RandomReusePass::Fact RandomReusePass::leafFact(const Node &leaf, size_t random) const {
+    auto fact = none;
+    if (leaf.prop == VProp::RND) {
+        set(fact.deps, random);
+        set(fact.masks, random);
+        fact.dist = Dist::Uniform;
+    } else if (leaf.prop != VProp::PUB && leaf.prop != VProp::CST) {
+        fact.secret = true;
+        fact.dist = Dist::Unknown;
+    }
+    return fact;
+}
+
+/// A random bit masking an operand of XOR perfectly still masks the result if the other operand does not depend on
+/// it. A function of two values is secret-independent if both are and they depend on disjoint random bits, or if one
+/// is masked perfectly by a random bit the other does not depend on.
+RandomReusePass::Fact RandomReusePass::infer(const Node &node, const Fact &lhs, const Fact &rhs) const {
+    if (node.kind == NodeKind::Copy || node.kind == NodeKind::Not) {
+        return lhs;
+    }
+    Fact fact = none;
+    for (size_t i = 0; i < fact.deps.size(); i++) {
+        fact.deps[i] = lhs.deps[i] | rhs.deps[i];
+        if (node.kind == NodeKind::Xor || node.kind == NodeKind::Eq) {
+            fact.masks[i] = (lhs.masks[i] & ~rhs.deps[i]) | (rhs.masks[i] & ~lhs.deps[i]);
+        }
+    }
+    fact.secret = lhs.secret || rhs.secret;
+    if (any(fact.masks)) {
+        fact.dist = Dist::Uniform;
+    } else if (!fact.secret) {
+        fact.dist = Dist::SecretIndep;
+    } else if (lhs.dist != Dist::Unknown && rhs.dist != Dist::Unknown &&
+               (!intersects(lhs.deps, rhs.deps) || anyOutside(lhs.masks, rhs.deps) ||
+                anyOutside(rhs.masks, lhs.deps))) {
+        fact.dist = Dist::SecretIndep;
+    } else {
+        fact.dist = Dist::Unknown;
+    }
+    return fact;
+}
+
+/// Each bit is evaluated twice, over two independent copies of the random bits: on 64 random samples first, then in
+/// Z3 if the samples agree. A bit equal in both copies does not depend on random bits, nor does an output bit or any
+/// value computed from such bits only.
+void RandomReusePass::pinUnknowns(const RandomReuseOptions &opts) {
+    z3::context ctx;
+    z3::solver solver(ctx);
+    if (opts.solver_timeout_ms) {
+        z3::params p(ctx);
+        p.set("timeout", opts.solver_timeout_ms);
+        solver.set(p);
+    }
+    std::vector<std::uint64_t> samples[2];
+    z3::expr_vector copies[2] = {z3::expr_vector(ctx), z3::expr_vector(ctx)};
+    std::mt19937_64 rng(0);
+    /// Whether each node does not depend on random bits
+    std::vector<bool> exact(nodes.size());
+
+    for (size_t id = 0; id < nodes.size(); id++) {
+        const auto &node = nodes[id];
+        // Words are not evaluated, each copy of them is an arbitrary value
+        auto is_word =
+            node.kind == NodeKind::Extract || node.kind == NodeKind::Assemble || node.kind == NodeKind::Opaque;
+        std::uint64_t noises[2] = {rng(), rng()};
+        auto sample = [&](int copy) -> std::uint64_t {
+            auto lhs = node.lhs < 0 ? 0 : samples[copy][node.lhs];
+            auto rhs = node.rhs < 0 ? 0 : samples[copy][node.rhs];
+            switch (node.kind) {
+                case NodeKind::Leaf:
+                    if (node.prop == VProp::CST) {
+                        return node.name == "1" ? ~std::uint64_t{0} : 0;
+                    }
+                    return noises[node.random >= 0 ? copy : 0];
+                case NodeKind::Copy:
+                    return lhs;
+                case NodeKind::Not:
+                    return ~lhs;
+                case NodeKind::Xor:
+                    return lhs ^ rhs;
+                case NodeKind::Eq:
+                    return ~(lhs ^ rhs);
+                case NodeKind::And:
+                    return lhs & rhs;
+                case NodeKind::Or:
+                    return lhs | rhs;
+                default:
+                    return noises[copy];
+            }
+        };
+        auto encode = [&](int copy) -> z3::expr {
+            auto name = std::to_string(id);
+            auto lhs = node.lhs < 0 ? ctx.bool_val(false) : copies[copy][node.lhs];
+            auto rhs = node.rhs < 0 ? ctx.bool_val(false) : copies[copy][node.rhs];
+            switch (node.kind) {
+                case NodeKind::Leaf:
+                    if (node.prop == VProp::CST) {
+                        return ctx.bool_val(node.name == "1");
+                    }
+                    return ctx.bool_const(((node.random >= 0 && copy ? "r'" : "l") + name).c_str());
+                case NodeKind::Copy:
+                    return lhs;
+                case NodeKind::Not:
+                    return !lhs;
+                case NodeKind::Xor:
+                    return lhs ^ rhs;
+                case NodeKind::Eq:
+                    return lhs == rhs;
+                case NodeKind::And:
+                    return lhs && rhs;
+                case NodeKind::Or:
+                    return lhs || rhs;
+                default:
+                    return ctx.bool_const(((copy ? "w'" : "w") + name).c_str());
+            }
+        };
+
+        if (node.kind == NodeKind::Leaf) {
+            exact[id] = node.random < 0;
+        } else {
+            exact[id] = (node.lhs < 0 || exact[node.lhs]) && (node.rhs < 0 || exact[node.rhs]);
+        }
+        samples[0].push_back(sample(0));
+        copies[0].push_back(encode(0));
+        if (!exact[id] && facts[id].dist == Dist::Unknown) {
+            exact[id] = output_bits.count(static_cast<int>(id));
+            if (!exact[id] && !is_word && sample(1) == samples[0][id]) {
+                solver.push();
+                solver.add(copies[0][id] != encode(1));
+                exact[id] = solver.check() == z3::unsat;
+                solver.pop();
+            }
+            if (exact[id]) {
+                plain_count++;
+            } else {
+                pinned_count++;
+                const auto &deps = facts[id].deps;
+                for (size_t random = 0; random < random_nodes.size(); random++) {
+                    if (test(deps, random)) {
+                        for (size_t i = 0; i < deps.size(); i++) {
+                            conflicts[random][i] |= deps[i];
+                        }
+                    }
+                }
+            }
+        }
+        samples[1].push_back(exact[id] ? samples[0][id] : sample(1));
+        copies[1].push_back(exact[id] ? copies[0][id] : encode(1));
+    }
+}
+
+void RandomReusePass::mergeRandoms() {
+    /// Random bits kept, and those merged into each of them
+    std::vector<size_t> kept;
+    std::vector<RandomSet> members(random_nodes.size());
+    for (size_t random = 0; random < random_nodes.size(); random++) {
+        merged_into.push_back(random);
+        if (!fresh[random]) {
+            continue;
+        }
+        // Only values depending on the random bit may be typed differently
+        std::vector<int> cone;
+        for (auto id = random_nodes[random] + 1; id < static_cast<int>(nodes.size()); id++) {
+            if (test(facts[id].deps, random)) {
+                cone.push_back(id);
+            }
+        }
+        for (auto into : kept) {
+            if (!intersects(conflicts[random], members[into]) && tryMerge(random, into, cone)) {
+                merged_into[random] = into;
+                set(members[into], random);
+                merged_count++;
+                break;
+            }
+        }
+        if (merged_into[random] == random) {
+            kept.push_back(random);
+            members[random] = none.deps;
+            set(members[random], random);
+        }
+    }
+}
+
+bool RandomReusePass::tryMerge(size_t random, size_t into, const std::vector<int> &cone) {
+    try_count++;
+    auto leaf = random_nodes[random];
+    scratch[leaf] = leafFact(nodes[leaf], into);
+    stamps[leaf] = try_count;
+    auto factOf = [&](int id) -> const Fact & {
+        return id < 0 ? none : stamps[id] == try_count ? scratch[id] : facts[id];
+    };
+    for (auto id : cone) {
+        auto fact = infer(nodes[id], factOf(nodes[id].lhs), factOf(nodes[id].rhs));
+        if (fact.dist == Dist::Unknown && facts[id].dist != Dist::Unknown) {
+            return false;
+        }
+        scratch[id] = std::move(fact);
+        stamps[id] = try_count;
+    }
+    facts[leaf] = std::move(scratch[leaf]);
+    for (auto id : cone) {
+        facts[id] = std::move(scratch[id]);
+    }
+    return true;
+}
+
+Region RandomReusePass::get() { return region; }
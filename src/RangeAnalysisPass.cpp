@@ -0,0 +1,245 @@
+#include "Re-Sc-Masker/RangeAnalysisPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Re-Sc-Masker/LookupTable.hpp"
+#include "Re-Sc-Masker/Preludes.hpp"
+
+RangeAnalysisPass::RangeAnalysisPass(const ValueInfo &ret, Region &&origin_region)
+    : region(std::move(origin_region)), ret(ret) {
+    llvm::errs() << "===RangeAnalysisPass: started===\n";
+
+    // Forward pass: the region has no branches, so every def is visited once in program order
+    std::unordered_map<std::string, int> declared;
+    for (const auto &inst : region.insts) {
+        if (inst.op.starts_with("/")) {  // comments and pseudo instructions
+            continue;
+        }
+        auto range = transfer(inst);
+        auto bits = transferBits(inst);
+        // Bits above the range are 0, and the value is at most its maybe-one bits and at least its one bits
+        bits.zeros |= range.hi ? ~(~uint64_t(0) >> std::countl_zero(range.hi)) : ~uint64_t(0);
+        range = Range{std::max(range.lo, bits.ones), std::min(range.hi, ~bits.zeros)};
+        ranges[inst.res.name] = range;
+        known_bits[inst.res.name] = bits;
+        if (narrowable(inst.res)) {
+            auto &sig = sig_widths[inst.res.name];
+            sig = std::max(sig, int(std::bit_width(range.hi)));
+            declared[inst.res.name] = getBitWidth(inst.res.width);
+        }
+    }
+
+    // Keep only the vars which actually get narrower
+    size_t saved_bits = 0;
+    for (auto it = sig_widths.begin(); it != sig_widths.end();) {
+        auto &[name, sig] = *it;
+        sig = std::max(sig, 1);
+        auto width = declared[name];
+        if (sig >= width) {
+            it = sig_widths.erase(it);
+            continue;
+        }
+        llvm::errs() << "narrowed: " << name << " " << width << " -> " << sig << " bits\n";
+        saved_bits += width - sig;
+        ++it;
+    }
+
+    for (auto &[name, var] : region.sym_tbl) {
+        narrow(var);
+    }
+    for (auto &inst : region.insts) {
+        narrow(inst.res);
+        narrow(inst.lhs);
+        narrow(inst.rhs);
+    }
+    llvm::errs() << "===RangeAnalysisPass: " << sig_widths.size() << " vars narrowed, " << saved_bits
+                 << " bits saved===\n";
+}
+
+RangeAnalysisPass::Range RangeAnalysisPass::full(Width width) {
+    auto bits = getBitWidth(width);
+    return Range{0, bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1};
+}
+
+RangeAnalysisPass::Range RangeAnalysisPass::rangeOf(const ValueInfo &var) const {
+    if (var.prop == VProp::CST) {
+        uint64_t value = std::stoull(var.name, nullptr, 0);
+        return Range{value, value};
+    }
+    if (isSigned(var.width)) {  // may be sign-extended by its users
+        return full(64);
+    }
+    auto range = ranges.find(var.name);
+    if (range == ranges.end()) {  // inputs and vars not defined yet
+        return full(var.width);
+    }
+    return range->second;
+}
+
+/// Range of the result of an instruction, or the full range of its type if it may wrap around
+RangeAnalysisPass::Range RangeAnalysisPass::transfer(const Instruction &inst) const {
+    if (isSigned(inst.res.width)) {
+        return full(64);
+    }
+    const auto top = full(inst.res.width);
+    auto fit = [&](Range r) { return r.hi <= top.hi ? r : top; };
+    auto ones = [](uint64_t hi) { return hi ? ~uint64_t(0) >> std::countl_zero(hi) : 0; };
+
+    const auto &op = inst.op;
+    if (op == "[]") {  // up to the largest entry
+        uint64_t hi = 0;
+        for (auto entry : LookupTable::all().at(inst.lhs.name).entries) {
+            hi = std::max(hi, entry & top.hi);
+        }
+        return Range{0, hi};
+    }
+    auto a = rangeOf(inst.lhs);
+    auto b = inst.isUnaryOp() ? Range{0, 0} : rangeOf(inst.rhs);
+    if (op == "=") {
+        return fit(a);
+    } else if (op == "&") {
+        return fit(Range{0, std::min(a.hi, b.hi)});
+    } else if (op == "|") {
+        return fit(Range{std::max(a.lo, b.lo), ones(std::max(a.hi, b.hi))});
+    } else if (op == "^") {
+        return fit(Range{0, ones(std::max(a.hi, b.hi))});
+    } else if (op == "+") {
+        uint64_t lo, hi;
+        if (__builtin_add_overflow(a.hi, b.hi, &hi)) {
+            return top;
+        }
+        lo = a.lo + b.lo;
+        return fit(Range{lo, hi});
+    } else if (op == "-") {
+        if (a.lo < b.hi) {  // may borrow
+            return top;
+        }
+        return fit(Range{a.lo - b.hi, a.hi - b.lo});
+    } else if (op == "*") {
+        uint64_t hi;
+        if (__builtin_mul_overflow(a.hi, b.hi, &hi)) {
+            return top;
+        }
+        return fit(Range{a.lo * b.lo, hi});
+    } else if (op == "<<") {
+        if (b.lo != b.hi || b.hi >= 64 || (a.hi << b.hi) >> b.hi != a.hi) {
+            return top;
+        }
+        return fit(Range{a.lo << b.hi, a.hi << b.hi});
+    } else if (op == ">>") {
+        if (isSigned(inst.lhs.width)) {
+            return top;
+        }
+        if (b.lo != b.hi) {
+            return fit(Range{0, a.hi});
+        }
+        if (b.hi >= 64) {
+            return Range{0, 0};
+        }
+        return fit(Range{a.lo >> b.hi, a.hi >> b.hi});
+    } else if (op == "!" || op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=" ||
+               op == "&&" || op == "||") {
+        return fit(Range{0, 1});
+    }
+    return top;
+}
+
+RangeAnalysisPass::KnownBits RangeAnalysisPass::knownBitsOf(const ValueInfo &var) const {
+    if (var.prop == VProp::CST) {
+        uint64_t value = std::stoull(var.name, nullptr, 0);
+        return KnownBits{~value, value};
+    }
+    if (isSigned(var.width)) {
+        return KnownBits{0, 0};
+    }
+    auto bits = known_bits.find(var.name);
+    if (bits == known_bits.end()) {
+        return KnownBits{~full(var.width).hi, 0};
+    }
+    return bits->second;
+}
+
+/// Known bits of the result of an instruction; all of them are unknown for ops not modeled
+RangeAnalysisPass::KnownBits RangeAnalysisPass::transferBits(const Instruction &inst) const {
+    if (isSigned(inst.res.width)) {
+        return KnownBits{0, 0};
+    }
+    const auto top = full(inst.res.width).hi;
+    auto fit = [&](KnownBits k) { return KnownBits{k.zeros | ~top, k.ones & top}; };
+    auto low = [](int n) { return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1; };
+
+    const auto &op = inst.op;
+    if (op == "[]") {  // bits common to all entries
+        KnownBits k{~uint64_t(0), ~uint64_t(0)};
+        for (auto entry : LookupTable::all().at(inst.lhs.name).entries) {
+            k = KnownBits{k.zeros & ~entry, k.ones & entry};
+        }
+        return fit(k);
+    }
+    auto a = knownBitsOf(inst.lhs);
+    auto b = inst.isUnaryOp() ? KnownBits{~uint64_t(0), 0} : knownBitsOf(inst.rhs);
+    // Shift amount, if known
+    auto amount = (b.zeros | b.ones) == ~uint64_t(0) ? std::optional{b.ones} : std::nullopt;
+    if (op == "=") {
+        return fit(a);
+    } else if (op == "&") {
+        return fit(KnownBits{a.zeros | b.zeros, a.ones & b.ones});
+    } else if (op == "|") {
+        return fit(KnownBits{a.zeros & b.zeros, a.ones | b.ones});
+    } else if (op == "^") {
+        return fit(KnownBits{(a.zeros & b.zeros) | (a.ones & b.ones), (a.zeros & b.ones) | (a.ones & b.zeros)});
+    } else if (op == "~") {
+        return fit(KnownBits{a.ones, a.zeros});
+    } else if (op == "+" || op == "-") {  // trailing zeros common to both operands stay zero
+        return fit(KnownBits{low(std::min(std::countr_one(a.zeros), std::countr_one(b.zeros))), 0});
+    } else if (op == "*") {
+        return fit(KnownBits{low(std::countr_one(a.zeros) + std::countr_one(b.zeros)), 0});
+    } else if (op == "<<") {
+        if (!amount) {
+            return fit(KnownBits{low(std::countr_one(a.zeros)), 0});
+        }
+        if (*amount >= 64) {
+            return fit(KnownBits{~uint64_t(0), 0});
+        }
+        return fit(KnownBits{(a.zeros << *amount) | low(int(*amount)), a.ones << *amount});
+    } else if (op == ">>") {
+        if (isSigned(inst.lhs.width)) {
+            return fit(KnownBits{0, 0});
+        }
+        if (!amount) {
+            return fit(KnownBits{~low(64 - std::countl_one(a.zeros)), 0});
+        }
+        if (*amount >= 64) {
+            return fit(KnownBits{~uint64_t(0), 0});
+        }
+        return fit(KnownBits{(a.zeros >> *amount) | ~(~uint64_t(0) >> *amount), a.ones >> *amount});
+    } else if (op == "!" || op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=" ||
+               op == "&&" || op == "||") {
+        return fit(KnownBits{~uint64_t(1), 0});
+    }
+    return fit(KnownBits{0, 0});
+}
+
+/// Only unsigned locals can be narrowed: other vars are visible outside of the region
+bool RangeAnalysisPass::narrowable(const ValueInfo &var) const {
+    return var.prop == VProp::UNK && !isSigned(var.width) && var.name != ret.name;
+}
+
+void RangeAnalysisPass::narrow(ValueInfo &var) const {
+    if (var.isNone() || var.prop == VProp::CST) {
+        return;
+    }
+    auto sig = sig_widths.find(var.name);
+    if (sig != sig_widths.end()) {
+        var.width = sig->second;
+    }
+}
+
+Region RangeAnalysisPass::get() { return region; }
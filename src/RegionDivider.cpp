@@ -1,14 +1,258 @@
 #include "Re-Sc-Masker/RegionDivider.hpp"
 
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Re-Sc-Masker/Preludes.hpp"
 
-// TODO: should be trivial divider + no divider
-
 TrivialRegionDivider::TrivialRegionDivider(Region &&global_region) : global_sym_tbl(std::move(global_region.sym_tbl)) {
     for (auto &&inst : global_region.insts) {
         // each instruction is a region
         regions.emplace_back(std::vector<Instruction>{std::move(inst)});
     }
 }
+
+namespace {
+bool isBitGate(const Instruction &inst) {
+    static const std::vector<std::string> GATES = {"^", "==", "&", "&&", "|", "||", "!", "~"};
+    return inst.res.width == 1 && inst.res.prop != VProp::PUB &&
+           std::find(GATES.begin(), GATES.end(), inst.op) != GATES.end();
+}
+
+/// Constants and bit indices, which are never written
+bool isNumber(const std::string &name) {
+    return std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+}  // namespace
+
+ConeRegionDivider::ConeRegionDivider(Region &&global_region, unsigned max_inputs)
+    : global_sym_tbl(std::move(global_region.sym_tbl)) {
+    auto &insts = global_region.insts;
+    std::unordered_map<std::string, int> def_counts, use_counts;
+    for (const auto &inst : insts) {
+        def_counts[inst.res.name]++;
+        use_counts[inst.lhs.name]++;
+        if (!inst.isUnaryOp()) {
+            use_counts[inst.rhs.name]++;
+        }
+    }
+
+    // Instructions of the cone rooted at each gate, and the bits it reads
+    std::vector<std::vector<size_t>> cones(insts.size());
+    std::vector<std::vector<std::string>> leaves(insts.size());
+    std::vector<bool> absorbed(insts.size());
+    // Gate defining each bit, if it is defined once
+    std::unordered_map<std::string, size_t> gates;
+    size_t cone_count = 0;
+    for (size_t i = 0; i < insts.size(); i++) {
+        const auto &inst = insts[i];
+        if (!isBitGate(inst)) {
+            continue;
+        }
+        cones[i] = {i};
+        std::vector<std::string> operands{inst.lhs.name};
+        if (!inst.isUnaryOp() && inst.rhs.name != inst.lhs.name) {
+            operands.push_back(inst.rhs.name);
+        }
+        for (size_t t = 0; t < operands.size(); t++) {
+            auto merged = leaves[i];
+            auto add = [&merged](const std::string &bit) {
+                if (std::find(merged.begin(), merged.end(), bit) == merged.end()) {
+                    merged.push_back(bit);
+                }
+            };
+            // Moved down to the root, a cone must read bits defined once
+            auto gate = gates.find(operands[t]);
+            if (gate != gates.end() && !absorbed[gate->second] && use_counts[operands[t]] == 1 &&
+                std::all_of(leaves[gate->second].begin(), leaves[gate->second].end(),
+                            [&](const auto &bit) { return def_counts[bit] <= 1; })) {
+                for (const auto &bit : leaves[gate->second]) {
+                    add(bit);
+                }
+                // The operands left read one bit each at least
+                auto with_cone = merged;
+                for (auto u = t + 1; u < operands.size(); u++) {
+                    add(operands[u]);
+                }
+                if (merged.size() <= max_inputs) {
+                    absorbed[gate->second] = true;
+                    cones[i].insert(cones[i].end(), cones[gate->second].begin(), cones[gate->second].end());
+                    leaves[i] = std::move(with_cone);
+                    continue;
+                }
+            }
+            if (std::find(leaves[i].begin(), leaves[i].end(), operands[t]) == leaves[i].end()) {
+                leaves[i].push_back(operands[t]);
+            }
+        }
+        if (def_counts[inst.res.name] == 1) {
+            gates[inst.res.name] = i;
+        }
+    }
+
+    for (size_t i = 0; i < insts.size(); i++) {
+        if (absorbed[i]) {
+            continue;
+        }
+        if (cones[i].size() < 2) {
+            regions.emplace_back(std::vector<Instruction>{std::move(insts[i])});
+            continue;
+        }
+        std::sort(cones[i].begin(), cones[i].end());
+        std::vector<Instruction> cone;
+        for (auto j : cones[i]) {
+            cone.emplace_back(std::move(insts[j]));
+        }
+        regions.emplace_back(std::move(cone));
+        cone_count++;
+    }
+    llvm::errs() << "===ConeRegionDivider: " << regions.size() << " regions, " << cone_count << " cones===\n";
+}
+
+PartitionRegionDivider::PartitionRegionDivider(Region &&global_region, size_t region_size)
+    : global_sym_tbl(std::move(global_region.sym_tbl)) {
+    auto &insts = global_region.insts;
+    // Comments go along with the instruction after them, as units
+    std::vector<size_t> unit_starts;
+    for (size_t i = 0; i < insts.size(); i++) {
+        if (unit_starts.empty() || insts[i - 1].op != "//") {
+            unit_starts.push_back(i);
+        }
+    }
+    const auto units = unit_starts.size();
+    unit_starts.push_back(insts.size());
+
+    // Edges from the last write of each bit to its reads and next write, and from the reads to the next write
+    std::vector<std::vector<size_t>> preds(units), succs(units);
+    std::unordered_map<std::string, size_t> last_writes;
+    std::unordered_map<std::string, std::vector<size_t>> reads;
+    auto add_edge = [&](size_t from, size_t to) {
+        if (from != to) {
+            preds[to].push_back(from);
+            succs[from].push_back(to);
+        }
+    };
+    for (size_t u = 0; u < units; u++) {
+        for (auto i = unit_starts[u]; i < unit_starts[u + 1]; i++) {
+            const auto &inst = insts[i];
+            if (inst.op == "//") {
+                continue;
+            }
+            for (const auto *operand : {&inst.lhs, &inst.rhs}) {
+                if (isNumber(operand->name)) {
+                    continue;
+                }
+                if (auto write = last_writes.find(operand->name); write != last_writes.end()) {
+                    add_edge(write->second, u);
+                }
+                reads[operand->name].push_back(u);
+            }
+            if (auto write = last_writes.find(inst.res.name); write != last_writes.end()) {
+                add_edge(write->second, u);
+            }
+            for (auto read : reads[inst.res.name]) {
+                add_edge(read, u);
+            }
+            reads[inst.res.name].clear();
+            last_writes[inst.res.name] = u;
+        }
+    }
+
+    const auto part_count = std::max<size_t>(1, region_size ? (units + region_size - 1) / region_size : units);
+    const auto target = (units + part_count - 1) / std::max<size_t>(1, part_count);
+    std::vector<size_t> parts(units), sizes(part_count);
+
+    // Greedy growing: the ready unit with the most predecessors in the current part, the earliest on ties
+    std::vector<size_t> waiting(units), affinity(units), affinity_parts(units);
+    std::set<std::pair<size_t, size_t>, std::greater<>> ready;  // (affinity, -unit)
+    auto key = [&](size_t u) { return std::pair{affinity[u], units - u}; };
+    for (size_t u = 0; u < units; u++) {
+        waiting[u] = preds[u].size();
+        if (!waiting[u]) {
+            ready.insert(key(u));
+        }
+    }
+    size_t part = 0;
+    while (!ready.empty()) {
+        if (sizes[part] == target && part + 1 < part_count) {
+            part++;
+            std::set<std::pair<size_t, size_t>, std::greater<>> reset;
+            for (auto [_, rank] : ready) {
+                affinity[units - rank] = 0;
+                reset.insert(key(units - rank));
+            }
+            ready = std::move(reset);
+        }
+        auto u = units - ready.begin()->second;
+        ready.erase(ready.begin());
+        parts[u] = part;
+        sizes[part]++;
+        for (auto s : succs[u]) {
+            affinity[s] = affinity_parts[s] == part ? affinity[s] + 1 : 1;
+            affinity_parts[s] = part;
+            if (--waiting[s] == 0) {
+                ready.insert(key(s));
+            }
+        }
+    }
+
+    // Refinement: a unit moves to an adjacent part if it cuts fewer edges, keeps the parts ordered along the edges
+    // and the parts within 10% of the target size
+    const auto slack = std::max<size_t>(1, target / 10);
+    auto edges_to = [&](size_t u, size_t p) {
+        auto in_p = [&](size_t v) { return parts[v] == p; };
+        return std::count_if(preds[u].begin(), preds[u].end(), in_p) +
+               std::count_if(succs[u].begin(), succs[u].end(), in_p);
+    };
+    for (auto pass = 0; pass < 4; pass++) {
+        auto moved = false;
+        for (size_t u = 0; u < units; u++) {
+            auto p = parts[u];
+            if (sizes[p] <= target - std::min(target, slack)) {
+                continue;
+            }
+            auto in_p = [&](size_t v) { return parts[v] == p; };
+            auto stay = edges_to(u, p);
+            if (p + 1 < part_count && sizes[p + 1] < target + slack &&
+                std::none_of(succs[u].begin(), succs[u].end(), in_p) && edges_to(u, p + 1) > stay) {
+                parts[u] = p + 1;
+            } else if (p > 0 && sizes[p - 1] < target + slack &&
+                       std::none_of(preds[u].begin(), preds[u].end(), in_p) && edges_to(u, p - 1) > stay) {
+                parts[u] = p - 1;
+            } else {
+                continue;
+            }
+            sizes[p]--;
+            sizes[parts[u]]++;
+            moved = true;
+        }
+        if (!moved) {
+            break;
+        }
+    }
+
+    std::vector<std::vector<Instruction>> part_insts(part_count);
+    for (size_t u = 0; u < units; u++) {
+        for (auto i = unit_starts[u]; i < unit_starts[u + 1]; i++) {
+            part_insts[parts[u]].emplace_back(std::move(insts[i]));
+        }
+    }
+    for (auto &part_inst : part_insts) {
+        if (!part_inst.empty()) {
+            regions.emplace_back(std::move(part_inst));
+        }
+    }
+    size_t edges = 0, cut = 0;
+    for (size_t u = 0; u < units; u++) {
+        edges += succs[u].size();
+        cut += std::count_if(succs[u].begin(), succs[u].end(), [&](size_t v) { return parts[v] != parts[u]; });
+    }
+    llvm::errs() << "===PartitionRegionDivider: " << regions.size() << " regions of "
+                 << *std::max_element(sizes.begin(), sizes.end()) << " instructions at most, " << cut << "/" << edges
+                 << " edges cut===\n";
+}
@@ -0,0 +1,415 @@
+#include "Re-Sc-Masker/RegionSynthesizer.hpp"
+
+#include <z3++.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "Re-Sc-Masker/GadgetTemplates.hpp"
+
+namespace {
+/// Most ops of a synthesized program
+constexpr unsigned MAX_OPS = 16;
+
+/// Boolean variables named `name` + `i`, for i < n
+std::vector<z3::expr> boolConsts(z3::context &ctx, const std::string &name, unsigned n) {
+    std::vector<z3::expr> vars;
+    for (unsigned i = 0; i < n; i++) {
+        vars.push_back(ctx.bool_const((name + std::to_string(i)).c_str()));
+    }
+    return vars;
+}
+
+z3::expr mkOr(z3::context &ctx, const std::vector<z3::expr> &es) {
+    z3::expr_vector v(ctx);
+    for (const auto &e : es) {
+        v.push_back(e);
+    }
+    return es.empty() ? ctx.bool_val(false) : z3::mk_or(v);
+}
+
+/// A signal of `search`, as the algebraic normal form of its value over the variables
+struct Signal {
+    /// Coefficients of the variables, and of the products of two of them
+    std::vector<z3::expr> linear, quadratic;
+    /// The distribution of its value does not depend on the inputs
+    z3::expr independent;
+};
+
+/// Value of each signal of `program` at point p of `search`
+std::vector<bool> run(const MaskedProgram &program, unsigned inputs, unsigned p) {
+    const auto x = p >> (inputs + program.randoms), m = (p >> program.randoms) & ((1u << inputs) - 1);
+    std::vector<bool> values;
+    for (unsigned i = 0; i < inputs; i++) {
+        values.push_back(((x ^ m) >> i) & 1);
+        values.push_back((m >> i) & 1);
+    }
+    for (unsigned j = 0; j < program.randoms; j++) {
+        values.push_back((p >> j) & 1);
+    }
+    for (const auto &op : program.ops) {
+        auto a = values[op.lhs], b = values[op.rhs];
+        values.push_back(op.op == "&&" ? a && b : op.op == "^" ? a != b : !a);
+    }
+    return values;
+}
+
+/// `program` with each op computing the same values as an earlier signal replaced by it, then without the ops
+/// its result does not depend on
+MaskedProgram simplified(const MaskedProgram &program, unsigned inputs) {
+    const auto first_op = 2 * inputs + program.randoms, points = 1u << first_op;
+    const auto signal_count = first_op + program.ops.size();
+    std::vector<std::vector<bool>> values(signal_count, std::vector<bool>(points));
+    for (unsigned p = 0; p < points; p++) {
+        auto at_p = run(program, inputs, p);
+        for (size_t i = 0; i < signal_count; i++) {
+            values[i][p] = at_p[i];
+        }
+    }
+    // The earlier signal computing the same values as each signal
+    std::vector<std::uint8_t> same(signal_count);
+    std::map<std::vector<bool>, std::uint8_t> computed;
+    for (size_t i = 0; i < signal_count; i++) {
+        same[i] = computed.try_emplace(values[i], std::uint8_t(i)).first->second;
+    }
+    std::vector<bool> live(signal_count);
+    live[same[program.res[0]]] = live[same[program.res[1]]] = true;
+    for (auto i = signal_count; i-- > first_op;) {
+        if (live[i]) {
+            const auto &op = program.ops[i - first_op];
+            live[same[op.lhs]] = true;
+            if (op.op != "!") {
+                live[same[op.rhs]] = true;
+            }
+        }
+    }
+    std::vector<std::uint8_t> renamed(signal_count);
+    for (unsigned i = 0; i < first_op; i++) {
+        renamed[i] = std::uint8_t(i);
+    }
+    MaskedProgram res;
+    res.randoms = program.randoms;
+    for (auto i = first_op; i < signal_count; i++) {
+        if (live[i] && same[i] == i) {
+            auto op = program.ops[i - first_op];
+            op.lhs = renamed[same[op.lhs]];
+            op.rhs = op.op == "!" ? 0 : renamed[same[op.rhs]];
+            renamed[i] = std::uint8_t(first_op + res.ops.size());
+            res.ops.push_back(op);
+        }
+    }
+    res.res[0] = renamed[same[program.res[0]]];
+    res.res[1] = renamed[same[program.res[1]]];
+    return res;
+}
+
+/// The second share of the result of `program` is uniform whatever the inputs and their masks are
+bool isFresh(const MaskedProgram &program, unsigned inputs) {
+    const auto per_mask = 1u << program.randoms, points = 1u << (2 * inputs + program.randoms);
+    for (unsigned group = 0; group < points; group += per_mask) {
+        auto ones = 0u;
+        for (auto p = group; p < group + per_mask; p++) {
+            ones += run(program, inputs, p)[program.res[1]];
+        }
+        if (2 * ones != per_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Degree of the algebraic normal form of a function of `inputs` bits
+unsigned degreeOf(std::uint64_t truth_table, unsigned inputs) {
+    for (unsigned i = 0; i < inputs; i++) {
+        for (unsigned x = 0; x < (1u << inputs); x++) {
+            if (x >> i & 1) {
+                truth_table ^= (truth_table >> (x ^ (1u << i)) & 1) << x;
+            }
+        }
+    }
+    auto degree = 0u;
+    for (unsigned x = 0; x < (1u << inputs); x++) {
+        if (truth_table >> x & 1) {
+            degree = std::max(degree, unsigned(std::popcount(x)));
+        }
+    }
+    return degree;
+}
+
+/// A program of `op_count` ops and `randoms` random bits whose shares xor to the goal, if any is found before
+/// `deadline`. Each op is the AND or the XOR of a pair of earlier signals, every op but the last being read by a
+/// later op or being the first share of the result, the last op being its second share.
+/// ANDs only read XORs of the shares and the random bits, so every value is a polynomial of degree 2 at most of the
+/// inputs x, their masks m and the random bits r, encoded by its coefficients. Probing security is typed as by
+/// `RandomReusePass`: a value masked perfectly by a mask or a random bit (of coefficient 1, in no product) is uniform,
+/// a value of no input or combining secret-independent values of disjoint masks and random bits is
+/// secret-independent, and every op must be either.
+std::optional<MaskedProgram> search(const RegionSynthesizer::Goal &goal, unsigned randoms, unsigned op_count,
+                                    std::optional<std::chrono::steady_clock::time_point> deadline) {
+    const auto k = goal.inputs, inputs = 2 * k + randoms, signal_count = inputs + op_count;
+    // Variable v: input v < k, then mask v - k, then random bit v - 2k; products of v < w at `product(v, w)`
+    const auto variables = 2 * k + randoms;
+    auto product = [&](unsigned v, unsigned w) { return w * (w - 1) / 2 + v; };
+    const auto products = variables * (variables - 1) / 2;
+
+    z3::context ctx;
+    z3::solver solver(ctx, "QF_FD");
+    if (deadline) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+            return std::nullopt;
+        }
+        z3::params p(ctx);
+        p.set("timeout", unsigned(left.count()));
+        solver.set(p);
+    }
+
+    auto constant = [&](std::initializer_list<unsigned> vars) {
+        Signal s{{}, {}, ctx.bool_val(true)};
+        for (unsigned v = 0; v < variables; v++) {
+            s.linear.push_back(ctx.bool_val(std::find(vars.begin(), vars.end(), v) != vars.end()));
+        }
+        s.quadratic.assign(products, ctx.bool_val(false));
+        return s;
+    };
+    std::vector<Signal> signals;
+    for (unsigned i = 0; i < k; i++) {
+        signals.push_back(constant({i, k + i}));
+        signals.push_back(constant({k + i}));
+    }
+    for (unsigned j = 0; j < randoms; j++) {
+        signals.push_back(constant({2 * k + j}));
+    }
+    auto unknown = [&](const std::string &name) {
+        return Signal{boolConsts(ctx, name + "l", variables), boolConsts(ctx, name + "q", products),
+                      ctx.bool_const((name + "i").c_str())};
+    };
+    // Masks and random bits appearing in a signal
+    auto deps = [&](const Signal &s) {
+        std::vector<z3::expr> res;
+        for (auto v = k; v < variables; v++) {
+            std::vector<z3::expr> terms{s.linear[v]};
+            for (unsigned w = 0; w < variables; w++) {
+                if (w != v) {
+                    terms.push_back(s.quadratic[product(std::min(v, w), std::max(v, w))]);
+                }
+            }
+            res.push_back(mkOr(ctx, terms));
+        }
+        return res;
+    };
+    auto is_linear = [&](const Signal &s) { return !mkOr(ctx, s.quadratic); };
+
+    // Readers of each signal
+    std::vector<std::vector<z3::expr>> readers(signal_count);
+    // Signal picked as each operand of each op, one-hot
+    std::vector<std::vector<z3::expr>> lhs_picks, rhs_picks;
+    std::vector<z3::expr> is_and;
+    auto exactly_one = [&](const std::vector<z3::expr> &picks) {
+        z3::expr_vector v(ctx);
+        for (const auto &e : picks) {
+            v.push_back(e);
+        }
+        std::vector<int> ones(v.size(), 1);
+        solver.add(z3::pbeq(v, ones.data(), 1));
+    };
+    // The signal picked among `picks`
+    auto operand = [&](const std::string &name, const std::vector<z3::expr> &picks) {
+        auto res = unknown(name);
+        for (unsigned a = 0; a < picks.size(); a++) {
+            const auto &s = signals[a];
+            for (unsigned v = 0; v < variables; v++) {
+                solver.add(z3::implies(picks[a], res.linear[v] == s.linear[v]));
+            }
+            for (unsigned q = 0; q < products; q++) {
+                solver.add(z3::implies(picks[a], res.quadratic[q] == s.quadratic[q]));
+            }
+            solver.add(z3::implies(picks[a], res.independent == s.independent));
+        }
+        return res;
+    };
+    for (unsigned i = 0; i < op_count; i++) {
+        auto n = std::to_string(i) + "_";
+        lhs_picks.push_back(boolConsts(ctx, "a" + n, inputs + i));
+        rhs_picks.push_back(boolConsts(ctx, "b" + n, inputs + i));
+        is_and.push_back(ctx.bool_const(("and" + n).c_str()));
+        const auto &lp = lhs_picks.back(), &rp = rhs_picks.back();
+        exactly_one(lp);
+        exactly_one(rp);
+        for (unsigned a = 0; a < inputs + i; a++) {
+            for (unsigned b = 0; b <= a; b++) {
+                solver.add(!(lp[a] && rp[b]));
+            }
+            readers[a].push_back(lp[a]);
+            readers[a].push_back(rp[a]);
+        }
+        auto lhs = operand("L" + n, lp), rhs = operand("R" + n, rp);
+        solver.add(z3::implies(is_and[i], is_linear(lhs) && is_linear(rhs)));
+
+        auto op = unknown("O" + n);
+        for (unsigned v = 0; v < variables; v++) {
+            auto sum = lhs.linear[v] != rhs.linear[v], prod = lhs.linear[v] && rhs.linear[v];
+            solver.add(op.linear[v] == z3::ite(is_and[i], prod, sum));
+            for (unsigned w = v + 1; w < variables; w++) {
+                auto q = product(v, w);
+                auto cross = (lhs.linear[v] && rhs.linear[w]) != (lhs.linear[w] && rhs.linear[v]);
+                solver.add(op.quadratic[q] == z3::ite(is_and[i], cross, lhs.quadratic[q] != rhs.quadratic[q]));
+            }
+        }
+        std::vector<z3::expr> secret(op.linear.begin(), op.linear.begin() + k), masked;
+        for (unsigned v = 0; v < variables; v++) {
+            for (unsigned w = v + 1; w < variables; w++) {
+                if (v < k || w < k) {
+                    secret.push_back(op.quadratic[product(v, w)]);
+                }
+            }
+        }
+        auto op_deps = deps(op), lhs_deps = deps(lhs), rhs_deps = deps(rhs);
+        std::vector<z3::expr> overlaps;
+        for (auto v = k; v < variables; v++) {
+            std::vector<z3::expr> terms;
+            for (unsigned w = 0; w < variables; w++) {
+                if (w != v) {
+                    terms.push_back(op.quadratic[product(std::min(v, w), std::max(v, w))]);
+                }
+            }
+            masked.push_back(op.linear[v] && !mkOr(ctx, terms));
+            overlaps.push_back(lhs_deps[v - k] && rhs_deps[v - k]);
+        }
+        auto combined = lhs.independent && rhs.independent && !mkOr(ctx, overlaps);
+        solver.add(op.independent == (combined || !mkOr(ctx, secret) || mkOr(ctx, masked)));
+        solver.add(op.independent);
+        signals.push_back(std::move(op));
+    }
+
+    // The last op is the second share of the result, the first share is picked; they xor to the goal
+    auto res_picks = boolConsts(ctx, "res", signal_count - 1);
+    exactly_one(res_picks);
+    auto first = operand("res_", res_picks);
+    const auto &second = signals.back();
+    auto anf = goal.truth_table;
+    for (unsigned i = 0; i < k; i++) {
+        for (unsigned x = 0; x < (1u << k); x++) {
+            if (x >> i & 1) {
+                anf ^= (anf >> (x ^ (1u << i)) & 1) << x;
+            }
+        }
+    }
+    for (unsigned v = 0; v < variables; v++) {
+        auto goal_coefficient = ctx.bool_val(v < k && (anf >> (1u << v) & 1));
+        solver.add((first.linear[v] != second.linear[v]) == goal_coefficient);
+        for (unsigned w = v + 1; w < variables; w++) {
+            goal_coefficient = ctx.bool_val(w < k && (anf >> ((1u << v) | (1u << w)) & 1));
+            solver.add((first.quadratic[product(v, w)] != second.quadratic[product(v, w)]) == goal_coefficient);
+        }
+    }
+    for (unsigned j = 0; j + 1 < signal_count; j++) {
+        readers[j].push_back(res_picks[j]);
+    }
+    for (unsigned j = inputs; j + 1 < signal_count; j++) {
+        solver.add(mkOr(ctx, readers[j]));
+    }
+
+    if (solver.check() != z3::sat) {
+        return std::nullopt;
+    }
+    auto model = solver.get_model();
+    auto is_true = [&](const z3::expr &e) { return model.eval(e, true).is_true(); };
+    auto picked = [&](const std::vector<z3::expr> &picks) {
+        return std::uint8_t(std::find_if(picks.begin(), picks.end(), is_true) - picks.begin());
+    };
+    MaskedProgram program;
+    program.randoms = randoms;
+    for (unsigned i = 0; i < op_count; i++) {
+        program.ops.push_back({is_true(is_and[i]) ? "&&" : "^", picked(lhs_picks[i]), picked(rhs_picks[i])});
+    }
+    program.res[0] = picked(res_picks);
+    program.res[1] = std::uint8_t(signal_count - 1);
+    return program;
+}
+}  // namespace
+
+RegionSynthesizer::RegionSynthesizer(const std::vector<Goal> &goals, const GadgetCostWeights &weights,
+                                     const SynthesisOptions &opts)
+    : programs(goals.size()) {
+    auto threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        for (auto i = next++; i < goals.size(); i = next++) {
+            programs[i] = synthesize(goals[i], weights, opts);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < std::min<size_t>(threads, goals.size()); t++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+std::optional<MaskedProgram> RegionSynthesizer::synthesize(const Goal &goal, const GadgetCostWeights &weights,
+                                                           const SynthesisOptions &opts) {
+    // ANDs of the programs read XORs of shares and random bits only
+    if (degreeOf(goal.truth_table, goal.inputs) > 2) {
+        return std::nullopt;
+    }
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (opts.timeout_ms) {
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(opts.timeout_ms);
+    }
+    // ANDs and XORs of shares are 0 where all of them are, so a function of 1 at 0 is synthesized negated,
+    // then its first share is negated back
+    auto negated = goal;
+    const bool negate = goal.truth_table & 1;
+    if (negate) {
+        negated.truth_table = ~goal.truth_table & ((std::uint64_t{2} << ((1u << goal.inputs) - 1)) - 1);
+    }
+    auto cost = [&](unsigned randoms, unsigned ops) {
+        return weights.instruction * (ops + negate) + weights.random * randoms;
+    };
+
+    // Programs with spare ops are found much faster than the smallest ones are proven not to exist, so each search
+    // allows as many ops as the best cost so far does, the next one an op fewer than the program found needs
+    std::optional<MaskedProgram> best;
+    auto best_cost = goal.bound;
+    for (auto randoms = 0u; randoms <= opts.max_randoms; randoms++) {
+        auto ops = MAX_OPS;
+        while (ops > 0 && cost(randoms, ops) >= best_cost) {
+            ops--;
+        }
+        while (ops > 0) {
+            auto program = search(negated, randoms, ops, deadline);
+            if (!program) {
+                break;
+            }
+            best = simplified(*program, goal.inputs);
+            best_cost = cost(randoms, unsigned(best->ops.size()));
+            ops = unsigned(best->ops.size()) - 1;
+        }
+        if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+            break;
+        }
+    }
+    if (!best) {
+        return std::nullopt;
+    }
+    best->fresh = best->randoms > 0 && isFresh(*best, goal.inputs);
+    if (negate) {
+        auto negated_share = std::uint8_t(2 * goal.inputs + best->randoms + best->ops.size());
+        best->ops.push_back({"!", best->res[0], 0});
+        best->res[0] = negated_share;
+    }
+    return best;
+}
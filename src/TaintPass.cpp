@@ -0,0 +1,75 @@
+#include "Re-Sc-Masker/TaintPass.hpp"
+
+#include <llvm-16/llvm/Support/raw_ostream.h>
+
+#include <utility>
+
+#include "Re-Sc-Masker/Preludes.hpp"
+
+TaintPass::TaintPass(Region &&origin_region) : region(std::move(origin_region)) {
+    llvm::errs() << "===TaintPass: started===\n";
+    size_t gate_count = 0;
+    for (auto &inst : region.insts) {
+        if (inst.op == "//") {
+            continue;
+        }
+        // A word assembled from bits is as secret as any of them
+        if (inst.op == "/clear/") {
+            defined.insert(inst.res.name);
+            tainted.erase(inst.res.name);
+            continue;
+        }
+        if (inst.op == "/z3=>var/") {
+            if (isTainted(inst.lhs)) {
+                tainted.insert(inst.res.name);
+            }
+            continue;
+        }
+        // A split bit is as secret as the var it comes from, and a recomputed table as its masks
+        bool is_tainted;
+        if (inst.op == "/var=>z3/") {
+            is_tainted = isTainted(inst.lhs);
+        } else if (inst.op == "/lut-recompute/") {
+            is_tainted = isTainted(inst.rhs);
+        } else {
+            is_tainted = isTainted(inst.lhs) || (!inst.isUnaryOp() && isTainted(inst.rhs));
+        }
+        defined.insert(inst.res.name);
+        if (is_tainted) {
+            tainted.insert(inst.res.name);
+        } else {
+            tainted.erase(inst.res.name);
+        }
+        if (inst.op == "/var=>z3/") {
+            continue;
+        }
+
+        gate_count++;
+        inst.res.prop = is_tainted ? VProp::UNK : VProp::PUB;
+        // Temps named only by instructions are not declared
+        if (auto declared = region.sym_tbl.find(inst.res.name); declared != region.sym_tbl.end()) {
+            declared->second.prop = inst.res.prop;
+        }
+        public_count += !is_tainted;
+    }
+    llvm::errs() << "===TaintPass: " << public_count << " of " << gate_count
+                 << " instructions do not depend on secrets===\n";
+}
+
+bool TaintPass::isTainted(const ValueInfo &var) const {
+    if (var.name == "0" || var.name == "1") {
+        return false;
+    }
+    if (defined.count(var.name)) {
+        return tainted.count(var.name);
+    }
+    // Read before being defined in the region: an input, classified by the symbol table
+    auto input = region.sym_tbl.find(var.name);
+    if (input == region.sym_tbl.end()) {
+        return true;
+    }
+    auto prop = input->second.prop;
+    return prop != VProp::PUB && prop != VProp::RND && prop != VProp::CST;
+}
+
+Region TaintPass::get() { return region; }
@@ -0,0 +1,68 @@
+#include "Re-Sc-Masker/WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Worker {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+};
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned threads, const std::vector<size_t> &roots,
+                                   const std::function<void(size_t, const Push &)> &work) {
+    const size_t count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Worker> workers(count);
+    // Dealt in turn, the earliest roots being at the back of each deque
+    for (size_t i = 0; i < roots.size(); i++) {
+        workers[i % count].tasks.push_front(roots[i]);
+    }
+    std::atomic<size_t> pending = roots.size();
+
+    auto run = [&](size_t self) {
+        const Push push = [&](size_t task) {
+            pending++;
+            std::lock_guard lock(workers[self].mutex);
+            workers[self].tasks.push_back(task);
+        };
+        while (pending > 0) {
+            std::optional<size_t> task;
+            {
+                std::lock_guard lock(workers[self].mutex);
+                if (!workers[self].tasks.empty()) {
+                    task = workers[self].tasks.back();
+                    workers[self].tasks.pop_back();
+                }
+            }
+            for (size_t k = 1; !task && k < count; k++) {
+                auto &victim = workers[(self + k) % count];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                }
+            }
+            if (!task) {
+                std::this_thread::yield();
+                continue;
+            }
+            work(*task, push);
+            pending--;
+        }
+    };
+
+    std::vector<std::thread> others;
+    for (size_t t = 1; t < count; t++) {
+        others.emplace_back(run, t);
+    }
+    run(0);
+    for (auto &other : others) {
+        other.join();
+    }
+}
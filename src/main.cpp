@@ -1,39 +1,238 @@
+#include <clang/AST/Attr.h>
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclBase.h>
 #include <clang/AST/Expr.h>
+#include <clang/AST/ExprCXX.h>
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/AST/Stmt.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/Tooling.h>
 #include <llvm-16/llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "Re-Sc-Masker/AigPass.hpp"
 #include "Re-Sc-Masker/BitBlastPass.hpp"
+#include "Re-Sc-Masker/CleanupPass.hpp"
 #include "Re-Sc-Masker/Config.hpp"
+#include "Re-Sc-Masker/ConstMulPass.hpp"
+#include "Re-Sc-Masker/ConstPropPass.hpp"
+#include "Re-Sc-Masker/LookupTable.hpp"
+#include "Re-Sc-Masker/ParamBindingPass.hpp"
 #include "Re-Sc-Masker/Preludes.hpp"
+#include "Re-Sc-Masker/RandomReusePass.hpp"
+#include "Re-Sc-Masker/RangeAnalysisPass.hpp"
 #include "Re-Sc-Masker/RegionCollector.hpp"
 #include "Re-Sc-Masker/RegionConcatenater.hpp"
 #include "Re-Sc-Masker/RegionDivider.hpp"
 #include "Re-Sc-Masker/RegionMasker.hpp"
+#include "Re-Sc-Masker/TaintPass.hpp"
 
 using namespace clang::tooling;
 using namespace llvm;
 
 static llvm::cl::OptionCategory toolCategory("Re-SC-Masker <options>");
 
+static llvm::cl::opt<unsigned> goalTimeoutMs("z3-goal-timeout",
+                                             llvm::cl::desc("Time limit (ms) of bit-blasting one instruction in Z3, "
+                                                            "0 for unlimited"),
+                                             llvm::cl::init(SCM_Z3_GOAL_TIMEOUT_MS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> goalMaxSteps("z3-goal-max-steps",
+                                            llvm::cl::desc("Step limit of each Z3 tactic, 0 for unlimited"),
+                                            llvm::cl::init(SCM_Z3_GOAL_MAX_STEPS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> goalMaxMemoryMb("z3-goal-max-memory",
+                                               llvm::cl::desc("Memory limit (MB) of each Z3 tactic, 0 for unlimited"),
+                                               llvm::cl::init(SCM_Z3_GOAL_MAX_MEMORY_MB), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> ctxRecyclePeriod("z3-ctx-recycle",
+                                                llvm::cl::desc("Recreate the Z3 context after N instructions, "
+                                                               "0 to never recycle"),
+                                                llvm::cl::init(SCM_Z3_CTX_RECYCLE_PERIOD), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> directBlastOnly("direct-blast",
+                                           llvm::cl::desc("Bit-blast every instruction directly without Z3"),
+                                           llvm::cl::init(SCM_DIRECT_BLAST), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> narrowWidths("narrow-widths",
+                                        llvm::cl::desc("Narrow local vars to their significant bits before bit-blasting"),
+                                        llvm::cl::init(SCM_NARROW_WIDTHS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<std::string> bindParams(
+    "bind-params",
+    llvm::cl::desc("File of `name = value` lines fixing public params, the function is specialized on them"),
+    llvm::cl::init(""), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<std::string> varClasses(
+    "var-classes",
+    llvm::cl::desc("File of `name = secret|public|random` lines classifying params, overriding their attributes "
+                   "and the naming convention"),
+    llvm::cl::init(""), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> constMulCsd("const-mul-csd",
+                                       llvm::cl::desc("Rewrite multiplications by constants into shifts and "
+                                                      "additions/subtractions before bit-blasting"),
+                                       llvm::cl::init(SCM_CONST_MUL_CSD), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<AdderArch> adderArch(
+    "adder", llvm::cl::desc("Architecture of adders and subtractors"),
+    llvm::cl::values(clEnumValN(AdderArch::Z3, "z3", "Whatever Z3 bit-blasts, ripple-carry as a fallback"),
+                     clEnumValN(AdderArch::RippleCarry, "ripple", "Ripple-carry, fewest ANDs"),
+                     clEnumValN(AdderArch::BrentKung, "brent-kung", "Brent-Kung, low AND depth"),
+                     clEnumValN(AdderArch::KoggeStone, "kogge-stone", "Kogge-Stone, lowest AND depth"),
+                     clEnumValN(AdderArch::Auto, "auto", "The cheapest one under the masked cost model")),
+    llvm::cl::init(SCM_ADDER_ARCH), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> adderDepthWeight("adder-depth-weight",
+                                                llvm::cl::desc("Cost of one level of AND depth when choosing "
+                                                               "the adder automatically"),
+                                                llvm::cl::init(SCM_ADDER_DEPTH_WEIGHT), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<MultiplierArch> multiplierArch(
+    "multiplier", llvm::cl::desc("Architecture of multipliers"),
+    llvm::cl::values(clEnumValN(MultiplierArch::Z3, "z3", "Whatever Z3 bit-blasts, carry-save as a fallback"),
+                     clEnumValN(MultiplierArch::CarrySave, "carry-save", "Carry-save partial product accumulation"),
+                     clEnumValN(MultiplierArch::Karatsuba, "karatsuba", "Karatsuba splitting of wide operands")),
+    llvm::cl::init(SCM_MULTIPLIER_ARCH), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> karatsubaThreshold("karatsuba-threshold",
+                                                  llvm::cl::desc("Multiplications at least this wide are split "
+                                                                 "by Karatsuba"),
+                                                  llvm::cl::init(SCM_KARATSUBA_THRESHOLD),
+                                                  llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> carrySaveSums("carry-save-sums",
+                                         llvm::cl::desc("Compress trees of additions spanning several instructions "
+                                                        "with a single carry-propagate adder"),
+                                         llvm::cl::init(SCM_CARRY_SAVE_SUMS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<LutMasking> lutMasking(
+    "lut-masking", llvm::cl::desc("Masking of lookups in constant tables"),
+    llvm::cl::values(clEnumValN(LutMasking::Circuit, "circuit", "Bitsliced circuit of the table"),
+                     clEnumValN(LutMasking::Recompute, "recompute", "Table recomputed under fresh masks"),
+                     clEnumValN(LutMasking::Auto, "auto", "The cheaper one under the masked cost model")),
+    llvm::cl::init(SCM_LUT_MASKING), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> lutRecomputeCost("lut-recompute-cost",
+                                                llvm::cl::desc("Masked cost of recomputing one table entry when "
+                                                               "choosing how to mask a lookup"),
+                                                llvm::cl::init(SCM_LUT_RECOMPUTE_COST_PER_ENTRY),
+                                                llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> arithMasking("arith-masking",
+                                        llvm::cl::desc("Mask sums, differences and products by constants on "
+                                                       "arithmetic shares, converting at Boolean operations"),
+                                        llvm::cl::init(SCM_ARITH_MASKING), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> wordMasking("word-masking",
+                                       llvm::cl::desc("Mask bitwise operations on whole words when their operands are "
+                                                      "inputs or masked on words already"),
+                                       llvm::cl::init(SCM_WORD_MASKING), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> aigRewriteRounds("aig-rewrite-rounds",
+                                                llvm::cl::desc("Rounds of cut-based AIG rewriting, 0 to disable"),
+                                                llvm::cl::init(SCM_AIG_REWRITE_ROUNDS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> maskedCostAnd("masked-cost-and",
+                                             llvm::cl::desc("Cost of a masked AND gate when rewriting the AIG and "
+                                                            "choosing adders and lookup circuits"),
+                                             llvm::cl::init(SCM_MASKED_COST_AND), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> maskedCostXor("masked-cost-xor",
+                                             llvm::cl::desc("Cost of a masked XOR gate when rewriting the AIG and "
+                                                            "choosing adders and lookup circuits"),
+                                             llvm::cl::init(SCM_MASKED_COST_XOR), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> maskedCostNot("masked-cost-not",
+                                             llvm::cl::desc("Cost of a masked NOT gate when rewriting the AIG and "
+                                                            "choosing adders and lookup circuits"),
+                                             llvm::cl::init(SCM_MASKED_COST_NOT), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> shareLinearOps("share-linear-ops",
+                                          llvm::cl::desc("Compute XOR and NOT share by share, without fresh "
+                                                         "randomness"),
+                                          llvm::cl::init(SCM_SHARE_LINEAR_OPS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> maskingOrder("masking-order",
+                                            llvm::cl::desc("Masking order d, masked values being split into d+1 "
+                                                           "shares"),
+                                            llvm::cl::init(SCM_MASKING_ORDER), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<AndGadget> andGadget(
+    "and-gadget", llvm::cl::desc("Gadget of masked ANDs, used wherever it is secure"),
+    llvm::cl::values(clEnumValN(AndGadget::ISW, "isw", "Ishai-Sahai-Wagner, on independent operands"),
+                     clEnumValN(AndGadget::DOM, "dom", "Domain-oriented masking, on independent operands"),
+                     clEnumValN(AndGadget::HPC1, "hpc1", "DOM after refreshing one operand, on any operands"),
+                     clEnumValN(AndGadget::Auto, "auto", "The cheapest secure one under the gadget cost model")),
+    llvm::cl::init(SCM_AND_GADGET), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> gadgetCostInstruction("gadget-cost-instruction",
+                                                     llvm::cl::desc("Weight of #instructions when choosing gadgets"),
+                                                     llvm::cl::init(SCM_GADGET_COST_INSTRUCTION),
+                                                     llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> gadgetCostRandom("gadget-cost-random",
+                                                llvm::cl::desc("Weight of #random bits when choosing gadgets"),
+                                                llvm::cl::init(SCM_GADGET_COST_RANDOM), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> gadgetCostLatency("gadget-cost-latency",
+                                                 llvm::cl::desc("Weight of latency (gate levels) when choosing "
+                                                                "gadgets"),
+                                                 llvm::cl::init(SCM_GADGET_COST_LATENCY),
+                                                 llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> synthesizeRegions("synthesize-regions",
+                                             llvm::cl::desc("Mask fanout-free cones of gates by programs synthesized "
+                                                            "by Z3 where cheaper than gadgets (first order only)"),
+                                             llvm::cl::init(SCM_SYNTHESIZE_REGIONS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> regionMaxInputs("region-max-inputs",
+                                               llvm::cl::desc("Most input bits of a cone of synthesized gates"),
+                                               llvm::cl::init(SCM_REGION_MAX_INPUTS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> synthesisTimeoutMs("synthesis-timeout",
+                                                  llvm::cl::desc("Time limit (ms) of synthesizing one region, 0 for "
+                                                                 "unlimited"),
+                                                  llvm::cl::init(SCM_SYNTHESIS_TIMEOUT_MS),
+                                                  llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> synthesisThreads("synthesis-threads",
+                                                llvm::cl::desc("Regions synthesized in parallel, 0 for one per "
+                                                               "hardware thread"),
+                                                llvm::cl::init(SCM_SYNTHESIS_THREADS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> regionSize("region-size",
+                                          llvm::cl::desc("Instructions per region of a partition of the circuit "
+                                                         "with few edges between regions, 0 for one per region"),
+                                          llvm::cl::init(SCM_PARTITION_REGION_SIZE), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> maskingThreads("masking-threads",
+                                              llvm::cl::desc("Regions masked in parallel, 0 for one per hardware "
+                                                             "thread"),
+                                              llvm::cl::init(SCM_MASKING_THREADS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> reuseRandoms("reuse-randoms",
+                                        llvm::cl::desc("Merge random bits of the masked code wherever every "
+                                                       "intermediate value stays as secure"),
+                                        llvm::cl::init(SCM_REUSE_RANDOMS), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<unsigned> randomReuseTimeoutMs("random-reuse-timeout",
+                                                    llvm::cl::desc("Time limit (ms) of proving that one value does "
+                                                                   "not depend on random bits, 0 for unlimited"),
+                                                    llvm::cl::init(SCM_RANDOM_REUSE_TIMEOUT_MS),
+                                                    llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> splitOffline("split-offline",
+                                        llvm::cl::desc("Move instructions not depending on inputs into a precompute "
+                                                       "function filling a state read by the masked function"),
+                                        llvm::cl::init(SCM_SPLIT_OFFLINE), llvm::cl::cat(toolCategory));
+static llvm::cl::opt<bool> taintAnalysis("taint-analysis",
+                                         llvm::cl::desc("Emit instructions not depending on secrets unmasked"),
+                                         llvm::cl::init(SCM_TAINT_ANALYSIS), llvm::cl::cat(toolCategory));
+
 // TODO: move inside of the class
 Region globalRegion;
 std::vector<std::string> original_fparams;
 ValueInfo ret_var;
+/// Names of param classes given by the user
+const std::unordered_map<std::string, VProp> PARAM_CLASS_NAMES = {
+    {"secret", VProp::SECRET}, {"public", VProp::PUB}, {"random", VProp::RND}};
+/// Classes of params given by `--var-classes`
+std::unordered_map<std::string, VProp> param_classes;
+/// Values of public params given by `--bind-params`
+ParamBindingPass::Bindings param_bindings;
+
+/// Class of a param given by the user, either in `--var-classes` or by `__attribute__((annotate("secret")))`
+std::optional<VProp> userClassOf(const clang::VarDecl *varDecl) {
+    auto cls = param_classes.find(varDecl->getNameAsString());
+    if (cls != param_classes.end()) {
+        return cls->second;
+    }
+    for (const auto *attr : varDecl->specific_attrs<clang::AnnotateAttr>()) {
+        auto name = PARAM_CLASS_NAMES.find(attr->getAnnotation().str());
+        if (name != PARAM_CLASS_NAMES.end()) {
+            return name->second;
+        }
+    }
+    return std::nullopt;
+}
 
 class ScMaskerASTVisitor : public clang::RecursiveASTVisitor<ScMaskerASTVisitor> {
 public:
-    int depth = 0;  // Tracks the current depth in the AST
+    int depth = 0;       // Tracks the current depth in the AST
+    int temp_count = 0;  // For names of temps
 
     bool VisitDecl(clang::Decl *decl) {
         auto ctxt = decl->getDeclContext();
@@ -41,6 +240,12 @@ public:
             return true;
         }
 
+        // Constant tables at file scope
+        if (auto *varDecl = clang::dyn_cast<clang::VarDecl>(decl); varDecl && ctxt->isFileContext()) {
+            registerTable(varDecl);
+            return true;
+        }
+
         // Check if the declaration is inside a function body
         if (auto *funcDecl = clang::dyn_cast<clang::FunctionDecl>(ctxt)) {
             printIndented("Decl", decl);
@@ -58,6 +263,10 @@ public:
                     if (varDecl->getType()->isPointerType()) {
                         prop = VProp::OUTPUT;
                     }
+                    // Then the class given by the user
+                    else if (auto cls = userClassOf(varDecl)) {
+                        prop = *cls;
+                    }
                     // Otherwise check the naming convention
                     else if (varName[0] == 'r') {
                         prop = VProp::RND;
@@ -85,6 +294,30 @@ public:
         return true;  // Continue the traversal
     }
 
+    /// Register a `const` array initialized by constants as a lookup table
+    void registerTable(const clang::VarDecl *varDecl) {
+        const auto *arrayType =
+            clang::dyn_cast_or_null<clang::ConstantArrayType>(varDecl->getType()->getAsArrayTypeUnsafe());
+        const auto *init = clang::dyn_cast_or_null<clang::InitListExpr>(varDecl->getInit());
+        if (!arrayType || !arrayType->getElementType().isConstQualified() || !init) {
+            return;
+        }
+        LookupTable table{getWidthFromType(arrayType->getElementType().getUnqualifiedType().getAsString()), {}, {}};
+        for (unsigned i = 0; i < init->getNumInits(); i++) {
+            clang::Expr::EvalResult entry;
+            if (!init->getInit(i)->EvaluateAsInt(entry, varDecl->getASTContext())) {
+                llvm::errs() << "Table " << varDecl->getNameAsString() << " ignored: entry " << i
+                             << " is not a constant\n";
+                return;
+            }
+            const auto &value = entry.Val.getInt();
+            table.entries.push_back(value.isSigned() ? uint64_t(value.getSExtValue()) : value.getZExtValue());
+        }
+        table.entries.resize(arrayType->getSize().getZExtValue(), 0);
+        llvm::errs() << "Table inserted: " << varDecl->getNameAsString() << "[" << table.entries.size() << "]\n";
+        LookupTable::all()[varDecl->getNameAsString()] = std::move(table);
+    }
+
     clang::Stmt *unfold(clang::Stmt *expr) {
         // If the expression is an ImplicitCastExpr, we need to unwrap the cast and
         // get the actual operand.
@@ -103,6 +336,106 @@ public:
         return expr;  // Return the original expression if it's not a cast
     }
 
+    /// A new temp var holding the value of an intermediate expression
+    ValueInfo newTemp(const clang::Expr *expr) {
+        auto name = "_t" + std::to_string(temp_count++);
+        auto vi = ValueInfo{name, getWidthFromType(expr->getType().getAsString()), VProp::UNK, nullptr};
+        globalRegion.sym_tbl[name] = vi;
+        return vi;
+    }
+
+    /// Flatten an expression into instructions on temps.
+    /// Return the var (or constant) holding its value, or nothing if the expression is not supported.
+    std::optional<ValueInfo> lowerExpr(clang::Expr *expr) {
+        if (auto *parenExpr = clang::dyn_cast<clang::ParenExpr>(expr)) {
+            return lowerExpr(parenExpr->getSubExpr());
+        }
+        if (auto *declRef = clang::dyn_cast<clang::DeclRefExpr>(expr)) {
+            return globalRegion.sym_tbl[declRef->getDecl()->getNameAsString()];
+        }
+        if (auto *literal = clang::dyn_cast<clang::IntegerLiteral>(expr)) {
+            return ValueInfo{std::to_string(literal->getValue().getZExtValue()),
+                             getWidthFromType(expr->getType().getAsString()), VProp::CST, nullptr};
+        }
+        if (auto *literal = clang::dyn_cast<clang::CXXBoolLiteralExpr>(expr)) {
+            return ValueInfo{literal->getValue() ? "1" : "0", 1, VProp::CST, nullptr};
+        }
+        if (auto *castExpr = clang::dyn_cast<clang::CastExpr>(expr)) {  // both implicit and explicit ones
+            auto sub = lowerExpr(castExpr->getSubExpr());
+            if (!sub) {
+                return std::nullopt;
+            }
+            auto width = getWidthFromType(castExpr->getType().getAsString());
+            if (width == sub->width) {
+                return sub;
+            }
+            if (sub->prop == VProp::CST) {  // fold it
+                auto value = std::stoull(sub->name);
+                if (getBitWidth(width) < 64) {
+                    value &= (uint64_t(1) << getBitWidth(width)) - 1;
+                }
+                return ValueInfo{std::to_string(value), width, VProp::CST, nullptr};
+            }
+            // Extensions and truncations are bit rewiring after bit-blasting
+            auto temp = newTemp(castExpr);
+            globalRegion.insts.emplace_back("=", temp, *sub, ValueInfo());
+            return temp;
+        }
+        if (auto *unOp = clang::dyn_cast<clang::UnaryOperator>(expr)) {
+            auto oprand = lowerExpr(unOp->getSubExpr());
+            if (!oprand) {
+                return std::nullopt;
+            }
+            switch (unOp->getOpcode()) {
+                case clang::UO_Deref:  // output params
+                case clang::UO_Plus:
+                    return oprand;
+                case clang::UO_Minus: {  // -a == 0 - a
+                    auto temp = newTemp(unOp);
+                    globalRegion.insts.emplace_back("-", temp, ValueInfo{"0", temp.width, VProp::CST, nullptr},
+                                                    *oprand);
+                    return temp;
+                }
+                default: {
+                    auto temp = newTemp(unOp);
+                    globalRegion.insts.emplace_back(clang::UnaryOperator::getOpcodeStr(unOp->getOpcode()).str(), temp,
+                                                    *oprand, ValueInfo());
+                    return temp;
+                }
+            }
+        }
+        if (auto *subscript = clang::dyn_cast<clang::ArraySubscriptExpr>(expr)) {  // lookups in constant tables only
+            auto *base = clang::dyn_cast<clang::DeclRefExpr>(subscript->getBase()->IgnoreParenImpCasts());
+            auto table = base ? LookupTable::all().find(base->getDecl()->getNameAsString()) : LookupTable::all().end();
+            if (table == LookupTable::all().end()) {
+                llvm::errs() << "Unsupported subscript: not a constant table\n";
+                return std::nullopt;
+            }
+            auto index = lowerExpr(subscript->getIdx());
+            if (!index) {
+                return std::nullopt;
+            }
+            auto temp = newTemp(subscript);
+            globalRegion.insts.emplace_back("[]", temp,
+                                            ValueInfo{table->first, table->second.width, VProp::CST, nullptr}, *index);
+            return temp;
+        }
+        if (auto *binOp = clang::dyn_cast<clang::BinaryOperator>(expr)) {
+            auto oprand1 = lowerExpr(binOp->getLHS());
+            auto oprand2 = lowerExpr(binOp->getRHS());
+            if (!oprand1 || !oprand2) {
+                return std::nullopt;
+            }
+            auto temp = newTemp(binOp);
+            globalRegion.insts.emplace_back(clang::BinaryOperator::getOpcodeStr(binOp->getOpcode()).str(), temp,
+                                            *oprand1, *oprand2);
+            return temp;
+        }
+        llvm::errs() << "Unsupported expression:\n";
+        expr->dump();
+        return std::nullopt;
+    }
+
     bool VisitStmt(clang::Stmt *stmt) {
         if (stmt) {
             printIndented("Stmt", stmt);
@@ -113,91 +446,60 @@ public:
             if (binOp->getOpcode() == clang::BinaryOperatorKind::BO_Assign) {  // "assignment"
                 clang::Expr *wrappedAssignTo = binOp->getLHS();
                 clang::Expr *wrappedAssignWith = binOp->getRHS();
-                // wrappedAssignTo->children();
                 assert(wrappedAssignTo != nullptr);
                 assert(wrappedAssignWith != nullptr);
 
-                // // Extract actual operands, unwrapping implicit casts if needed
+                // `a = ...` or `*out = ...`
                 auto res = unfold(wrappedAssignTo);
-                auto assignWith = unfold(wrappedAssignWith);
-                assert(res != nullptr);
-                assert(assignWith != nullptr);
-                llvm::errs() << "....";
-                res->dump();
-                llvm::errs() << "====";
-                assignWith->dump();
-
+                if (auto *derefOp = clang::dyn_cast<clang::UnaryOperator>(res);
+                    derefOp && derefOp->getOpcode() == clang::UO_Deref) {
+                    res = unfold(derefOp->getSubExpr());
+                }
                 auto *resRef = clang::dyn_cast<clang::DeclRefExpr>(res);
-                if (resRef) {
-                    llvm::errs() << resRef->getNameInfo().getAsString() << "\n";
-                } else {
-                    llvm::errs() << "NO! " << resRef->getNameInfo().getAsString() << "\n";
+                if (!resRef) {
+                    llvm::errs() << "NO! Unsupported assignment target\n";
+                    res->dump();
                     return false;  // FAILED
                 }
-                // Get the LHS variable
-                std::string lhsStr;
-                llvm::raw_string_ostream lhsOS(lhsStr);
-                res->printPretty(lhsOS, nullptr, clang::PrintingPolicy(clang::LangOptions()));
-
-                // Check the expression
-                if (auto *nestedBinOp = clang::dyn_cast<clang::BinaryOperator>(assignWith)) {
-                    // BINOP: C = A op B
-                    llvm::errs() << "-----BINOP Assignment: \n";
-                    // TODO: allow constants
-                    auto oprand1 = clang::dyn_cast<clang::DeclRefExpr>(unfold(nestedBinOp->getLHS()));
-                    auto oprand2 = clang::dyn_cast<clang::DeclRefExpr>(unfold(nestedBinOp->getRHS()));
-                    assert(oprand1);
-                    assert(oprand2);
-                    oprand1->dump();
-                    oprand2->dump();
-                    llvm::errs() << "-----BINOP end\n";
-                    globalRegion.insts.emplace_back(clang::BinaryOperator::getOpcodeStr(nestedBinOp->getOpcode()).str(),
-                                                    globalRegion.sym_tbl[resRef->getDecl()->getNameAsString()],
-                                                    globalRegion.sym_tbl[oprand1->getDecl()->getNameAsString()],
-                                                    globalRegion.sym_tbl[oprand2->getDecl()->getNameAsString()]);
-                } else if (auto *unOp = clang::dyn_cast<clang::UnaryOperator>(assignWith)) {
-                    // UOP: C = op A
-                    llvm::errs() << "-----UOP Assignment: \n";
-                    // TODO: allow constants
-                    auto oprand = clang::dyn_cast<clang::DeclRefExpr>(unfold(unOp->getSubExpr()));
-                    assert(oprand);
-                    oprand->dump();
-                    llvm::errs() << "-----UOP end\n";
-                    globalRegion.insts.emplace_back(clang::UnaryOperator::getOpcodeStr(unOp->getOpcode()).str(),
-                                                    globalRegion.sym_tbl[resRef->getDecl()->getNameAsString()],
-                                                    globalRegion.sym_tbl[oprand->getDecl()->getNameAsString()],
-                                                    ValueInfo());
-                } else if (auto *directRef = clang::dyn_cast<clang::DeclRefExpr>(assignWith)) {
-                    // Handle direct assignments (a = b)
-                    llvm::errs() << "-----Direct Assignment: \n";
-                    directRef->dump();
-                    llvm::errs() << resRef->getDecl()->getNameAsString() << "\n";
-                    llvm::errs() << directRef->getDecl()->getNameAsString() << "\n";
-                    llvm::errs() << "-----Direct Assignment end\n";
-                    globalRegion.insts.emplace_back("=",  // Use assignment operator
-                                                    globalRegion.sym_tbl[resRef->getDecl()->getNameAsString()],
-                                                    globalRegion.sym_tbl[directRef->getDecl()->getNameAsString()],
-                                                    ValueInfo());  // No third operand needed for direct assignment
-                } else {
-                    // Invalid: Other forms
+                auto target = globalRegion.sym_tbl[resRef->getDecl()->getNameAsString()];
+
+                llvm::errs() << "-----Assignment to " << target.name << ": \n";
+                auto value = lowerExpr(wrappedAssignWith);
+                if (!value) {
                     std::string rhsStr;
                     llvm::raw_string_ostream rhsOS(rhsStr);
-                    assignWith->printPretty(rhsOS, nullptr, clang::PrintingPolicy(clang::LangOptions()));
+                    wrappedAssignWith->printPretty(rhsOS, nullptr, clang::PrintingPolicy(clang::LangOptions()));
+                    llvm::errs() << "NO! Unsupported expression: " << rhsStr << "\n";
+                    return false;  // FAILED
+                }
+
+                auto &insts = globalRegion.insts;
+                bool is_last_temp = temp_count > 0 && value->name == "_t" + std::to_string(temp_count - 1);
+                if (is_last_temp && !insts.empty() && insts.back().res.name == value->name) {
+                    // `_t = a op b; c = _t;` -> `c = a op b;`
+                    globalRegion.sym_tbl.erase(value->name);
+                    insts.back().res = target;
+                } else {
+                    insts.emplace_back("=", target, *value, ValueInfo());
                 }
+                llvm::errs() << "-----Assignment end: " << insts.back().toString() << "\n";
                 return true;  // done with this statement
             }
             return true;
         }
         if (auto *retStmt = clang::dyn_cast<clang::ReturnStmt>(stmt)) {
-            auto ret = unfold(retStmt->getRetValue());
+            if (!retStmt->getRetValue()) {  // `return;`
+                return true;
+            }
             llvm::errs() << "-----RET\n";
-            ret->dump();
-            assert(clang::dyn_cast<clang::DeclRefExpr>(ret));
-            auto retVarName = clang::dyn_cast<clang::DeclRefExpr>(ret)->getDecl()->getNameAsString();
-            ret_var = ValueInfo(
-                retVarName,
-                getWidthFromType(clang::dyn_cast<clang::DeclRefExpr>(ret)->getDecl()->getType().getAsString()),
-                VProp::OUTPUT, nullptr);
+            retStmt->getRetValue()->dump();
+            // NOTE: a non-trivial return value is computed into a temp
+            auto ret = lowerExpr(retStmt->getRetValue());
+            if (!ret || ret->prop == VProp::CST) {
+                llvm::errs() << "NO! Unsupported return value\n";
+                return false;  // FAILED
+            }
+            ret_var = ValueInfo(ret->name, ret->width, VProp::OUTPUT, nullptr);
             return true;
         }
         if (auto *declStmt = clang::dyn_cast<clang::DeclStmt>(stmt)) {
@@ -272,23 +574,113 @@ public:
         llvm::errs() << "---Global Region DUMP---\n";
         globalRegion.dump();
 
+        // Public params fixed at deployment become constants
+        if (!bindParams.empty()) {
+            llvm::errs() << "---Param Binding---\n";
+            ParamBindingPass binding(std::move(globalRegion), param_bindings);
+            std::erase_if(original_fparams, [&](const auto &name) { return binding.bound.count(name); });
+            globalRegion = binding.get();
+            globalRegion.dump();
+        }
+
+        // Multiplications by constants become shifts and adds, unless they are masked arithmetically
+        auto arith_masking = arithMasking && maskingOrder <= 1;
+        if (constMulCsd && !arith_masking) {
+            llvm::errs() << "---Constant Multiplication---\n";
+            globalRegion = ConstMulPass(std::move(globalRegion)).get();
+            globalRegion.dump();
+        }
+
+        // Value-range analysis
+        if (narrowWidths) {
+            llvm::errs() << "---Range Analysis---\n";
+            globalRegion = RangeAnalysisPass(ret_var, std::move(globalRegion)).get();
+            globalRegion.dump();
+        }
+
         // Bit-blasting
         llvm::errs() << "---Bit-Blast(Per Instr.)---\n";
-        auto blasted = Z3BitBlastPass(ret_var, std::move(globalRegion));
+        BitBlastOptions blast_opts;
+        blast_opts.goal_timeout_ms = goalTimeoutMs;
+        blast_opts.goal_max_steps = goalMaxSteps;
+        blast_opts.goal_max_memory_mb = goalMaxMemoryMb;
+        blast_opts.ctx_recycle_period = ctxRecyclePeriod;
+        blast_opts.direct_only = directBlastOnly;
+        blast_opts.arith.adder_arch = adderArch;
+        blast_opts.arith.adder_depth_weight = adderDepthWeight;
+        blast_opts.arith.multiplier_arch = multiplierArch;
+        blast_opts.arith.karatsuba_threshold = karatsubaThreshold;
+        blast_opts.arith.masked_cost = MaskedCost{maskedCostAnd, maskedCostXor, maskedCostNot};
+        blast_opts.carry_save_sums = carrySaveSums;
+        blast_opts.lut_masking = lutMasking;
+        blast_opts.lut_recompute_cost_per_entry = lutRecomputeCost;
+        // The conversions between Boolean and arithmetic shares, and the gadgets on words, are first-order only
+        blast_opts.arith_masking = arith_masking;
+        blast_opts.word_masking = wordMasking && maskingOrder <= 1;
+        auto blasted = Z3BitBlastPass(ret_var, std::move(globalRegion), blast_opts);
         globalRegion = blasted.get();
         globalRegion.dump();
 
+        // Fold constant bits, so that they never reach the masker
+        llvm::errs() << "---Constant Propagation---\n";
+        globalRegion = ConstPropPass(std::move(globalRegion)).get();
+        globalRegion.dump();
+
+        // Merge duplicate gates and absorb NOT gates in an AIG, then minimize its masked cost
+        llvm::errs() << "---AIG---\n";
+        AigOptions aig_opts;
+        aig_opts.rewrite_rounds = aigRewriteRounds;
+        aig_opts.cost = blast_opts.arith.masked_cost;
+        globalRegion = AigPass(std::move(globalRegion), aig_opts).get();
+
+        // Drop copies, dead instructions and unused symbols before masking
+        llvm::errs() << "---Cleanup---\n";
+        globalRegion = CleanupPass(std::move(globalRegion)).get();
+        globalRegion.dump();
+
+        // Only the secret cone needs masking
+        if (taintAnalysis) {
+            llvm::errs() << "---Taint Analysis---\n";
+            globalRegion = TaintPass(std::move(globalRegion)).get();
+        }
+
         // REPLACE phase: Replace each region with a masked region
         llvm::errs() << "---REPLACE---\n";
         auto global_st = globalRegion.sym_tbl;
 
         // !!! Main pipeline is here
-        auto divided = TrivialRegionDivider(std::move(globalRegion));
-        auto masked = TrivialRegionMasker(std::move(divided));
-        auto combined = RegionCollector(std::move(masked));
-        auto final = RegionConcatenater(std::move(combined));
+        MaskingOptions mask_opts;
+        mask_opts.share_linear_ops = shareLinearOps;
+        mask_opts.order = std::max(1u, unsigned(maskingOrder));
+        mask_opts.and_gadget = andGadget;
+        mask_opts.cost_weights = GadgetCostWeights{gadgetCostInstruction, gadgetCostRandom, gadgetCostLatency};
+        mask_opts.synthesize_regions = synthesizeRegions;
+        mask_opts.synthesis.timeout_ms = synthesisTimeoutMs;
+        mask_opts.synthesis.threads = synthesisThreads;
+        mask_opts.threads = maskingThreads;
+        auto mask = [&](auto &&divided) {
+            auto masked = TrivialRegionMasker(std::move(divided), mask_opts);
+            auto combined = RegionCollector(std::move(masked));
+            auto final = RegionConcatenater(std::move(combined));
+
+            // Draw fewer random bits; the types of `RandomReusePass` only tell first-order security
+            if (reuseRandoms && mask_opts.order == 1) {
+                llvm::errs() << "---Random Reuse---\n";
+                RandomReuseOptions reuse_opts;
+                reuse_opts.solver_timeout_ms = randomReuseTimeoutMs;
+                final.region = RandomReusePass(ret_var, std::move(final.region), original_fparams, reuse_opts).get();
+            }
 
-        final.printAsCode("masked_func", ret_var, original_fparams);
+            final.printAsCode("masked_func", ret_var, original_fparams, splitOffline);
+        };
+        // Synthesized regions are cones of several gates, which only pay off at first order, see `main`
+        if (synthesizeRegions) {
+            mask(ConeRegionDivider(std::move(globalRegion), regionMaxInputs));
+        } else if (regionSize > 0) {
+            mask(PartitionRegionDivider(std::move(globalRegion), regionSize));
+        } else {
+            mask(TrivialRegionDivider(std::move(globalRegion)));
+        }
     }
 };
 
@@ -312,6 +704,45 @@ int main(int argc, const char **argv) {
     auto argsParser = CommonOptionsParser::create(argc, argv, toolCategory);
 
     CommonOptionsParser &optionsParser = argsParser.get();
+    // The conversions between Boolean and arithmetic shares, and the gadgets on words, are first-order only
+    if (arithMasking && maskingOrder > 1) {
+        llvm::errs() << "Warning: --arith-masking is first-order only, ignored at --masking-order=" << maskingOrder
+                     << "\n";
+    }
+    if (wordMasking && maskingOrder > 1) {
+        llvm::errs() << "Warning: --word-masking is first-order only, ignored at --masking-order=" << maskingOrder
+                     << "\n";
+    }
+    // Synthesized programs mask cones of their own division on two shares
+    if (synthesizeRegions && (maskingOrder > 1 || !shareLinearOps || regionSize > 0)) {
+        llvm::errs() << "--synthesize-regions cannot be combined with "
+                     << (maskingOrder > 1  ? "--masking-order=" + std::to_string(maskingOrder)
+                         : !shareLinearOps ? std::string("--share-linear-ops=false")
+                                           : "--region-size=" + std::to_string(regionSize))
+                     << "\n";
+        return 1;
+    }
+    if (!varClasses.empty()) {
+        auto parsed = parseAssignments(
+            varClasses, "name = secret|public|random", [](const std::string &name, const std::string &cls) {
+                auto prop = PARAM_CLASS_NAMES.find(cls);
+                if (prop == PARAM_CLASS_NAMES.end()) {
+                    return false;
+                }
+                param_classes[name] = prop->second;
+                return true;
+            });
+        if (!parsed) {
+            return 1;
+        }
+    }
+    if (!bindParams.empty()) {
+        auto bindings = ParamBindingPass::parseFile(bindParams);
+        if (!bindings) {
+            return 1;
+        }
+        param_bindings = std::move(*bindings);
+    }
     ClangTool tool(optionsParser.getCompilations(), optionsParser.getSourcePathList());
     auto af = std::make_unique<ScMaskerFrontendActionFactory>();
     auto result = tool.run(af.get());